@@ -11,28 +11,55 @@
 
 #include <math.h>       // For mathematic operations.
 #include <cstdio>
-#include <TextureLoader.h> //For loading an image for the texture mapping
+#include "texture.hpp" //For loading an image for the texture mapping
 #include "objloader.hpp"
+#include "mesh.hpp"
+#include "meshprep.hpp"
+#include "meshcache.hpp"
+#include "gpumesh.hpp"
+#include "edges.hpp"
+#include "bench.hpp"
+#include "headless.hpp"
+#include "transform.hpp"
+#include "softraster.hpp"
+#include "asyncasset.hpp"
+#include "lod.hpp"
+#include "vcache.hpp"
+#include "quantise.hpp"
+#include "bvh.hpp"
+#include "clusters.hpp"
+#include "scene.hpp"
+#include "profiler.hpp"
+#include "gputimer.hpp"
+#include "framepacer.hpp"
+#include "inputqueue.hpp"
+#include "camera.hpp"
+#include "asynclog.hpp"
+#include "clock.hpp"
+#include <algorithm>
 #include <array>
+#include <string>
 #include <vector>
 
 // Global variable for current rendering mode.
 char rendermode;
  
-//Camera variables
-int cameraX = 5;
-int cameraY = 5;
-int cameraZ = 10;
-int centerZ = 0;
-int centerX = 0;
-int centerY = 0;
+//Camera eye and centre, and the rotation of the cube (and meshes)
+CameraState camera = camera_default();
+
+//Input events from the GLUT callbacks, applied to the camera and settings
+//once per frame, and the pointer position of the last drag
+InputQueue inputQueue;
+std::vector<InputEvent> inputEvents;
 int oldX = 0;
 int oldY = 0;
+const float dragUnitsPerPixel = 0.25f;
+const float dragLimit = 40.0f;
+size_t inputEventCount = 0;   // Events applied in the last frame, before coalescing
+double inputDelay = 0.0;      // Seconds from the oldest of them to the frame
 
-//Cube rotation variables
-float rotqubeX = 0;
-float rotqubeY = 0;
-float rotqubeZ = 0;
+//Window messages, written off the render thread
+AsyncLog logSink;
 
 //Specifying the position for the light source
 GLfloat pos[4] = { 0.00, 1.00, 3.00, 0.00 };
@@ -45,50 +72,441 @@ GLfloat material_Se[] = { 10 };
 
 //Texture mapping variables
 GLuint g_textureID[1];
-unsigned char* image = NULL;
 int iheight, iwidth;
 
-//For loading the meshes
-std::vector<std::array<float, 3>> vertices;
-std::vector<std::array<int, 3>> vertexIndices;
+//The loaded mesh (structure-of-arrays) and its per-face normals
+Mesh mesh;
+Float3Array faceNormals;
+
+//Retained vertex/index buffers for the mesh, and a switch back to the
+//immediate-mode path for comparing the per-frame cost ('i' key)
+GpuMesh meshBuffers;
+bool immediateMesh = false;
+
+//Mesh shading: flat face normals, or smooth vertex normals blended by face
+//area or corner angle ('1'/'2'/'3' keys)
+enum ShadingMode { SHADING_FLAT, SHADING_SMOOTH_AREA, SHADING_SMOOTH_ANGLE };
+int shadingMode = SHADING_FLAT;
+int preparedShading = -1;
+int normalsShading = -1;
+Float3Array vertexNormals;
+
+//Simplified levels of the mesh (LOD_FRACTIONS of its triangles) for the
+//'b' mode, picked by the mesh's size on screen unless fixed with the 'l' key
+std::vector<MeshLod> meshLods;
+std::vector<Float3Array> lodVertexNormals;
+std::vector<GpuMesh> lodBuffers;
+float meshRadius = 0.0f;
+int lodSetting = -1;  // -1 picks the level automatically
+int drawnLod = 0;
+
+//Unique edges of the mesh for the wireframe mode, and their line buffer
+EdgeList meshEdges;
+GpuLines edgeBuffers;
+
+//Clusters of every detail level (CLUSTER_TRIANGLES triangles each), culled
+//against the view before the 'b' mode draws ('c' key turns this off)
+std::vector<std::vector<MeshCluster>> meshClusters;
+std::vector<MeshDrawRange> drawRanges;
+bool clusterCulling = true;
+ClusterCullStats cullStats = {};
+
+//Ray-cast acceleration structure over the mesh, and the triangle of the
+//mesh under the last left click (-1 for none), highlighted in every mesh mode
+Bvh meshBvh;
+int pickedTriangle = -1;
+
+//Scene mode ('g'): many instances of the meshes in sceneFiles on a grid,
+//batched by mesh and material ('+'/'-' double or halve the instances, 'j'
+//toggles instanced draws). The meshes load the first time the mode is used.
+struct SceneMeshSource
+{
+	std::string path;
+	Mesh mesh;
+	Float3Array normals;
+};
+const char* const mainMeshFile = "bunny.obj";
+std::vector<std::string> sceneFiles = { "bunny.obj", "screwdriver.obj" };
+Scene scene;
+AsyncAsset<std::vector<SceneMeshSource>> sceneLoader;
+int sceneInstances = 256;
+bool sceneRequested = false;
+SceneDrawStats sceneStats = {};
+
+//CPU timings of the frame's phases ('p' toggles them and the overlay
+//listing them, 't' writes the recorded frames as a Chrome trace)
+FrameProfiler profiler;
+GpuTimer gpuTimer;  // GPU time of the same phases, on with the profiler
+const char* const traceFile = "trace.json";
+const uint32_t overlayFrames = 60;  // Frames the overlay averages over.
+
+//When the window redraws: only after something changed, unless 'h' sets a
+//fixed rate. GLUT timers wake the pacer for due frames and, while loader
+//threads run, to collect their assets; otherwise the program sleeps.
+FramePacer pacer;
+const double pacedRate = 60.0;
+const double assetPollSeconds = 0.05;
+double pacerTimerDue = -1.0;  // When the armed timer fires, -1 for none
+int pacerTimerGeneration = 0;
+
+//CPU renderer for machines without GL (--headless ... --software)
+SoftRasterizer softRasterizer;
+
+//Assets built on loader threads. The scene draws without them (the cube
+//untextured, no mesh) until renderScene() collects and uploads them.
+struct MeshAsset
+{
+	Mesh mesh;
+	Float3Array faceNormals;
+	std::vector<MeshLod> lods;
+	EdgeList edges;
+	std::vector<std::vector<MeshCluster>> clusters;  // Per detail level, 0 being the full mesh.
+	Bvh bvh;
+};
+AsyncAsset<MeshAsset> meshLoader;
+AsyncAsset<TexturePyramid> textureLoader;
+TextureFormat textureFormat;
+MeshFormat meshFormat = MESH_FORMAT_FLOAT;
+bool meshReady = false;
+bool textureReady = false;
 
 /*
 	Scalling the vertices of the imported meshes to fit in the cube
 */
-void normaliseVectors() {
+void normaliseVectors(Mesh& target) {
+	mesh_normalise(target);
+}
+
+/*
+	Loads a mesh and its face normals, normalised and clustered, from the
+	binary cache next to the OBJ file when it is up to date, and otherwise
+	from the OBJ file, (re)writing the cache. Makes no GL calls, so it runs
+	on a loader thread.
+*/
+void loadPreparedMesh(const char* path, Mesh& target, Float3Array& targetFaceNormals) {
+	if (load_mesh_cache(path, target, targetFaceNormals, MESH_CACHE_PREPARED)) return;
+
+	std::vector<std::array<float, 3>> vertices;
+	std::vector<std::array<int, 3>> vertexIndices;
+	load_obj_parallel(path, vertices, vertexIndices);
+	if (!mesh_from_obj(vertices, vertexIndices, target))
+		printf("'%s' has faces with invalid vertex indices.\n", path);
+
+	normaliseVectors(target);
+
+	//Cluster and reorder for the vertex cache before anything is indexed per triangle
+	VertexCacheReport before = vcache_report(target);
+	cluster_mesh(target);
+	print_vcache_report(path, before, vcache_report(target));
+	compute_face_normals(target, targetFaceNormals);
+	save_mesh_cache(path, target, targetFaceNormals, MESH_CACHE_PREPARED);
+}
+
+/*
+	Loads the main mesh with everything the modes use on top of it: the
+	edge list, the BVH for picking, the detail levels and the clusters of
+	every level. Runs on a loader thread.
+*/
+MeshAsset loadMesh(const char* path) {
+	ProfileScope scope(profiler, "load mesh");
+	MeshAsset asset;
+	loadPreparedMesh(path, asset.mesh, asset.faceNormals);
+	build_edge_list(asset.mesh, asset.edges);
+	if (asset.mesh.triangleCount() == 0) return asset;
+
+	//Picking casts rays through this rather than testing every triangle
+	double start = clock_seconds();
+	asset.bvh.build(asset.mesh);
+	printf("Mesh BVH: %zu nodes, %.1f KB, built in %.1f ms.\n", asset.bvh.nodeCount(), asset.bvh.bytes() / 1024.0, (clock_seconds() - start) * 1000.0);
+
+	//Simplified levels, cached like the mesh itself
+	asset.lods.resize(LOD_LEVELS);
+	bool cached = true;
+	int level;
+	for (level = 0; cached && level < LOD_LEVELS; level++)
+		cached = load_mesh_cache(path, asset.lods[level].mesh, asset.lods[level].faceNormals, MESH_CACHE_PREPARED, level + 1);
+	if (!cached) {
+		build_lod_chain(asset.mesh, LOD_FRACTIONS, LOD_LEVELS, asset.lods);
+		print_lod_report(path, asset.mesh.triangleCount(), asset.lods);
+		for (level = 0; level < LOD_LEVELS; level++) {
+			cluster_mesh(asset.lods[level].mesh);
+			compute_face_normals(asset.lods[level].mesh, asset.lods[level].faceNormals);
+			save_mesh_cache(path, asset.lods[level].mesh, asset.lods[level].faceNormals, MESH_CACHE_PREPARED, level + 1);
+		}
+	}
+
+	//Cluster bounds follow from the (cached) triangle order
+	asset.clusters.resize(1 + LOD_LEVELS);
+	compute_mesh_clusters(asset.mesh, asset.faceNormals, asset.clusters[0]);
+	for (level = 0; level < LOD_LEVELS; level++)
+		compute_mesh_clusters(asset.lods[level].mesh, asset.lods[level].faceNormals, asset.clusters[level + 1]);
+	return asset;
+}
+
+//Immediate-mode helpers for the mesh arrays
+void meshVertex(const Mesh& source, uint32_t i) {
+	glVertex3f(source.positions.x[i], source.positions.y[i], source.positions.z[i]);
+}
+
+void meshVertex(uint32_t i) {
+	meshVertex(mesh, i);
+}
+
+void meshNormal(const Float3Array& normals, uint32_t i) {
+	glNormal3f(normals.x[i], normals.y[i], normals.z[i]);
+}
+
+//Mesh, normals and buffers of a detail level (0 is the full mesh)
+const Mesh& lodMesh(int level) {
+	return level == 0 ? mesh : meshLods[level - 1].mesh;
+}
+
+const Float3Array& lodFaceNormals(int level) {
+	return level == 0 ? faceNormals : meshLods[level - 1].faceNormals;
+}
+
+Float3Array& lodNormals(int level) {
+	return level == 0 ? vertexNormals : lodVertexNormals[level - 1];
+}
+
+GpuMesh& lodMeshBuffers(int level) {
+	return level == 0 ? meshBuffers : lodBuffers[level - 1];
+}
+
+int lodCount() {
+	return 1 + (int)meshLods.size();
+}
+
+/*
+	Computes the vertex normals the current smooth shading mode needs, for
+	every detail level (flat shading uses the face normals from loadMesh).
+*/
+void prepareNormals() {
+	if (shadingMode == SHADING_FLAT || normalsShading == shadingMode) return;
+
+	NormalWeighting weighting = shadingMode == SHADING_SMOOTH_ANGLE ? NORMALS_ANGLE_WEIGHTED : NORMALS_AREA_WEIGHTED;
+	lodVertexNormals.resize(meshLods.size());
+	int level;
+	for (level = 0; level < lodCount(); level++)
+		compute_vertex_normals(lodMesh(level), weighting, lodNormals(level));
+	normalsShading = shadingMode;
+}
+
+/*
+	Computes the normals the current shading mode needs and uploads the
+	matching mesh buffers of every detail level. Runs once per shading
+	change, not per frame.
+*/
+void prepareShading() {
+	std::vector<float> interleaved;
+	std::vector<GLuint> indices;
+
+	prepareNormals();
+	lodBuffers.resize(meshLods.size());
+	size_t bytes = 0;
+	int level;
+	for (level = 0; level < lodCount(); level++) {
+		if (shadingMode == SHADING_FLAT) {
+			build_flat_mesh(lodMesh(level), lodFaceNormals(level), interleaved, indices);
+		} else {
+			build_smooth_mesh(lodMesh(level), lodNormals(level), interleaved, indices);
+		}
+		gpu_mesh_upload(lodMeshBuffers(level), interleaved, indices, meshFormat);
+		bytes += lodMeshBuffers(level).bytes;
+	}
+	preparedShading = shadingMode;
+	printf("Mesh buffers: %d level(s), %.1f KB (%s).\n", lodCount(), bytes / 1024.0, mesh_format_name(meshFormat));
+}
+
+/*
+	Detail level for the 'b' mode: the fixed 'l' setting, or the coarsest
+	level that still gives each triangle a couple of pixels at the mesh's
+	current size on screen (same projection as reshape()).
+*/
+int chooseLod(int viewportHeight) {
+	if (lodSetting >= 0) return (std::min)(lodSetting, lodCount() - 1);
+
+	size_t triangleCounts[1 + LOD_LEVELS];
+	int level;
+	for (level = 0; level < lodCount() && level <= LOD_LEVELS; level++)
+		triangleCounts[level] = lodMesh(level).triangleCount();
+	float distance = sqrtf(camera.eye[0] * camera.eye[0] + camera.eye[1] * camera.eye[1] + camera.eye[2] * camera.eye[2]);
+	return select_lod(triangleCounts, level, meshRadius, distance, 45.0f, viewportHeight);
+}
+
+/*
+	Culls the clusters of detail level 'level' against the current GL
+	matrices, leaving the triangles to draw in drawRanges.
+*/
+void cullClusters(int level) {
+	double start = clock_seconds();
+	Mat4 projection, modelview;
+	glGetFloatv(GL_PROJECTION_MATRIX, projection.m);
+	glGetFloatv(GL_MODELVIEW_MATRIX, modelview.m);
+	cullStats = cull_mesh_clusters(meshClusters[level], projection, modelview, drawRanges);
+	cullStats.milliseconds = (clock_seconds() - start) * 1000.0;
+}
+
+//The camera (gluLookAt in renderScene()) and the camera with the cube and mesh rotation
+Mat4 viewMatrix() {
+	return mat4_look_at(camera.eye[0], camera.eye[1], camera.eye[2], camera.center[0], camera.center[1], camera.center[2], 0.0f, 1.0f, 0.0f);
+}
+
+Mat4 meshModelview() {
+	Mat4 modelview = mat4_multiply(viewMatrix(), mat4_rotate(camera.rotation[0], 1.0f, 0.0f, 0.0f));
+	modelview = mat4_multiply(modelview, mat4_rotate(camera.rotation[1], 0.0f, 1.0f, 0.0f));
+	return mat4_multiply(modelview, mat4_rotate(camera.rotation[2], 0.0f, 0.0f, 1.0f));
+}
+
+/*
+	Casts a ray from the camera through window pixel (x, y) of a width x height
+	window (same projection as reshape()) and selects the nearest triangle of
+	the full-detail mesh it hits, whatever level is drawn. Logs the result and
+	how long the unproject and ray cast took.
+*/
+void pickTriangle(int x, int y, int width, int height) {
+	if (!meshReady || height == 0) return;
+
+	double start = clock_seconds();
+	float origin[3], direction[3];
+	BvhRayHit hit;
+	Mat4 projection = mat4_perspective(45.0f, (float)width / (float)height, 0.1f, 100.0f);
+	bool found = mat4_pick_ray(projection, meshModelview(), x, y, width, height, origin, direction)
+		&& meshBvh.intersectRay(origin, direction, 1.0f, hit);
+	double milliseconds = (clock_seconds() - start) * 1000.0;
+
+	pickedTriangle = found ? (int)hit.triangle : -1;
+	if (found) {
+		logSink.write("Picked triangle %d at (%.3f, %.3f, %.3f) in %.3f ms.\n", pickedTriangle,
+			origin[0] + hit.t * direction[0], origin[1] + hit.t * direction[1], origin[2] + hit.t * direction[2], milliseconds);
+	} else {
+		logSink.write("Picked nothing at (%d, %d) in %.3f ms.\n", x, y, milliseconds);
+	}
+}
+
+/*
+	Makes a loaded mesh the current one and reports the edges of its
+	wireframe (each interior edge is shared by two triangles) that make the
+	mesh open or non-manifold. GL buffers are left to the caller.
+*/
+void useMesh(MeshAsset& asset) {
+	mesh = std::move(asset.mesh);
+	faceNormals = std::move(asset.faceNormals);
+	meshLods = std::move(asset.lods);
+	meshEdges = std::move(asset.edges);
+	meshClusters = std::move(asset.clusters);
+	meshBvh = std::move(asset.bvh);
+	pickedTriangle = -1;
+	meshRadius = mesh_bounding_radius(mesh);
+	preparedShading = -1;
+	normalsShading = -1;
+	meshReady = true;
+
+	printf("Mesh edges: %zu unique (%zu triangle sides), %zu boundary, %zu non-manifold",
+		meshEdges.edgeCount(), mesh.indices.size(), meshEdges.boundaryEdges, meshEdges.nonManifoldEdges);
+	if (meshEdges.degenerateEdges > 0) printf(", %zu degenerate sides", meshEdges.degenerateEdges);
+	printf(".\n");
+}
+
+/*
+	Loads the scene meshes other than the main mesh, which the scene shares
+	once it has loaded. The scene draws them whole and smooth shaded, so
+	they get vertex normals and nothing else. Runs on a loader thread.
+*/
+std::vector<SceneMeshSource> loadSceneMeshes(const std::vector<std::string>& paths) {
+	std::vector<SceneMeshSource> sources;
+	size_t i;
+	for (i = 0; i < paths.size(); i++) {
+		if (paths[i] == mainMeshFile) continue;
+		SceneMeshSource source;
+		Float3Array sourceFaceNormals;
+		source.path = paths[i];
+		loadPreparedMesh(paths[i].c_str(), source.mesh, sourceFaceNormals);
+		compute_vertex_normals(source.mesh, NORMALS_AREA_WEIGHTED, source.normals);
+		sources.push_back(std::move(source));
+	}
+	return sources;
+}
+
+/*
+	Places sceneInstances instances on a square grid in the xz plane around
+	the origin, cycling through the registered meshes and materials, each
+	turned a different way and sized to its cell.
+*/
+void layoutScene() {
+	if (scene.materialCount() == 0) {
+		const SceneMaterial materials[4] = {
+			{ { 0.11f, 0.06f, 0.11f, 1.0f }, { 0.43f, 0.47f, 0.54f, 1.0f }, { 0.33f, 0.33f, 0.52f, 1.0f }, 10.0f },
+			{ { 0.20f, 0.05f, 0.05f, 1.0f }, { 0.80f, 0.20f, 0.15f, 1.0f }, { 0.30f, 0.30f, 0.30f, 1.0f }, 20.0f },
+			{ { 0.05f, 0.15f, 0.05f, 1.0f }, { 0.25f, 0.70f, 0.30f, 1.0f }, { 0.20f, 0.20f, 0.20f, 1.0f }, 10.0f },
+			{ { 0.25f, 0.20f, 0.07f, 1.0f }, { 0.75f, 0.61f, 0.23f, 1.0f }, { 0.63f, 0.56f, 0.37f, 1.0f }, 50.0f }
+		};
+		int m;
+		for (m = 0; m < 4; m++) scene.addMaterial(materials[m]);
+	}
+
+	scene.clearInstances();
+	if (scene.meshCount() == 0) return;
+	const int side = (int)ceil(sqrt((double)sceneInstances));
+	const float cell = 6.0f / side;
 	int i;
-	float maxX = vertices[0][0];
-	float maxY = vertices[0][1];
-	float maxZ = vertices[0][2];
-	float minX = vertices[0][0];
-	float minY = vertices[0][1];
-	float minZ = vertices[0][2];
-	
-	for (i = 0; i < vertices.size(); i++) {
- 		if (maxX < vertices[i][0]) maxX = vertices[i][0];
-		if (maxY < vertices[i][1]) maxY = vertices[i][1];
-		if (maxZ < vertices[i][2]) maxZ = vertices[i][2];
-		if (minX > vertices[i][0]) minX = vertices[i][0];
-		if (minY > vertices[i][1]) minY = vertices[i][1];
-		if (minZ > vertices[i][2]) minZ = vertices[i][2];
+	for (i = 0; i < sceneInstances; i++) {
+		Mat4 transform = mat4_translate((i % side + 0.5f) * cell - 3.0f, 0.0f, (i / side + 0.5f) * cell - 3.0f);
+		transform = mat4_multiply(transform, mat4_rotate((float)(i * 37 % 360), 0.0f, 1.0f, 0.0f));
+		transform = mat4_multiply(transform, mat4_scale(0.45f * cell, 0.45f * cell, 0.45f * cell));
+		scene.addInstance((uint32_t)(i % scene.meshCount()), (uint32_t)(i / scene.meshCount() % scene.materialCount()), transform);
 	}
+}
 
-	float range = max(max(maxX-minX, maxZ-minZ), maxY-minY);
-	
-	//Normalise to [0,1]
-	for (i = 0; i < vertices.size(); i++) {
-		vertices[i][0] = (vertices[i][0] - minX) / (range);
-		vertices[i][1] = (vertices[i][1] - minY) / (range);
-		vertices[i][2] = (vertices[i][2] - minZ) / (range);
+//Adds the main mesh to the scene, if the scene uses it
+void addMainMeshToScene() {
+	if (std::find(sceneFiles.begin(), sceneFiles.end(), mainMeshFile) == sceneFiles.end()) return;
+	Float3Array normals;
+	compute_vertex_normals(mesh, NORMALS_AREA_WEIGHTED, normals);
+	scene.addMesh(mainMeshFile, mesh, normals);
+	layoutScene();
+}
+
+//Starts loading the scene meshes the first time the scene mode draws
+void requestScene() {
+	sceneRequested = true;
+	if (meshReady) addMainMeshToScene();
+	std::vector<std::string> paths = sceneFiles;
+	sceneLoader.start([paths] { return loadSceneMeshes(paths); });
+}
+
+/*
+	Collects the assets that have finished loading and uploads them; called
+	at the start of every frame on the render thread. With 'wait', blocks
+	until everything has arrived.
+*/
+bool pollAssets(bool wait) {
+	bool collected = false;
+	TexturePyramid pyramid;
+	if (wait ? textureLoader.wait(pyramid) : textureLoader.poll(pyramid)) {
+		glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
+		if (upload_texture_pyramid(pyramid, textureFormat, iwidth, iheight)) textureReady = true;
+		print_texture_memory_report();
+		collected = true;
 	}
 
-	//Scale to [-1,1]
-	for (i = 0; i < vertices.size(); i++) {
-		vertices[i][0] = (vertices[i][0] * 2) - 1;
-		vertices[i][1] = (vertices[i][1] * 2) - 1;
-		vertices[i][2] = (vertices[i][2] * 2) - 1;
+	MeshAsset asset;
+	if (wait ? meshLoader.wait(asset) : meshLoader.poll(asset)) {
+		useMesh(asset);
+		prepareShading();
+		gpu_lines_upload(edgeBuffers, meshEdges.indices.data(), meshEdges.indices.size());
+		if (sceneRequested) addMainMeshToScene();
+		collected = true;
 	}
 
+	std::vector<SceneMeshSource> sources;
+	if (wait ? sceneLoader.wait(sources) : sceneLoader.poll(sources)) {
+		size_t i;
+		for (i = 0; i < sources.size(); i++) scene.addMesh(sources[i].path, sources[i].mesh, sources[i].normals);
+		layoutScene();
+		collected = true;
+	}
+	return collected;
 }
 
 
@@ -103,84 +521,149 @@ void InitGL(GLvoid)
 	glEnable(GL_COLOR_MATERIAL);
 	glHint(GL_PERSPECTIVE_CORRECTION_HINT, GL_NICEST);
 
-	// Read an image.
-	image = glmReadPPM("mandrill.ppm", &iwidth, &iheight);
 	// Create a texture object with an unused texture ID.
 	glGenTextures(1, &g_textureID[0]);
 	// Set g_textureID as the current 2D texture object.
 	glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
-	// Set the loaded image as the current texture image.
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16, iwidth, iheight, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
+	// Build the image's mipmaps in the background; pollAssets() uploads them. MIP_FILTER=kaiser
+	// selects the sharper filter, TEXTURE_FORMAT=rgb8|srgb8|rgba8|bc1 overrides the storage format.
+	textureFormat = texture_format_from_env();
+	MipEncoding encoding = texture_encoding(textureFormat);
+	MipFilter filter = mip_filter_from_env();
+	textureLoader.start([encoding, filter] {
+		TexturePyramid pyramid;
+		build_texture_pyramid("mandrill.ppm", encoding, filter, pyramid);
+		return pyramid;
+	});
 
 	// Specify what to do when s, t are outside range [0, 1].
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
 	// Specify how to interpolate texture colour values
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 
 	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
 
-	load_obj("bunny.obj", vertices, vertexIndices);
-	normaliseVectors();
-	
+	// MESH_FORMAT=quantised uploads the mesh as snorm16 positions, snorm8 normals and
+	// 16-bit indices ("--bench quantise" reports the precision this costs).
+	meshFormat = mesh_format_from_env();
+	meshLoader.start([] { return loadMesh(mainMeshFile); });
 }
 
 
-void idle(void)
-{
-	glutPostRedisplay();  // Trigger display callback.
+//Whether a loader thread is still working on an asset
+bool assetsPending() {
+	return meshLoader.pending() || textureLoader.pending() || sceneLoader.pending();
 }
 
+void schedulePacer();
 
-void display(void)
+//GLUT timer: draws the frame if it is due, after collecting finished assets
+void pacerTimer(int generation) {
+	if (generation != pacerTimerGeneration) return;  // Superseded by an earlier timer.
+	pacerTimerDue = -1.0;
+	if (assetsPending() && pollAssets(false)) pacer.markDirty();
+	if (pacer.frameDue()) glutPostRedisplay();
+	else schedulePacer();
+}
+
+/*
+	Arms a GLUT timer for the pacer's next frame, or for the next asset poll
+	while loads are running. GLUT timers cannot be cancelled, so an earlier
+	deadline arms a new timer and the old one is ignored when it fires.
+	With nothing to draw or load no timer is armed.
+*/
+void schedulePacer() {
+	double wait = pacer.secondsUntilDue();
+	if (assetsPending() && (wait < 0.0 || wait > assetPollSeconds)) wait = assetPollSeconds;
+	if (wait < 0.0) return;
+
+	const double due = clock_seconds() + wait;
+	if (pacerTimerDue >= 0.0 && pacerTimerDue <= due) return;
+	pacerTimerDue = due;
+	glutTimerFunc((unsigned)(wait * 1000.0), pacerTimer, ++pacerTimerGeneration);
+}
+
+//Marks the view as changed so a frame gets drawn for it
+void requestRedraw() {
+	pacer.markDirty();
+	if (pacer.frameDue()) glutPostRedisplay();
+	else schedulePacer();
+}
+
+
+/*
+	Draws one frame of the current render mode into the current buffer.
+	Shared by the GLUT display callback and the headless renderer.
+*/
+void renderScene(void)
 {
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	{
+		ProfileScope scope(profiler, "assets");
+		pollAssets(false);
+	}
 
-	glLoadIdentity();
+	{
+		ProfileScope scope(profiler, "clear");
+		GpuTimerPass pass(gpuTimer, "clear");
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	}
+
+	{
+		ProfileScope scope(profiler, "camera");
+		glLoadIdentity();
 
-	// Set the camera.
+		// Set the camera.
 	
-	//gluPerspective(45.0f, aspect, 0.1f, 100.0f);
-	gluLookAt(cameraX, cameraY, cameraZ,
-		centerX, centerY, centerZ,
-		0.0f, 1.0f, 0.0f);
-
-	//Turn on the lights
-	glLightfv(GL_LIGHT0, GL_POSITION, pos);
-	glEnable(GL_LIGHTING);
-	glEnable(GL_LIGHT0);
-
-	//Cartesian coordinate system as lines.
-	glBegin(GL_LINES);
-	glColor3f(0.0f, 0.0f, 1.0f);
-	glNormal3f(0.0f, 0.0f, 1.0f);
-	glVertex3f(-1.0f, -1.0f, 3.0f);
-	glVertex3f(-1.0f, -1.0f, 4.0f);
-
-	glColor3f(0.0f, 1.0f, 0.0f);
-	glNormal3f(0.0f, 0.0f, 1.0f);
-	glVertex3f(-1.0f, -1.0f, 3.0f);
-	glVertex3f(-1.0f, 0.0f, 3.0f);
-
-	glColor3f(1.0f, 0.0f, 0.0f);
-	glNormal3f(0.0f, 0.0f, 1.0f);
-	glVertex3f(-1.0f, -1.0f, 3.0f);
-	glVertex3f(0.0f, -1.0f, 3.0f);
-	glEnd();
+		//gluPerspective(45.0f, aspect, 0.1f, 100.0f);
+		gluLookAt(camera.eye[0], camera.eye[1], camera.eye[2],
+			camera.center[0], camera.center[1], camera.center[2],
+			0.0f, 1.0f, 0.0f);
+	}
+
+	{
+		ProfileScope scope(profiler, "lights/axes");
+		GpuTimerPass pass(gpuTimer, "lights/axes");
+		//Turn on the lights
+		glLightfv(GL_LIGHT0, GL_POSITION, pos);
+		glEnable(GL_LIGHTING);
+		glEnable(GL_LIGHT0);
+
+		//Cartesian coordinate system as lines.
+		glBegin(GL_LINES);
+		glColor3f(0.0f, 0.0f, 1.0f);
+		glNormal3f(0.0f, 0.0f, 1.0f);
+		glVertex3f(-1.0f, -1.0f, 3.0f);
+		glVertex3f(-1.0f, -1.0f, 4.0f);
+
+		glColor3f(0.0f, 1.0f, 0.0f);
+		glNormal3f(0.0f, 0.0f, 1.0f);
+		glVertex3f(-1.0f, -1.0f, 3.0f);
+		glVertex3f(-1.0f, 0.0f, 3.0f);
+
+		glColor3f(1.0f, 0.0f, 0.0f);
+		glNormal3f(0.0f, 0.0f, 1.0f);
+		glVertex3f(-1.0f, -1.0f, 3.0f);
+		glVertex3f(0.0f, -1.0f, 3.0f);
+		glEnd();
+	}
+
+	ProfileScope submitScope(profiler, "submit");
+	GpuTimerPass submitPass(gpuTimer, "submit");
 
 	//Rotation of the cube (and meshes)
-	glRotatef(rotqubeX, 1.0f, 0.0f, 0.0f);	// Rotate the cube around the X axis
-	glRotatef(rotqubeY, 0.0f, 1.0f, 0.0f);	// Rotate the cube around the Y axis
-	glRotatef(rotqubeZ, 0.0f, 0.0f, 1.0f);  // Rotate the cube around the Z axis
+	glRotatef(camera.rotation[0], 1.0f, 0.0f, 0.0f);	// Rotate the cube around the X axis
+	glRotatef(camera.rotation[1], 0.0f, 1.0f, 0.0f);	// Rotate the cube around the Y axis
+	glRotatef(camera.rotation[2], 0.0f, 0.0f, 1.0f);  // Rotate the cube around the Z axis
 
 	// Different render modes.
 	switch (rendermode) {
 
 	case 'f': // to display faces
 	{
-		//Enable texturing
-		glEnable(GL_TEXTURE_2D);
+		//Enable texturing (once the image has loaded)
+		if (textureReady) glEnable(GL_TEXTURE_2D);
 		glBindTexture(GL_TEXTURE_2D, g_textureID[0]);
 
 		glBegin(GL_QUADS);
@@ -271,8 +754,6 @@ void display(void)
 	}
 	case 'b':
 	{
-		glBegin(GL_TRIANGLES);
-
 		//Specify materials
 		glMaterialfv(GL_FRONT, GL_AMBIENT, material_Ka);
 		glMaterialfv(GL_FRONT, GL_DIFFUSE, material_Kd);
@@ -280,38 +761,72 @@ void display(void)
 		glMaterialfv(GL_FRONT, GL_EMISSION, material_Ke);
 		glMaterialfv(GL_FRONT, GL_SHININESS, material_Se);
 
-		int i;
-		for (i = 0; i < vertexIndices.size(); i++) {
+		if (!meshReady) break;
+		if (preparedShading != shadingMode) prepareShading();
+		glShadeModel(shadingMode == SHADING_FLAT ? GL_FLAT : GL_SMOOTH);
+
+		//Pick the detail level for the mesh's size on screen
+		GLint viewport[4];
+		glGetIntegerv(GL_VIEWPORT, viewport);
+		drawnLod = chooseLod(viewport[3]);
+
+		//Keep only the clusters in view and facing the camera
+		if (clusterCulling) {
+			cullClusters(drawnLod);
+		} else {
+			const MeshDrawRange everything = { 0, (uint32_t)lodMesh(drawnLod).triangleCount() };
+			drawRanges.assign(1, everything);
+		}
 
-			//Get the vertex indices for each point of each triangle
-			int p1 = vertexIndices[i][0] - 1;
-			int p2 = vertexIndices[i][1] - 1;
-			int p3 = vertexIndices[i][2] - 1;
+		if (!immediateMesh) {
+			//Draw the visible clusters from the retained buffers
+			gpu_mesh_draw(lodMeshBuffers(drawnLod), &drawRanges);
+		} else {
+			const Mesh& lod = lodMesh(drawnLod);
+			const Float3Array& lodFaces = lodFaceNormals(drawnLod);
+			const Float3Array& lodVertices = lodNormals(drawnLod);
+			glBegin(GL_TRIANGLES);
+
+			size_t r;
+			uint32_t i;
+			for (r = 0; r < drawRanges.size(); r++) {
+				for (i = drawRanges[r].firstTriangle; i < drawRanges[r].firstTriangle + drawRanges[r].triangleCount; i++) {
+
+					//Get the vertex indices for each point of each triangle
+					uint32_t p1 = lod.indices[3 * i];
+					uint32_t p2 = lod.indices[3 * i + 1];
+					uint32_t p3 = lod.indices[3 * i + 2];
+
+					//Draw each triangle with its precomputed normals (for shading)
+					if (shadingMode == SHADING_FLAT) {
+						meshNormal(lodFaces, i);
+						meshVertex(lod, p1);
+						meshVertex(lod, p2);
+						meshVertex(lod, p3);
+					} else {
+						meshNormal(lodVertices, p1);
+						meshVertex(lod, p1);
+						meshNormal(lodVertices, p2);
+						meshVertex(lod, p2);
+						meshNormal(lodVertices, p3);
+						meshVertex(lod, p3);
+					}
+				}
+			}
 
-			//Calculate the surface normal for each triangle by finding the cross product (for shading)
-			float v[] = { vertices[p2][0] - vertices[p1][0], vertices[p2][1] - vertices[p1][1], vertices[p2][2] - vertices[p1][2] };
-			float w[] = { vertices[p3][0] - vertices[p1][0], vertices[p3][1] - vertices[p1][1], vertices[p3][2] - vertices[p1][2] };
-			
-			float nx = (v[1] * w[2]) - (v[2] * w[1]);
-			float ny = (v[2] * w[0]) - (v[0] * w[2]);
-			float nz = (v[0] * w[1]) - (v[1] * w[0]);
-
-			//Normalise the normal vector
-			float ax = nx / (abs(nx) + abs(ny) + abs(nz));
-			float ay = ny / (abs(nx) + abs(ny) + abs(nz));
-			float az = nz / (abs(nx) + abs(ny) + abs(nz));
-
-			glNormal3f(ax, ay, az);
-			//Draw each triangle
-			glVertex3f(vertices[p1][0], vertices[p1][1], vertices[p1][2]);
-			glVertex3f(vertices[p2][0], vertices[p2][1], vertices[p2][2]);
-			glVertex3f(vertices[p3][0], vertices[p3][1], vertices[p3][2]);
+			glEnd();
 		}
 
-
-		glEnd();
+		glShadeModel(GL_FLAT);
 		break;
 	}
+		case 'g': // many instances of the scene meshes
+		{
+			if (!sceneRequested) requestScene();
+			sceneStats = scene.draw();
+			break;
+		}
+
 		case 'v': // to display points
 		{
 			
@@ -329,9 +844,9 @@ void display(void)
 			glVertex3f(1.0f, -1.0f, -1.0f);
 
 			//Display the points of the loaded mesh
-			int i;
-			for (i = 0; i < vertices.size(); i++) {
-				glVertex3f(vertices[i][0], vertices[i][1], vertices[i][2]);
+			size_t i;
+			for (i = 0; i < mesh.vertexCount(); i++) {
+				meshVertex((uint32_t)i);
 			}
 
 			glEnd();
@@ -382,30 +897,226 @@ void display(void)
 			glVertex3f(1.0f, 1.0f, -1.0f);
 			glVertex3f(1.0f, -1.0f, -1.0f);
 
-			//Display the edges of the loaded mesh
-			int i;
-			for (i = 0; i < vertexIndices.size(); i++) {
+			glEnd();
+
+			//Display the edges of the loaded mesh, each shared edge once
+			if (!meshReady) break;
+			if (!immediateMesh) {
+				gpu_lines_draw(meshBuffers, edgeBuffers);
+			} else {
+				glBegin(GL_LINES);
+				size_t i;
+				for (i = 0; i < meshEdges.indices.size(); i++) meshVertex(meshEdges.indices[i]);
+				glEnd();
+			}
+			break;
+		}
+	}
 
-				int p1 = vertexIndices[i][0] - 1;
-				int p2 = vertexIndices[i][1] - 1;
-				int p3 = vertexIndices[i][2] - 1;
+	//The picked triangle, unlit and in front of whichever detail level was
+	//drawn; the 'g' mode draws the scene instead of the mesh it belongs to
+	if (pickedTriangle >= 0 && rendermode != 'f' && rendermode != 'g') {
+		glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+		glDisable(GL_LIGHTING);
+		glDisable(GL_COLOR_MATERIAL);  // Keep the highlight colour out of the material.
+		glDisable(GL_DEPTH_TEST);
+		glColor3f(1.0f, 1.0f, 0.0f);
+		glBegin(GL_TRIANGLES);
+		int k;
+		for (k = 0; k < 3; k++) meshVertex(mesh.indices[3 * pickedTriangle + k]);
+		glEnd();
+		glPopAttrib();
+	}
+}
 
-				glVertex3f(vertices[p1][0], vertices[p1][1], vertices[p1][2]);
-				glVertex3f(vertices[p2][0], vertices[p2][1], vertices[p2][2]);
-				
-				glVertex3f(vertices[p2][0], vertices[p2][1], vertices[p2][2]);
-				glVertex3f(vertices[p3][0], vertices[p3][1], vertices[p3][2]);
+//Corners of the cube in the order the 'v' mode draws them, and the
+//corner pairs of the 'e' mode's lines
+const float cubeCorners[8][3] = {
+	{ 1.0f, 1.0f, 1.0f }, { -1.0f, 1.0f, 1.0f }, { -1.0f, -1.0f, 1.0f }, { 1.0f, -1.0f, 1.0f },
+	{ 1.0f, 1.0f, -1.0f }, { -1.0f, 1.0f, -1.0f }, { -1.0f, -1.0f, -1.0f }, { 1.0f, -1.0f, -1.0f }
+};
+const uint32_t cubeEdges[12][2] = {
+	{ 1, 2 }, { 1, 0 }, { 2, 3 }, { 3, 0 }, { 0, 4 }, { 4, 5 },
+	{ 5, 1 }, { 2, 6 }, { 3, 7 }, { 6, 7 }, { 6, 5 }, { 4, 7 }
+};
 
-				glVertex3f(vertices[p1][0], vertices[p1][1], vertices[p1][2]);
-				glVertex3f(vertices[p3][0], vertices[p3][1], vertices[p3][2]);
-			}
+/*
+	CPU version of renderScene() for the 'v', 'e' and 'b' modes, with the
+	same camera, light, materials and colours. The GL state it mirrors is the
+	one the window settles into: points are 5 pixels (set after the first
+	'v' frame) and the axes' last colour, red, is the mesh colour through
+	GL_COLOR_MATERIAL.
+*/
+void renderSceneSoftware(SoftFramebuffer& target) {
+	target.clear(0.0f, 0.0f, 0.0f, 1.0f, 1.0f);
+
+	SoftState state;
+	state.projection = mat4_perspective(45.0f, (float)target.width / (float)target.height, 0.1f, 100.0f);
+	state.modelview = viewMatrix();
+	state.setLightPosition(pos);
+	state.lighting = true;
+	state.colorMaterial = true;
+
+	//Cartesian coordinate system as lines
+	Float3Array axes;
+	axes.resize(4);
+	const float axisPoints[4][3] = { { -1.0f, -1.0f, 3.0f }, { -1.0f, -1.0f, 4.0f }, { -1.0f, 0.0f, 3.0f }, { 0.0f, -1.0f, 3.0f } };
+	const float axisColors[3][3] = { { 0.0f, 0.0f, 1.0f }, { 0.0f, 1.0f, 0.0f }, { 1.0f, 0.0f, 0.0f } };
+	int i;
+	for (i = 0; i < 4; i++) {
+		axes.x[i] = axisPoints[i][0];
+		axes.y[i] = axisPoints[i][1];
+		axes.z[i] = axisPoints[i][2];
+	}
+	for (i = 0; i < 3; i++) {
+		const uint32_t line[2] = { 0, (uint32_t)i + 1 };
+		SoftState::set4(state.color, axisColors[i][0], axisColors[i][1], axisColors[i][2], 1.0f);
+		softRasterizer.drawLines(target, state, axes, line, 1);
+	}
 
-			glEnd();
-			break;
+	//Rotation of the cube (and meshes)
+	state.modelview = meshModelview();
+
+	Float3Array cube;
+	cube.resize(8);
+	for (i = 0; i < 8; i++) {
+		cube.x[i] = cubeCorners[i][0];
+		cube.y[i] = cubeCorners[i][1];
+		cube.z[i] = cubeCorners[i][2];
+	}
+
+	switch (rendermode) {
+	case 'b':
+		memcpy(state.material.specular, material_Ks, sizeof(material_Ks));
+		memcpy(state.material.emission, material_Ke, sizeof(material_Ke));
+		state.material.shininess = material_Se[0];
+		drawnLod = chooseLod(target.height);
+		if (shadingMode == SHADING_FLAT) {
+			const Mesh& lod = lodMesh(drawnLod);
+			softRasterizer.drawTriangles(target, state, lod.positions, lod.indices.data(), lod.triangleCount(), lodFaceNormals(drawnLod), true);
+		} else {
+			const Mesh& lod = lodMesh(drawnLod);
+			softRasterizer.drawTriangles(target, state, lod.positions, lod.indices.data(), lod.triangleCount(), lodNormals(drawnLod), false);
 		}
+		break;
+	case 'v':
+		SoftState::set4(state.color, 0.0f, 1.0f, 0.0f, 1.0f);
+		state.pointSize = 5.0f;
+		softRasterizer.drawPoints(target, state, cube);
+		softRasterizer.drawPoints(target, state, mesh.positions);
+		break;
+	case 'e':
+		SoftState::set4(state.color, 0.0f, 0.0f, 1.0f, 1.0f);
+		softRasterizer.drawLines(target, state, cube, &cubeEdges[0][0], 12);
+		softRasterizer.drawLines(target, state, mesh.positions, meshEdges.indices.data(), meshEdges.edgeCount());
+		break;
 	}
 
-	glutSwapBuffers();
+	//The picked triangle, unlit (there is no depth test to turn off, so a
+	//coarser detail level can hide parts of it)
+	if (pickedTriangle >= 0) {
+		Float3Array corners;
+		corners.resize(3);
+		int k;
+		for (k = 0; k < 3; k++) {
+			const uint32_t v = mesh.indices[3 * pickedTriangle + k];
+			corners.x[k] = mesh.positions.x[v];
+			corners.y[k] = mesh.positions.y[v];
+			corners.z[k] = mesh.positions.z[v];
+		}
+		const uint32_t triangle[3] = { 0, 1, 2 };
+		state.lighting = false;
+		SoftState::set4(state.color, 1.0f, 1.0f, 0.0f, 1.0f);
+		softRasterizer.drawTriangles(target, state, corners, triangle, 1, corners, true);  // Unlit, so the normals go unused.
+	}
+}
+
+//Draws a line of text with its baseline at window pixel (x, y)
+void drawOverlayText(int x, int y, const char* text) {
+	glRasterPos2i(x, y);
+	const char* c;
+	for (c = text; *c; c++) glutBitmapCharacter(GLUT_BITMAP_8_BY_13, *c);
+}
+
+/*
+	Lists each profiled phase's mean and worst time over the last
+	overlayFrames frames in the top left corner, in window pixels, then the
+	GPU passes' mean times since the profiler was turned on.
+*/
+void drawProfilerOverlay(void)
+{
+	std::vector<ProfileSample> samples;
+	std::vector<ProfilePhase> phases;
+	profiler.snapshot(samples);
+	const uint32_t last = profiler.frame() - 1;
+	profile_phases(samples, last >= overlayFrames ? last - overlayFrames + 1 : 0, last, phases);
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glPushAttrib(GL_ENABLE_BIT | GL_CURRENT_BIT);
+	glDisable(GL_LIGHTING);
+	glDisable(GL_DEPTH_TEST);
+	glDisable(GL_TEXTURE_2D);
+	glMatrixMode(GL_PROJECTION);
+	glPushMatrix();
+	glLoadIdentity();
+	glOrtho(0.0, viewport[2], 0.0, viewport[3], -1.0, 1.0);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glLoadIdentity();
+
+	glColor3f(1.0f, 1.0f, 1.0f);
+	char line[96];
+	int y = viewport[3] - 16;
+	size_t p;
+	for (p = 0; p <= phases.size(); p++, y -= 14) {
+		if (p == 0) snprintf(line, sizeof(line), "%-12s %8s %8s", "phase", "mean ms", "max ms");
+		else snprintf(line, sizeof(line), "%-12s %8.3f %8.3f", phases[p - 1].name, phases[p - 1].meanMilliseconds, phases[p - 1].maxMilliseconds);
+		drawOverlayText(8, y, line);
+	}
+	snprintf(line, sizeof(line), "pacer %6.1f Hz %8.3f ms draw", pacer.smoothedIntervalMilliseconds() > 0.0 ? 1000.0 / pacer.smoothedIntervalMilliseconds() : 0.0, pacer.smoothedDrawMilliseconds());
+	drawOverlayText(8, y, line);
+	y -= 14;
+	snprintf(line, sizeof(line), "input %3u events %6.3f ms queued", (unsigned)inputEventCount, inputDelay * 1000.0);
+	drawOverlayText(8, y, line);
+	y -= 14;
+	const std::vector<GpuPassStats>& passes = gpuTimer.stats();
+	for (p = 0; p < passes.size(); p++, y -= 14) {
+		snprintf(line, sizeof(line), "gpu %-8s %8.3f %8.3f", passes[p].name, passes[p].totalMilliseconds / passes[p].frames, passes[p].maxMilliseconds);
+		drawOverlayText(8, y, line);
+	}
+
+	glPopMatrix();
+	glMatrixMode(GL_PROJECTION);
+	glPopMatrix();
+	glMatrixMode(GL_MODELVIEW);
+	glPopAttrib();
+}
+
+void processInput();
+
+void display(void)
+{
+	pacer.beginFrame();
+	profiler.beginFrame();
+	{
+		ProfileScope scope(profiler, "frame");
+		{
+			ProfileScope inputScope(profiler, "input");
+			processInput();
+		}
+		gpuTimer.beginFrame();
+		renderScene();
+		gpuTimer.endFrame();
+		if (profiler.enabled()) {
+			ProfileScope overlayScope(profiler, "overlay");
+			drawProfilerOverlay();
+		}
+		ProfileScope swapScope(profiler, "swap");
+		glutSwapBuffers();
+	}
+	pacer.endFrame();
+	schedulePacer();
 }
 
 
@@ -430,8 +1141,33 @@ void reshape(int width, int height)
 }
 
 
-// Callback for standard keyboard presses.
-void keyboard(unsigned char key, int x, int y)
+//Writes the frames still in the profiler's ring as a Chrome trace
+void writeTrace(const char* path) {
+	std::vector<ProfileSample> samples;
+	profiler.snapshot(samples);
+	if (profile_write_chrome_trace(path, samples))
+		printf("Wrote %zu profiler samples to '%s'.\n", samples.size(), path);
+}
+
+//Steps through redrawing on change only, on change at most pacedRate times
+//a second, and continuously at pacedRate
+void cyclePacing() {
+	if (pacer.rate() == 0.0) pacer.setRate(pacedRate, false);
+	else if (!pacer.continuous()) pacer.setRate(pacedRate, true);
+	else pacer.setRate(0.0, false);
+	if (pacer.rate() == 0.0) logSink.write("Redrawing on change.\n");
+	else logSink.write("Redrawing %s at %.0f frames per second.\n", pacer.continuous() ? "continuously" : "on change, at most", pacer.rate());
+}
+
+//Keys applyKey() acts on (escape first); the others are not queued and draw nothing
+const char commandKeys[] = "\x1b" "vefbg+-jicl123wsadmnxyzrpth";
+
+bool isCommandKey(unsigned char key) {
+	return key != 0 && strchr(commandKeys, key) != NULL;
+}
+
+//Applies a key press from the input queue
+void applyKey(unsigned char key)
 {
 	switch (key)
 	{
@@ -445,27 +1181,38 @@ void keyboard(unsigned char key, int x, int y)
 		case 'e': rendermode = 'e'; break;  // edges
 		case 'f': rendermode = 'f'; break;  // faces
 		case 'b': rendermode = 'b'; break;  // meshes faces
-		case 'w': cameraZ--; break; //camera translation + rotation
-		case 's': cameraZ++; break; //camera translation + rotation
-		case 'a': cameraX--; centerX--; break; //camera translation (modifies the variables such that it doesn't rotate the view)
-		case 'd': cameraX++; centerX++; break; //camera translation (modifies the variables such that it doesn't rotate the view)
-		case 'm': cameraY++; centerY++; break; //camera translation (modifies the variables such that it doesn't rotate the view)
-		case 'n': cameraY--; centerY--; break; //camera translation (modifies the variables such that it doesn't rotate the view)
-		case 'x': rotqubeX += 1.0f; if (rotqubeX == 360.00) rotqubeX = 0.00; break;  // rotate cube around X axis
-		case 'y': rotqubeY += 1.0f; if (rotqubeY == 360.00) rotqubeY = 0.00; break;  // rotate cube around Y axis
-		case 'z': rotqubeZ += 1.0f; if (rotqubeZ == 360.00) rotqubeZ = 0.00; break;  // rotate cube around Z axis
-		case 'r': rotqubeX = 0; rotqubeY = 0; rotqubeZ = 0; break; // reset the position of the cube
+		case 'g': rendermode = 'g'; break;  // scene of mesh instances
+		case '+': if (sceneInstances < 65536) { sceneInstances *= 2; layoutScene(); } break;  // more scene instances
+		case '-': if (sceneInstances > 1) { sceneInstances /= 2; layoutScene(); } break;  // fewer scene instances
+		case 'j': scene.setInstancing(!scene.instancing()); break;  // toggle instanced scene draws
+		case 'i': immediateMesh = !immediateMesh; break;  // toggle immediate-mode mesh drawing
+		case 'c': clusterCulling = !clusterCulling; break;  // toggle culling of off-screen and back-facing mesh clusters
+		case 'l': lodSetting = lodSetting < LOD_LEVELS ? lodSetting + 1 : -1; break;  // cycle automatic / fixed mesh detail level
+		case '1': shadingMode = SHADING_FLAT; break;  // flat mesh shading
+		case '2': shadingMode = SHADING_SMOOTH_AREA; break;  // smooth shading, area-weighted normals
+		case '3': shadingMode = SHADING_SMOOTH_ANGLE; break;  // smooth shading, angle-weighted normals
+		case 'w': camera_move_eye(camera, 0.0f, 0.0f, -1.0f); break; //camera translation + rotation
+		case 's': camera_move_eye(camera, 0.0f, 0.0f, 1.0f); break; //camera translation + rotation
+		case 'a': camera_translate(camera, -1.0f, 0.0f, 0.0f); break; //camera translation (moves the eye and centre together so the view doesn't rotate)
+		case 'd': camera_translate(camera, 1.0f, 0.0f, 0.0f); break; //camera translation (moves the eye and centre together so the view doesn't rotate)
+		case 'm': camera_translate(camera, 0.0f, 1.0f, 0.0f); break; //camera translation (moves the eye and centre together so the view doesn't rotate)
+		case 'n': camera_translate(camera, 0.0f, -1.0f, 0.0f); break; //camera translation (moves the eye and centre together so the view doesn't rotate)
+		case 'x': camera_rotate_model(camera, 0, 1.0f); break;  // rotate cube around X axis
+		case 'y': camera_rotate_model(camera, 1, 1.0f); break;  // rotate cube around Y axis
+		case 'z': camera_rotate_model(camera, 2, 1.0f); break;  // rotate cube around Z axis
+		case 'r': camera.rotation[0] = camera.rotation[1] = camera.rotation[2] = 0.0f; break; // reset the position of the cube
+		case 'p': profiler.setEnabled(!profiler.enabled()); gpuTimer.setEnabled(profiler.enabled()); gpuTimer.resetStats(); break;  // toggle the frame profilers and their overlay
+		case 't': writeTrace(traceFile); break;  // write the profiled frames as a Chrome trace
+		case 'h': cyclePacing(); break;  // redraw on change / at most pacedRate / continuously at pacedRate
 
 		default:
 			break;
 	}
-
-	glutPostRedisplay();
 }
 
 
-// Arrow keys need to be handled in a separate function from other keyboard presses.
-void arrow_keys(int a_keys, int x, int y)
+//Applies an arrow key press from the input queue
+void applySpecialKey(int a_keys)
 {
 	switch (a_keys)
 	{
@@ -483,35 +1230,367 @@ void arrow_keys(int a_keys, int x, int y)
 }
 
 
+/*
+	Applies the input queued since the last frame, oldest first. A drag's
+	motion events arrive folded into one, so it pans the camera and logs the
+	new centre once per frame however many events the window sent.
+*/
+void processInput()
+{
+	inputEventCount = inputQueue.drain(inputEvents);
+	inputDelay = inputEvents.empty() ? 0.0 : clock_seconds() - inputEvents[0].time;
+	bool dragged = false;
+	size_t i;
+	for (i = 0; i < inputEvents.size(); i++) {
+		const InputEvent& event = inputEvents[i];
+		switch (event.type) {
+		case INPUT_KEY: applyKey((unsigned char)event.code); break;
+		case INPUT_SPECIAL_KEY: applySpecialKey(event.code); break;
+		case INPUT_BUTTON:
+			oldX = event.x;
+			oldY = event.y;
+			//Left click selects the mesh triangle under the cursor
+			if (event.code == GLUT_LEFT_BUTTON && event.state == GLUT_DOWN)
+				pickTriangle(event.x, event.y, glutGet(GLUT_WINDOW_WIDTH), glutGet(GLUT_WINDOW_HEIGHT));
+			break;
+		case INPUT_MOTION:
+			//rotating camera
+			camera_drag(camera, (float)(event.x - oldX), (float)(event.y - oldY), dragUnitsPerPixel, dragLimit);
+			oldX = event.x;
+			oldY = event.y;
+			dragged = true;
+			break;
+		}
+	}
+	if (dragged) logSink.write("x: %.2f y: %.2f \n", camera.center[0], camera.center[1]);
+}
+
+
+// Callback for standard keyboard presses.
+void keyboard(unsigned char key, int x, int y)
+{
+	if (!isCommandKey(key)) return;
+	inputQueue.push(input_event(INPUT_KEY, key, 0, x, y));
+	requestRedraw();
+}
+
+
+// Arrow keys need to be handled in a separate function from other keyboard presses.
+void arrow_keys(int a_keys, int x, int y)
+{
+	if (a_keys != GLUT_KEY_UP && a_keys != GLUT_KEY_DOWN) return;
+	inputQueue.push(input_event(INPUT_SPECIAL_KEY, a_keys, 0, x, y));
+	requestRedraw();
+}
+
+
 // Handling mouse button event.
 void mouseButton(int button, int state, int x, int y)
 {
-	oldX = x;
-	oldY = y;
+	inputQueue.push(input_event(INPUT_BUTTON, button, state, x, y));
+	//Only a left click (a pick) changes the view
+	if (button == GLUT_LEFT_BUTTON && state == GLUT_DOWN) requestRedraw();
 }
 
 
 // Handling mouse move events.
 void mouseMove(int x, int y)
 {
-	//rotating camera
-	int newX = centerX - (oldX - x);
-	int newY = centerY + (oldY - y);
-	if (abs(newX) <= 40) {
-		centerX = newX;
+	inputQueue.push(input_event(INPUT_MOTION, 0, 0, x, y));
+	requestRedraw();
+}
+
+
+//Prints the headless frame-time summary
+void reportFrameTimes(char mode, const std::vector<double>& times) {
+	FrameTimeSummary summary = summarise_frame_times(times);
+	printf("Mode '%c'%s, %d frames: min %.3f ms, median %.3f ms, p99 %.3f ms (mean %.3f ms)\n",
+		mode, immediateMesh ? " (immediate)" : "", (int)times.size(), summary.min, summary.median, summary.p99, summary.mean);
+	if (mode == 'b')
+		printf("Drew detail level %d (%d triangles).\n", drawnLod, (int)lodMesh(drawnLod).triangleCount());
+	if (mode == 'g')
+		printf("Scene: %zu instances of %zu meshes in %zu batches, %zu draw calls (%s), %zu triangles, submitted in %.3f ms.\n",
+			sceneStats.instances, scene.meshCount(), sceneStats.batches, sceneStats.drawCalls, sceneStats.instanced ? "instanced" : "one per instance",
+			sceneStats.triangles, sceneStats.submitMilliseconds);
+}
+
+//Prints the profiled phases of frames [first, last]
+void reportProfile(uint32_t first, uint32_t last) {
+	std::vector<ProfileSample> samples;
+	std::vector<ProfilePhase> phases;
+	profiler.snapshot(samples);
+	profile_phases(samples, first, last, phases);
+	printf("Profiled phases over %u frames:  mean (ms)  max (ms)  calls\n", last - first + 1);
+	size_t p;
+	for (p = 0; p < phases.size(); p++)
+		printf("  %-12s %20.3f %9.3f %6u\n", phases[p].name, phases[p].meanMilliseconds, phases[p].maxMilliseconds, phases[p].calls);
+}
+
+/*
+	Prints the GPU time and primitives of each pass over the timed frames,
+	waiting for the last few frames' queries, then a one-line total for
+	comparing builds.
+*/
+void reportGpuTimes(char mode, int frames) {
+	if (!gpuTimer.supported()) {
+		printf("GPU timing: this driver has no timer queries (GL_TIME_ELAPSED).\n");
+		return;
 	}
-	if (abs(newY) <= 40) {
-		centerY = newY;
+	gpuTimer.collect(true);
+	const std::vector<GpuPassStats>& passes = gpuTimer.stats();
+	printf("GPU passes over %d frames (%u untimed):  mean (ms)  max (ms)  primitives/frame\n", frames, gpuTimer.skippedFrames());
+	double total = 0.0;
+	size_t p;
+	for (p = 0; p < passes.size(); p++) {
+		const double mean = passes[p].totalMilliseconds / passes[p].frames;
+		total += mean;
+		if (gpuTimer.countsPrimitives())
+			printf("  %-12s %27.3f %9.3f %17.0f\n", passes[p].name, mean, passes[p].maxMilliseconds, (double)passes[p].primitives / passes[p].frames);
+		else
+			printf("  %-12s %27.3f %9.3f %17s\n", passes[p].name, mean, passes[p].maxMilliseconds, "-");
 	}
-		printf("x: %d y: %d \n", centerX, centerY);
-		oldX = x;
-		oldY = y;
+	printf("GPU mode '%c': %.3f ms per frame.\n", mode, total);
 }
 
+/*
+	Times the scene mode at growing instance counts, instanced and with one
+	draw per instance, and prints the draw calls and CPU submit time of each.
+*/
+void reportSceneScaling(int frames) {
+	printf("Scene scaling, median of %d frames:     instanced          |   one draw per instance\n", frames);
+	printf("Instances  Draws  Submit (ms)  Frame (ms)  | Draws  Submit (ms)  Frame (ms)\n");
+	const int savedInstances = sceneInstances;
+	const bool wantInstancing = scene.instancing();
+	scene.setInstancing(true);
+	const bool canInstance = scene.instancing();
+	int count;
+	for (count = 1; count <= 1024; count *= 4) {
+		sceneInstances = count;
+		layoutScene();
+		printf("%9d", count);
+		int pass;
+		for (pass = 0; pass < 2; pass++) {
+			scene.setInstancing(pass == 0);
+			if (pass == 0 && !canInstance) {
+				printf("  %5s  %11s  %10s  |", "-", "-", "-");
+				continue;
+			}
+			std::vector<double> submit(frames), times(frames);
+			int i;
+			for (i = 0; i < frames; i++) {
+				double start = clock_seconds();
+				renderScene();
+				glFinish();
+				times[i] = (clock_seconds() - start) * 1000.0;
+				submit[i] = sceneStats.submitMilliseconds;
+			}
+			printf("  %5zu  %11.3f  %10.3f%s", sceneStats.drawCalls, summarise_frame_times(submit).median, summarise_frame_times(times).median, pass == 0 ? "  |" : "\n");
+		}
+	}
+	scene.setInstancing(wantInstancing);
+	sceneInstances = savedInstances;
+	layoutScene();
+}
+
+/*
+	The headless loop on the software rasteriser: no GL context at all.
+*/
+int runHeadlessSoftware(char mode, int frames, int width, int height, const int* pick, const char* outPath) {
+	if (mode == 'f' || mode == 'g') {
+		printf("The software renderer draws the 'v', 'e' and 'b' modes only.\n");
+		return 1;
+	}
+	printf("Headless: software rasteriser, %u threads, %dx%d\n", thread_pool().size(), width, height);
+
+	MeshAsset asset = loadMesh(mainMeshFile);
+	useMesh(asset);
+	prepareNormals();
+	rendermode = mode;
+	if (pick != NULL) pickTriangle(pick[0], pick[1], width, height);
+
+	SoftFramebuffer target;
+	target.resize(width, height);
+	renderSceneSoftware(target);
+
+	std::vector<double> times(frames);
+	int i;
+	for (i = 0; i < frames; i++) {
+		double start = clock_seconds();
+		renderSceneSoftware(target);
+		times[i] = (clock_seconds() - start) * 1000.0;
+	}
+	reportFrameTimes(mode, times);
+
+	if (outPath != NULL && target.savePPM(outPath))
+		printf("Wrote last frame to '%s'.\n", outPath);
+	return 0;
+}
+
+/*
+	Renders frames of one render mode offscreen and reports the frame times.
+	Usage: --headless <v|e|f|b|g> [--frames N] [--size WxH] [--shading 1|2|3] [--immediate] [--software] [--lod auto|0-3] [--pick X,Y]
+	                      [--camera X,Y,Z] [--center X,Y,Z] [--no-cull] [--instances N] [--no-instancing] [--scene a.obj,b.obj] [--out file.ppm]
+	--pick clicks window pixel (X, Y) once the mesh has loaded. In the 'b' mode
+	frames with and without cluster culling are then timed in turn, unless it
+	is off; the 'g' mode is timed again at growing instance counts.
+*/
+int runHeadless(int argc, char** argv)
+{
+	if (argc < 1 || strchr("vefbg", argv[0][0]) == NULL || argv[0][1] != '\0') {
+		printf("Usage: --headless <v|e|f|b|g> [--frames N] [--size WxH] [--shading 1|2|3] [--immediate] [--software] [--lod auto|0-%d] [--pick X,Y] [--camera X,Y,Z] [--center X,Y,Z] [--no-cull]"
+			" [--instances N] [--no-instancing] [--scene a.obj,b.obj] [--profile] [--trace file.json] [--gpu-timing] [--out file.ppm]\n", LOD_LEVELS);
+		return 1;
+	}
+	char mode = argv[0][0];
+	int frames = 100;
+	int width = 500, height = 500;
+	const char* outPath = NULL;
+	const char* tracePath = NULL;
+	bool software = false;
+	int pickAt[2];
+	const int* pick = NULL;
+
+	int i;
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) frames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) sscanf(argv[++i], "%dx%d", &width, &height);
+		else if (strcmp(argv[i], "--shading") == 0 && i + 1 < argc) shadingMode = atoi(argv[++i]) - 1;
+		else if (strcmp(argv[i], "--immediate") == 0) immediateMesh = true;
+		else if (strcmp(argv[i], "--software") == 0) software = true;
+		else if (strcmp(argv[i], "--lod") == 0 && i + 1 < argc) { i++; lodSetting = strcmp(argv[i], "auto") == 0 ? -1 : atoi(argv[i]); }
+		else if (strcmp(argv[i], "--pick") == 0 && i + 1 < argc && sscanf(argv[i + 1], "%d,%d", &pickAt[0], &pickAt[1]) == 2) { i++; pick = pickAt; }
+		else if (strcmp(argv[i], "--camera") == 0 && i + 1 < argc) sscanf(argv[++i], "%f,%f,%f", &camera.eye[0], &camera.eye[1], &camera.eye[2]);
+		else if (strcmp(argv[i], "--center") == 0 && i + 1 < argc) sscanf(argv[++i], "%f,%f,%f", &camera.center[0], &camera.center[1], &camera.center[2]);
+		else if (strcmp(argv[i], "--no-cull") == 0) clusterCulling = false;
+		else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc) sceneInstances = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--no-instancing") == 0) scene.setInstancing(false);
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc) {
+			sceneFiles.clear();
+			std::string list = argv[++i];
+			size_t start = 0, comma;
+			do {
+				comma = list.find(',', start);
+				sceneFiles.push_back(list.substr(start, comma == std::string::npos ? std::string::npos : comma - start));
+				start = comma + 1;
+			} while (comma != std::string::npos);
+		}
+		else if (strcmp(argv[i], "--profile") == 0) profiler.setEnabled(true);
+		else if (strcmp(argv[i], "--gpu-timing") == 0) gpuTimer.setEnabled(true);
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) { tracePath = argv[++i]; profiler.setEnabled(true); }
+		else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) outPath = argv[++i];
+		else { printf("Unknown headless option '%s'.\n", argv[i]); return 1; }
+	}
+	if (frames < 1 || width < 1 || height < 1 || sceneInstances < 1 || lodSetting > LOD_LEVELS || shadingMode < SHADING_FLAT || shadingMode > SHADING_SMOOTH_ANGLE) {
+		printf("Invalid headless options.\n");
+		return 1;
+	}
+	if (software)
+		return runHeadlessSoftware(mode, frames, width, height, pick, outPath);
+
+	//No windowless context on this platform: fall back to a hidden window
+	HeadlessContext context;
+	if (!context.create(width, height)) {
+		char programName[] = "OpenGLCoursework";
+		char* glutArgv[] = { programName, NULL };
+		int glutArgc = 1;
+		glutInit(&glutArgc, glutArgv);
+		glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_DEPTH);
+		glutInitWindowSize(width, height);
+		glutCreateWindow("CM20219 OpenGL Coursework (headless)");
+		glutHideWindow();
+		context.createFramebuffer(width, height);
+	}
+	printf("Headless: %s, %s, %dx%d\n", context.backend(), (const char*)glGetString(GL_RENDERER), width, height);
+
+	double launch = clock_seconds();
+	InitGL();
+	reshape(width, height);
+	rendermode = mode;
+
+	//The first frame does not wait for the assets
+	renderScene();
+	glFinish();
+	double firstFrame = clock_seconds() - launch;
+	pollAssets(true);
+	printf("First frame after %.1f ms, assets ready after %.1f ms.\n", firstFrame * 1000.0, (clock_seconds() - launch) * 1000.0);
+	if (pick != NULL) pickTriangle(pick[0], pick[1], width, height);
+
+	//One untimed frame with the assets, so buffer and shader setup is not counted
+	renderScene();
+	glFinish();
+
+	std::vector<double> times(frames);
+	const uint32_t firstProfiled = profiler.frame() + 1;
+	gpuTimer.resetStats();
+	for (i = 0; i < frames; i++) {
+		double start = clock_seconds();
+		profiler.beginFrame();
+		{
+			ProfileScope scope(profiler, "frame");
+			gpuTimer.beginFrame();
+			renderScene();
+			gpuTimer.endFrame();
+			ProfileScope finishScope(profiler, "finish");
+			glFinish();
+		}
+		times[i] = (clock_seconds() - start) * 1000.0;
+	}
+
+	reportFrameTimes(mode, times);
+	if (profiler.enabled()) reportProfile(firstProfiled, profiler.frame());
+	if (gpuTimer.enabled()) reportGpuTimes(mode, frames);
+	if (tracePath != NULL) writeTrace(tracePath);
+
+	if (outPath != NULL && save_framebuffer_ppm(outPath, width, height))
+		printf("Wrote last frame to '%s'.\n", outPath);
+
+	//What the cluster culling removed, and the same frames without it
+	if (mode == 'b' && clusterCulling && meshReady) {
+		ClusterCullStats culled = cullStats;
+		printf("Cluster culling: drew %zu of %zu clusters (%zu outside the view, %zu facing away), %zu of %zu triangles in %zu draws; culling took %.3f ms.\n",
+			culled.clusters - culled.frustumCulled - culled.backfaceCulled, culled.clusters, culled.frustumCulled, culled.backfaceCulled,
+			culled.drawnTriangles, culled.triangles, culled.ranges, culled.milliseconds);
+
+		//Alternate culled and unculled frames, so drift in the clock or the
+		//driver hits both alike, and compare each pair
+		const int pairs = (std::max)(frames, 20);
+		std::vector<double> culledTimes(pairs), unculled(pairs), savings(pairs);
+		for (i = 0; i < pairs; i++) {
+			int pass;
+			for (pass = 0; pass < 2; pass++) {
+				clusterCulling = pass == 0;
+				double start = clock_seconds();
+				renderScene();
+				glFinish();
+				(pass == 0 ? culledTimes : unculled)[i] = (clock_seconds() - start) * 1000.0;
+			}
+			savings[i] = unculled[i] - culledTimes[i];
+		}
+		clusterCulling = true;
+
+		//Only call it a saving when at least three pairs in four agree
+		std::sort(savings.begin(), savings.end());
+		double median = summarise_frame_times(culledTimes).median, unculledMedian = summarise_frame_times(unculled).median;
+		double saving = summarise_frame_times(savings).median;
+		printf("Without culling: median %.3f ms against %.3f ms with it, over %d interleaved pairs; ", unculledMedian, median, pairs);
+		if (savings[pairs / 4] > 0.0)
+			printf("culling saves %.3f ms per frame (%.0f%%).\n", saving, unculledMedian > 0.0 ? 100.0 * saving / unculledMedian : 0.0);
+		else
+			printf("the difference (%+.3f ms) is below the noise.\n", saving);
+	}
+	if (mode == 'g')
+		reportSceneScaling((std::min)(frames, 5));
+	return 0;
+}
 
 // Entry point to the application.
 int main(int argc, char** argv)
 {
+	if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+		return run_benchmark(argc - 2, argv + 2);
+	if (argc > 1 && strcmp(argv[1], "--headless") == 0)
+		return runHeadless(argc - 2, argv + 2);
+
 	glutInit(&argc, argv);
 	glutInitDisplayMode(GLUT_RGBA | GLUT_DOUBLE | GLUT_MULTISAMPLE);
 	glutInitWindowSize(500, 500);
@@ -527,7 +1606,7 @@ int main(int argc, char** argv)
 	glutSpecialFunc(arrow_keys);  // For special keys
 	glutMouseFunc(mouseButton);
 	glutMotionFunc(mouseMove);
-	glutIdleFunc(idle);
+	schedulePacer();  // Polls the asset loaders; frames are drawn as things change.
 
 	glutMainLoop();
 }
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <future>
+
+
+// A value built on a background thread (std::async) and collected on the
+// render thread. The render thread polls once per frame instead of waiting,
+// so the window draws while assets load; anything that needs the GL context
+// (uploads) happens after collection, on the thread that owns the context.
+
+template <typename T>
+class AsyncAsset
+{
+public:
+	AsyncAsset() {}
+
+	AsyncAsset(const AsyncAsset&) = delete;
+	AsyncAsset& operator=(const AsyncAsset&) = delete;
+
+	// Runs 'load' on a new thread. The previous result must have been collected.
+	void start(const std::function<T()>& load)
+	{
+		m_future = std::async(std::launch::async, load);
+	}
+
+	// True from start() until the result is collected.
+	bool pending() const { return m_future.valid(); }
+
+	// Moves the result into 'out' if it is ready. Never blocks; returns true
+	// once per start().
+	bool poll(T& out)
+	{
+		if (!m_future.valid() || m_future.wait_for(std::chrono::seconds(0)) != std::future_status::ready) return false;
+		out = m_future.get();
+		return true;
+	}
+
+	// Waits for the result and moves it into 'out'. Returns false if nothing is pending.
+	bool wait(T& out)
+	{
+		if (!m_future.valid()) return false;
+		out = m_future.get();
+		return true;
+	}
+
+private:
+	std::future<T> m_future;
+};
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+// printf-style log whose lines are written and flushed by a background
+// thread, so a callback that logs never waits on the console. Lines are
+// written in the order they were logged; the destructor writes whatever is
+// still queued.
+class AsyncLog
+{
+public:
+	explicit AsyncLog(FILE* out = stdout) : m_out(out), m_stop(false)
+	{
+		m_writer = std::thread(&AsyncLog::writer, this);
+	}
+
+	~AsyncLog()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_one();
+		m_writer.join();
+	}
+
+	AsyncLog(const AsyncLog&) = delete;
+	AsyncLog& operator=(const AsyncLog&) = delete;
+
+	// Formats on the calling thread and queues the text; lines longer than 512 bytes are cut.
+	void write(const char* format, ...)
+	{
+		char line[512];
+		va_list args;
+		va_start(args, format);
+		vsnprintf(line, sizeof(line), format, args);
+		va_end(args);
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_lines.push_back(line);
+		}
+		m_wake.notify_one();
+	}
+
+private:
+	void writer()
+	{
+		std::deque<std::string> lines;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_wake.wait(lock, [this] { return m_stop || !m_lines.empty(); });
+				if (m_lines.empty() && m_stop) return;
+				lines.swap(m_lines);
+			}
+			size_t i;
+			for (i = 0; i < lines.size(); i++) fputs(lines[i].c_str(), m_out);
+			fflush(m_out);
+			lines.clear();
+		}
+	}
+
+	FILE* m_out;
+	bool m_stop;
+	std::deque<std::string> m_lines;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::thread m_writer;
+};
@@ -0,0 +1,958 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <array>
+#include <vector>
+#include "bvh.hpp"
+#include "clock.hpp"
+#include "clusters.hpp"
+#include "framepacer.hpp"
+#include "objloader.hpp"
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+#include "meshprep.hpp"
+#include "meshcache.hpp"
+#include "mipmap.hpp"
+#include "ppmimage.hpp"
+#include "quantise.hpp"
+#include "texformat.hpp"
+#include "vcache.hpp"
+
+
+// Command-line benchmarks, run with "OpenGLCoursework --bench <name> [args]".
+// They need no window or GL context.
+
+
+typedef std::function<bool(const char*, std::vector<std::array<float, 3>>&, std::vector<std::array<int, 3>>&)> ObjLoaderFunc;
+
+template <typename T>
+inline bool bench_identical(const std::vector<T>& a, const std::vector<T>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+template <typename T>
+inline bool bench_identical(const AlignedArray<T>& a, const AlignedArray<T>& b)
+{
+	return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+// Best-of-N wall time of one loader on one file.
+inline double bench_obj_loader(const ObjLoaderFunc& loader, const char* path, int iterations, std::vector<std::array<float, 3>>& vertices, std::vector<std::array<int, 3>>& vertexIndices)
+{
+	double best = 1e30;
+	int i;
+	for (i = 0; i < iterations; i++) {
+		vertices.clear();
+		vertexIndices.clear();
+		double start = clock_seconds();
+		loader(path, vertices, vertexIndices);
+		double elapsed = clock_seconds() - start;
+		if (elapsed < best) best = elapsed;
+	}
+	return best;
+}
+
+/*
+	Writes an OBJ with what a chunked parse must get right: texture and
+	normal references ("1/2/3", "1//3", "1/2"), negative indices reaching
+	back past the face's own vertices, quads and pentagons, comments, other
+	record types and CRLF line ends. Returns the number of triangles it
+	describes once fan-triangulated, 0 if it cannot be written.
+*/
+inline size_t bench_write_obj(const char* path, int faces)
+{
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		printf("Could not write '%s'.\n", path);
+		return 0;
+	}
+	fprintf(file, "# Generated by --bench obj\no chunks\nusemtl none\n");
+
+	uint32_t seed = 12345;
+	size_t triangles = 0;
+	int vertices = 0, i, k;
+	for (i = 0; i < faces; i++) {
+		seed = seed * 1103515245u + 12345u;
+		const int corners = 3 + (int)((seed >> 16) % 3);
+		const int style = (int)((seed >> 20) % 4);
+		for (k = 0; k < corners; k++) {
+			seed = seed * 1103515245u + 12345u;
+			fprintf(file, "v %.6f %.6f %.6f%s", ((seed >> 4) & 1023) / 1023.0f, ((seed >> 14) & 1023) / 1023.0f, -((seed >> 22) & 511) / 511.0f,
+				(seed & 1) ? "\r\n" : "\n");
+			vertices++;
+		}
+		fprintf(file, "vt 0.5 0.5\nvn 0 0 1\n");
+
+		fputc('f', file);
+		for (k = 0; k < corners; k++) {
+			int absolute = vertices - corners + 1 + k;
+			if (style >= 2 && absolute > 40) absolute -= 37;
+			const int relative = absolute - vertices - 1;
+			if (style == 0) fprintf(file, " %d", absolute);
+			else if (style == 1) fprintf(file, " %d/%d/%d", absolute, i + 1, i + 1);
+			else if (style == 2) fprintf(file, " %d//%d", relative, -1);
+			else fprintf(file, "  %d/%d", relative, -1);
+		}
+		fprintf(file, (seed & 2) ? "\r\n" : "\n");
+		triangles += corners - 2;
+	}
+	if (fclose(file) != 0) {
+		printf("Could not write '%s'.\n", path);
+		return 0;
+	}
+	return triangles;
+}
+
+/*
+	Parse throughput of load_obj(), load_obj_mapped() and load_obj_parallel()
+	at increasing thread counts. Every output is checked against load_obj().
+	Then load_obj_parallel() is checked against load_obj_mapped() on a
+	generated OBJ with the syntax load_obj() cannot read, split into many
+	small chunks. Usage: --bench obj [file.obj] [iterations]
+*/
+inline int bench_obj(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "bunny.obj";
+	int iterations = argc > 1 ? atoi(argv[1]) : 5;
+	if (iterations < 1) iterations = 1;
+
+	MappedFile file(path);
+	if (!file.isOpen()) {
+		printf("Could not open '%s'.\n", path);
+		return 1;
+	}
+	double megabytes = file.size() / (1024.0 * 1024.0);
+	file.close();
+
+	std::vector<std::array<float, 3>> refVertices, vertices;
+	std::vector<std::array<int, 3>> refIndices, indices;
+	double tStdio = bench_obj_loader(load_obj, path, iterations, refVertices, refIndices);
+	double tMapped = bench_obj_loader(load_obj_mapped, path, iterations, vertices, indices);
+	bool identical = bench_identical(vertices, refVertices) && bench_identical(indices, refIndices);
+
+	printf("\n%s: %.2f MB, %zu vertices, %zu faces (best of %d)\n", path, megabytes, refVertices.size(), refIndices.size(), iterations);
+	printf("  load_obj              %8.2f ms  %8.1f MB/s\n", tStdio * 1e3, megabytes / tStdio);
+	printf("  load_obj_mapped       %8.2f ms  %8.1f MB/s  %5.1fx  %s\n", tMapped * 1e3, megabytes / tMapped, tStdio / tMapped, identical ? "identical" : "DIFFERS");
+
+	bool allIdentical = identical;
+	unsigned threads;
+	for (threads = 1; ; threads *= 2) {
+		if (threads > thread_pool().size()) threads = thread_pool().size();
+		ObjLoaderFunc loader = [threads](const char* p, std::vector<std::array<float, 3>>& v, std::vector<std::array<int, 3>>& f) {
+			return load_obj_parallel(p, v, f, threads);
+		};
+		double t = bench_obj_loader(loader, path, iterations, vertices, indices);
+		identical = bench_identical(vertices, refVertices) && bench_identical(indices, refIndices);
+		allIdentical = allIdentical && identical;
+		printf("  load_obj_parallel x%-2u %8.2f ms  %8.1f MB/s  %5.1fx  %s\n", threads, t * 1e3, megabytes / t, tStdio / t, identical ? "identical" : "DIFFERS");
+		if (threads == thread_pool().size()) break;
+	}
+
+	// Most test meshes are a single default-sized chunk, so split a generated
+	// file finely enough that chunks start mid-face-list and negative indices
+	// cross chunk boundaries.
+	const char* generated = "bench_obj_chunks.obj";
+	const size_t triangles = bench_write_obj(generated, 20000);
+	if (triangles == 0) return 1;
+	refVertices.clear();
+	refIndices.clear();
+	load_obj_mapped(generated, refVertices, refIndices);
+	identical = refIndices.size() == triangles;
+	allIdentical = allIdentical && identical;
+	printf("\n%s: %zu vertices, %zu faces  %s\n", generated, refVertices.size(), refIndices.size(), identical ? "as written" : "MISCOUNTED");
+
+	const size_t chunkBytes[3] = { 1024, 16 * 1024, OBJ_MIN_CHUNK_BYTES };
+	int size;
+	for (size = 0; size < 3; size++) {
+		for (threads = 1; ; threads *= 2) {
+			if (threads > thread_pool().size()) threads = thread_pool().size();
+			vertices.clear();
+			indices.clear();
+			load_obj_parallel(generated, vertices, indices, threads, chunkBytes[size]);
+			identical = bench_identical(vertices, refVertices) && bench_identical(indices, refIndices);
+			allIdentical = allIdentical && identical;
+			printf("  load_obj_parallel x%-2u %7zu-byte chunks  %s\n", threads, chunkBytes[size], identical ? "identical to load_obj_mapped" : "DIFFERS");
+			if (threads == thread_pool().size()) break;
+		}
+	}
+	remove(generated);
+	return allIdentical ? 0 : 1;
+}
+
+/*
+	Cold-start cost of a mesh: parse + normalise + cluster + normals, the
+	steps loadMesh() runs, against loading the binary cache. The cache it
+	writes is the one the application would.
+	Usage: --bench cache [file.obj] [iterations]
+*/
+inline int bench_cache(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "bunny.obj";
+	int iterations = argc > 1 ? atoi(argv[1]) : 5;
+	if (iterations < 1) iterations = 1;
+
+	Mesh mesh, cachedMesh;
+	Float3Array normals, cachedNormals;
+	double tParse = 1e30, tCache = 1e30;
+	int i;
+	for (i = 0; i < iterations; i++) {
+		std::vector<std::array<float, 3>> vertices;
+		std::vector<std::array<int, 3>> indices;
+		double start = clock_seconds();
+		if (!load_obj_parallel(path, vertices, indices)) return 1;
+		mesh_from_obj(vertices, indices, mesh);
+		mesh_normalise(mesh);
+		cluster_mesh(mesh);
+		compute_face_normals(mesh, normals);
+		double elapsed = clock_seconds() - start;
+		if (elapsed < tParse) tParse = elapsed;
+	}
+
+	if (!save_mesh_cache(path, mesh, normals, MESH_CACHE_PREPARED)) return 1;
+	for (i = 0; i < iterations; i++) {
+		double start = clock_seconds();
+		if (!load_mesh_cache(path, cachedMesh, cachedNormals, MESH_CACHE_PREPARED)) return 1;
+		double elapsed = clock_seconds() - start;
+		if (elapsed < tCache) tCache = elapsed;
+	}
+
+	bool identical = bench_identical(mesh.positions.x, cachedMesh.positions.x) && bench_identical(mesh.positions.y, cachedMesh.positions.y)
+		&& bench_identical(mesh.positions.z, cachedMesh.positions.z) && bench_identical(mesh.indices, cachedMesh.indices)
+		&& bench_identical(normals.x, cachedNormals.x) && bench_identical(normals.y, cachedNormals.y) && bench_identical(normals.z, cachedNormals.z);
+	printf("\n%s: %zu vertices, %zu faces (best of %d)\n", path, mesh.vertexCount(), mesh.triangleCount(), iterations);
+	printf("  parse + prepare %8.3f ms\n", tParse * 1e3);
+	printf("  mesh cache      %8.3f ms  %5.1fx  %s\n", tCache * 1e3, tParse / tCache, identical ? "identical" : "DIFFERS");
+	return identical ? 0 : 1;
+}
+
+// Best-of-N time of a preparation step.
+template <typename Setup, typename Step>
+inline double bench_step(int iterations, Setup setup, Step step)
+{
+	double best = 1e30;
+	int i;
+	for (i = 0; i < iterations; i++) {
+		setup();
+		double start = clock_seconds();
+		step();
+		double elapsed = clock_seconds() - start;
+		if (elapsed < best) best = elapsed;
+	}
+	return best;
+}
+
+// The original three-pass normaliseVectors(), kept as the baseline.
+inline void normalise_reference(std::vector<std::array<float, 3>>& vertices)
+{
+	size_t i;
+	float maxX = vertices[0][0], maxY = vertices[0][1], maxZ = vertices[0][2];
+	float minX = vertices[0][0], minY = vertices[0][1], minZ = vertices[0][2];
+	for (i = 0; i < vertices.size(); i++) {
+		if (maxX < vertices[i][0]) maxX = vertices[i][0];
+		if (maxY < vertices[i][1]) maxY = vertices[i][1];
+		if (maxZ < vertices[i][2]) maxZ = vertices[i][2];
+		if (minX > vertices[i][0]) minX = vertices[i][0];
+		if (minY > vertices[i][1]) minY = vertices[i][1];
+		if (minZ > vertices[i][2]) minZ = vertices[i][2];
+	}
+	float range = (std::max)((std::max)(maxX - minX, maxZ - minZ), maxY - minY);
+	for (i = 0; i < vertices.size(); i++) {
+		vertices[i][0] = (vertices[i][0] - minX) / (range);
+		vertices[i][1] = (vertices[i][1] - minY) / (range);
+		vertices[i][2] = (vertices[i][2] - minZ) / (range);
+	}
+	for (i = 0; i < vertices.size(); i++) {
+		vertices[i][0] = (vertices[i][0] * 2) - 1;
+		vertices[i][1] = (vertices[i][1] * 2) - 1;
+		vertices[i][2] = (vertices[i][2] * 2) - 1;
+	}
+}
+
+/*
+	mesh_normalise() at every SIMD level the CPU supports, checked against
+	its scalar result, and the original three-pass loop over the same
+	vertices as the baseline, on random vertices.
+	Usage: --bench normalise [millions of vertices] [iterations]
+*/
+inline int bench_normalise(int argc, char** argv)
+{
+	double millions = argc > 0 ? atof(argv[0]) : 10;
+	int iterations = argc > 1 ? atoi(argv[1]) : 5;
+	if (iterations < 1) iterations = 1;
+	size_t count = (size_t)(millions * 1e6);
+	if (count < 1) count = 1;
+
+	std::vector<std::array<float, 3>> source(count), reference;
+	Mesh sourceMesh, work, scalar;
+	sourceMesh.positions.resize(count);
+	float* arrays[3] = { sourceMesh.positions.x.data(), sourceMesh.positions.y.data(), sourceMesh.positions.z.data() };
+	size_t i;
+	unsigned int seed = 12345;
+	for (i = 0; i < count; i++) {
+		int k;
+		for (k = 0; k < 3; k++) {
+			seed = seed * 1664525u + 1013904223u;
+			source[i][k] = arrays[k][i] = (float)(seed >> 8) / (1 << 24) * 200.0f - 50.0f;
+		}
+	}
+	const double gigabytes = count * sizeof(source[0]) / 1e9;
+
+	printf("%zu vertices, %.2f GB (best of %d)\n", count, gigabytes, iterations);
+
+	double tReference = 1e30;
+	int it;
+	for (it = 0; it < iterations; it++) {
+		reference = source;
+		double start = clock_seconds();
+		normalise_reference(reference);
+		double elapsed = clock_seconds() - start;
+		if (elapsed < tReference) tReference = elapsed;
+	}
+	printf("  reference (3 passes) %8.2f ms  %6.2f GB/s\n", tReference * 1e3, gigabytes / tReference);
+
+	// Against the original loop the results differ by rounding only; every
+	// SIMD level must match the scalar mesh_normalise() exactly.
+	bool allIdentical = true;
+	int level;
+	for (level = SIMD_SCALAR; level <= simd_level(); level++) {
+		const SimdLevel simd = (SimdLevel)level;
+		double best = bench_step(iterations, [&] { work = sourceMesh; }, [&] { mesh_normalise(work, simd); });
+		if (level == SIMD_SCALAR) scalar = work;
+
+		float maxError = 0;
+		for (i = 0; i < count; i++) {
+			maxError = (std::max)(maxError, fabsf(work.positions.x[i] - reference[i][0]));
+			maxError = (std::max)(maxError, fabsf(work.positions.y[i] - reference[i][1]));
+			maxError = (std::max)(maxError, fabsf(work.positions.z[i] - reference[i][2]));
+		}
+		const bool identical = bench_identical(work.positions.x, scalar.positions.x) && bench_identical(work.positions.y, scalar.positions.y)
+			&& bench_identical(work.positions.z, scalar.positions.z);
+		allIdentical = allIdentical && identical;
+		printf("  mesh_normalise %-5s %8.2f ms  %6.2f GB/s  %5.1fx  max error %.2g  %s\n", simd_level_name(simd), best * 1e3, gigabytes / best, tReference / best, maxError,
+			identical ? "matches scalar" : "DIFFERS FROM SCALAR");
+	}
+	return allIdentical ? 0 : 1;
+}
+
+// The array-of-structs normal loops the mesh code used before Mesh, kept as
+// the baseline for bench_mesh(). Indices are 1-based, as load_obj() returns.
+inline void face_normals_aos(const std::vector<std::array<float, 3>>& vertices, const std::vector<std::array<int, 3>>& vertexIndices, std::vector<std::array<float, 3>>& faceNormals)
+{
+	faceNormals.resize(vertexIndices.size());
+	size_t i;
+	for (i = 0; i < vertexIndices.size(); i++) {
+		const std::array<float, 3>& a = vertices[vertexIndices[i][0] - 1];
+		const std::array<float, 3>& b = vertices[vertexIndices[i][1] - 1];
+		const std::array<float, 3>& c = vertices[vertexIndices[i][2] - 1];
+		float v[] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float w[] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float nx = (v[1] * w[2]) - (v[2] * w[1]);
+		float ny = (v[2] * w[0]) - (v[0] * w[2]);
+		float nz = (v[0] * w[1]) - (v[1] * w[0]);
+		float length = sqrtf(nx * nx + ny * ny + nz * nz);
+		float scale = length > 0 ? 1.0f / length : 0.0f;
+		faceNormals[i][0] = nx * scale;
+		faceNormals[i][1] = ny * scale;
+		faceNormals[i][2] = nz * scale;
+	}
+}
+
+inline void vertex_normals_aos(const std::vector<std::array<float, 3>>& vertices, const std::vector<std::array<int, 3>>& vertexIndices, std::vector<std::array<float, 3>>& vertexNormals)
+{
+	vertexNormals.assign(vertices.size(), std::array<float, 3>{ { 0.0f, 0.0f, 0.0f } });
+	size_t i;
+	for (i = 0; i < vertexIndices.size(); i++) {
+		const int p[3] = { vertexIndices[i][0] - 1, vertexIndices[i][1] - 1, vertexIndices[i][2] - 1 };
+		const std::array<float, 3>& a = vertices[p[0]];
+		const std::array<float, 3>& b = vertices[p[1]];
+		const std::array<float, 3>& c = vertices[p[2]];
+		float v[] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+		float w[] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+		float n[] = { (v[1] * w[2]) - (v[2] * w[1]), (v[2] * w[0]) - (v[0] * w[2]), (v[0] * w[1]) - (v[1] * w[0]) };
+		int j, k;
+		for (j = 0; j < 3; j++)
+			for (k = 0; k < 3; k++) vertexNormals[p[j]][k] += n[k];
+	}
+	for (i = 0; i < vertexNormals.size(); i++) {
+		std::array<float, 3>& n = vertexNormals[i];
+		float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		float scale = length > 0 ? 1.0f / length : 0.0f;
+		n[0] *= scale;
+		n[1] *= scale;
+		n[2] *= scale;
+	}
+}
+
+/*
+	Mesh preparation on the old array-of-structs vectors against the
+	structure-of-arrays Mesh. Usage: --bench mesh [file.obj] [iterations]
+*/
+inline int bench_mesh(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "bunny.obj";
+	int iterations = argc > 1 ? atoi(argv[1]) : 20;
+	if (iterations < 1) iterations = 1;
+
+	std::vector<std::array<float, 3>> source, vertices, faceNormals, vertexNormals;
+	std::vector<std::array<int, 3>> indices;
+	if (!load_obj_parallel(path, source, indices)) return 1;
+	Mesh sourceMesh, mesh;
+	mesh_from_obj(source, indices, sourceMesh);
+	Float3Array meshFaceNormals, meshVertexNormals;
+
+	vertices = source;
+	normalise_reference(vertices);
+	mesh = sourceMesh;
+	mesh_normalise(mesh);
+
+	double aosNormalise = bench_step(iterations, [&] { vertices = source; }, [&] { normalise_reference(vertices); });
+	double soaNormalise = bench_step(iterations, [&] { mesh = sourceMesh; }, [&] { mesh_normalise(mesh); });
+	double aosFace = bench_step(iterations, [] {}, [&] { face_normals_aos(vertices, indices, faceNormals); });
+	double soaFace = bench_step(iterations, [] {}, [&] { compute_face_normals(mesh, meshFaceNormals); });
+	double aosVertex = bench_step(iterations, [] {}, [&] { vertex_normals_aos(vertices, indices, vertexNormals); });
+	double soaVertex = bench_step(iterations, [] {}, [&] { compute_vertex_normals(mesh, NORMALS_AREA_WEIGHTED, meshVertexNormals); });
+
+	float maxError = 0;
+	size_t i;
+	for (i = 0; i < faceNormals.size(); i++) {
+		maxError = (std::max)(maxError, fabsf(faceNormals[i][0] - meshFaceNormals.x[i]));
+		maxError = (std::max)(maxError, fabsf(faceNormals[i][1] - meshFaceNormals.y[i]));
+		maxError = (std::max)(maxError, fabsf(faceNormals[i][2] - meshFaceNormals.z[i]));
+	}
+
+	printf("\n%s: %zu vertices, %zu faces (best of %d, %s)\n", path, mesh.vertexCount(), mesh.triangleCount(), iterations, simd_level_name(simd_level()));
+	printf("                     AoS vectors    SoA Mesh\n");
+	printf("  normalise        %10.3f ms %10.3f ms  %5.2fx\n", aosNormalise * 1e3, soaNormalise * 1e3, aosNormalise / soaNormalise);
+	printf("  face normals     %10.3f ms %10.3f ms  %5.2fx\n", aosFace * 1e3, soaFace * 1e3, aosFace / soaFace);
+	printf("  vertex normals   %10.3f ms %10.3f ms  %5.2fx\n", aosVertex * 1e3, soaVertex * 1e3, aosVertex / soaVertex);
+	printf("  max face normal difference %.2g\n", maxError);
+	return 0;
+}
+
+/*
+	Mipmap pyramid build time with the box filter at each SIMD level (checked
+	against the scalar pyramid) and with the Kaiser filter.
+	Usage: --bench mipmap [file.ppm] [iterations]
+*/
+inline int bench_mipmap(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "mandrill.ppm";
+	int iterations = argc > 1 ? atoi(argv[1]) : 5;
+	if (iterations < 1) iterations = 1;
+
+	PpmImage image;
+	if (!image.open(path)) return 1;
+	std::vector<unsigned char> pixels(image.rowBytes() * image.height());
+	if (!image.readRows(image.height(), &pixels[0])) {
+		printf("'%s' has malformed pixel data.\n", path);
+		return 1;
+	}
+	const int width = image.width(), height = image.height(), channels = image.channels();
+	printf("%dx%d, %d channel(s) (best of %d)\n", width, height, channels, iterations);
+
+	std::vector<MipLevel> reference, levels;
+	double tScalar = 0.0;
+	int level, it;
+	for (level = SIMD_SCALAR; level <= simd_level(); level++) {
+		double best = 1e30;
+		for (it = 0; it < iterations; it++) {
+			double start = clock_seconds();
+			build_mipmaps(&pixels[0], width, height, channels, MIP_FILTER_BOX, levels, (SimdLevel)level);
+			double elapsed = clock_seconds() - start;
+			if (elapsed < best) best = elapsed;
+		}
+		if (level == SIMD_SCALAR) {
+			reference = levels;
+			tScalar = best;
+		}
+
+		bool identical = levels.size() == reference.size();
+		size_t i;
+		for (i = 0; identical && i < levels.size(); i++) identical = bench_identical(levels[i].pixels, reference[i].pixels);
+		printf("  box %-16s %8.2f ms  %5.1fx  %u levels  %s\n", simd_level_name((SimdLevel)level), best * 1e3, tScalar / best, (unsigned)levels.size(), identical ? "identical" : "DIFFERS");
+	}
+
+	double best = 1e30;
+	for (it = 0; it < iterations; it++) {
+		double start = clock_seconds();
+		build_mipmaps(&pixels[0], width, height, channels, MIP_FILTER_KAISER, levels);
+		double elapsed = clock_seconds() - start;
+		if (elapsed < best) best = elapsed;
+	}
+	printf("  kaiser               %8.2f ms\n", best * 1e3);
+	return 0;
+}
+
+/*
+	Texture memory of a mipmapped image in each storage format, and the time
+	and error (PSNR over every level) of the BC1 encoder.
+	Usage: --bench texformat [file.ppm] [iterations]
+*/
+inline int bench_texformat(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "mandrill.ppm";
+	int iterations = argc > 1 ? atoi(argv[1]) : 5;
+	if (iterations < 1) iterations = 1;
+
+	PpmImage image;
+	if (!image.open(path)) return 1;
+	std::vector<unsigned char> pixels(image.rowBytes() * image.height());
+	if (!image.readRows(image.height(), &pixels[0])) {
+		printf("'%s' has malformed pixel data.\n", path);
+		return 1;
+	}
+	const int channels = image.channels();
+	std::vector<MipLevel> levels, encoded;
+	build_mipmaps(&pixels[0], image.width(), image.height(), channels, MIP_FILTER_BOX, levels);
+	printf("%dx%d, %u levels (best of %d, %u threads)\n", image.width(), image.height(), (unsigned)levels.size(), iterations, thread_pool().size());
+
+	// RGB16 is what the coursework used to request for this 8-bit data.
+	size_t rgb16 = 0, i;
+	for (i = 0; i < levels.size(); i++) rgb16 += (size_t)levels[i].width * levels[i].height * channels * 2;
+	printf("  %-8s %10.1f KB\n", "rgb16", rgb16 / 1024.0);
+	const TextureFormat formats[3] = { TEXTURE_FORMAT_RGB8, TEXTURE_FORMAT_RGBA8, TEXTURE_FORMAT_BC1 };
+	int f;
+	for (f = 0; f < 3; f++) {
+		size_t bytes = 0;
+		for (i = 0; i < levels.size(); i++) bytes += texture_level_bytes(formats[f], levels[i].width, levels[i].height, channels);
+		printf("  %-8s %10.1f KB  %5.2fx smaller\n", texture_format_name(formats[f]), bytes / 1024.0, (double)rgb16 / bytes);
+	}
+
+	double best = 1e30;
+	int it;
+	for (it = 0; it < iterations; it++) {
+		encoded = levels;
+		double start = clock_seconds();
+		bc1_encode_levels(encoded, channels);
+		double elapsed = clock_seconds() - start;
+		if (elapsed < best) best = elapsed;
+	}
+
+	double squaredError = 0.0, samples = 0.0;
+	std::vector<unsigned char> decoded;
+	for (i = 0; i < levels.size(); i++) {
+		const size_t count = (size_t)levels[i].width * levels[i].height;
+		decoded.resize(count * 3);
+		bc1_decode(&encoded[i].pixels[0], levels[i].width, levels[i].height, &decoded[0]);
+		size_t j;
+		int k;
+		for (j = 0; j < count; j++) {
+			for (k = 0; k < 3; k++) {
+				const double d = (double)decoded[j * 3 + k] - levels[i].pixels[j * channels + (channels == 3 ? k : 0)];
+				squaredError += d * d;
+			}
+		}
+		samples += count * 3.0;
+	}
+	const double mse = squaredError / samples;
+	printf("  bc1 encode %8.2f ms  PSNR %.2f dB\n", best * 1e3, mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0);
+	return 0;
+}
+
+// Sorted copy of the triangles, each rotated to start at its smallest index.
+inline std::vector<std::array<uint32_t, 3>> bench_triangle_set(const Mesh& mesh)
+{
+	std::vector<std::array<uint32_t, 3>> triangles(mesh.triangleCount());
+	size_t i;
+	for (i = 0; i < triangles.size(); i++) {
+		const uint32_t* t = &mesh.indices[3 * i];
+		int first = t[0] <= t[1] && t[0] <= t[2] ? 0 : (t[1] <= t[2] ? 1 : 2);
+		triangles[i] = {{ t[first], t[(first + 1) % 3], t[(first + 2) % 3] }};
+	}
+	std::sort(triangles.begin(), triangles.end());
+	return triangles;
+}
+
+/*
+	Simulated vertex cache behaviour after each mesh optimisation pass run
+	over the whole mesh, and after cluster_mesh(), which runs them per
+	cluster and is the order the application draws, with the time each
+	takes. Usage: --bench vcache [file.obj] [iterations]
+*/
+inline int bench_vcache(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "bunny.obj";
+	int iterations = argc > 1 ? atoi(argv[1]) : 10;
+	if (iterations < 1) iterations = 1;
+
+	std::vector<std::array<float, 3>> vertices;
+	std::vector<std::array<int, 3>> indices;
+	if (!load_obj_parallel(path, vertices, indices)) return 1;
+	Mesh source, cacheOrder, overdrawOrder, fetchOrder, clustered;
+	mesh_from_obj(vertices, indices, source);
+	mesh_normalise(source);
+
+	cacheOrder = source;
+	double tCache = bench_step(iterations, [&] { cacheOrder = source; },
+		[&] { optimise_vertex_cache(cacheOrder.indices.data(), cacheOrder.triangleCount(), cacheOrder.vertexCount()); });
+	overdrawOrder = cacheOrder;
+	double tOverdraw = bench_step(iterations, [&] { overdrawOrder = cacheOrder; },
+		[&] { optimise_overdraw(overdrawOrder.indices.data(), overdrawOrder.triangleCount(), overdrawOrder.positions); });
+	fetchOrder = overdrawOrder;
+	double tFetch = bench_step(iterations, [&] { fetchOrder = overdrawOrder; }, [&] { optimise_vertex_fetch(fetchOrder); });
+	clustered = source;
+	double tClustered = bench_step(iterations, [&] { clustered = source; }, [&] { cluster_mesh(clustered); });
+
+	bool sameTriangles = bench_triangle_set(source) == bench_triangle_set(overdrawOrder);
+	printf("\n%s: %zu vertices, %zu faces (best of %d)\n", path, source.vertexCount(), source.triangleCount(), iterations);
+	printf("                   FIFO %d ACMR  ATVR   LRU %d ACMR  ATVR       time\n", VCACHE_FIFO_SIZE, VCACHE_LRU_SIZE);
+	const Mesh* meshes[5] = { &source, &cacheOrder, &overdrawOrder, &fetchOrder, &clustered };
+	const char* names[5] = { "original", "vertex cache", "+ overdraw", "+ vertex fetch", "clustered" };
+	const double times[5] = { 0.0, tCache, tOverdraw, tFetch, tClustered };
+	int m;
+	for (m = 0; m < 5; m++) {
+		VertexCacheReport report = vcache_report(*meshes[m]);
+		printf("  %-16s %12.3f %5.3f %12.3f %5.3f  %8.3f ms\n", names[m], report.fifo.acmr, report.fifo.atvr, report.lru.acmr, report.lru.atvr, times[m] * 1e3);
+	}
+	printf("  %zu vertices after fetch order, triangles %s\n", fetchOrder.vertexCount(), sameTriangles ? "unchanged" : "DIFFER");
+	return sameTriangles ? 0 : 1;
+}
+
+/*
+	snorm16 position encode/decode kernels at each SIMD level (checked
+	against the scalar ones), octahedral normal coding, and the size and
+	error of the quantised mesh. Usage: --bench quantise [file.obj] [iterations]
+*/
+inline int bench_quantise(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "bunny.obj";
+	int iterations = argc > 1 ? atoi(argv[1]) : 50;
+	if (iterations < 1) iterations = 1;
+
+	std::vector<std::array<float, 3>> vertices;
+	std::vector<std::array<int, 3>> indices;
+	if (!load_obj_parallel(path, vertices, indices)) return 1;
+	Mesh mesh;
+	Float3Array normals;
+	mesh_from_obj(vertices, indices, mesh);
+	mesh_normalise(mesh);
+	compute_vertex_normals(mesh, NORMALS_AREA_WEIGHTED, normals);
+
+	const size_t count = mesh.vertexCount();
+	printf("\n%s: %zu vertices, %zu faces (best of %d)\n", path, count, mesh.triangleCount(), iterations);
+	AlignedArray<int16_t> encoded(count), reference(count);
+	AlignedArray<float> decoded(count), referenceDecoded(count);
+	snorm16_encode_array_scalar(mesh.positions.x.data(), count, reference.data());
+	snorm16_decode_array_scalar(reference.data(), count, referenceDecoded.data());
+
+	bool allIdentical = true;
+	double tEncodeScalar = 0.0, tDecodeScalar = 0.0;
+	int level;
+	for (level = SIMD_SCALAR; level <= (int)simd_level() && level <= SIMD_SSE2; level++) {
+		const SimdLevel simd = (SimdLevel)level;
+		double tEncode = bench_step(iterations, [] {}, [&] { snorm16_encode_array(mesh.positions.x.data(), count, encoded.data(), simd); });
+		double tDecode = bench_step(iterations, [] {}, [&] { snorm16_decode_array(encoded.data(), count, decoded.data(), simd); });
+		if (level == SIMD_SCALAR) {
+			tEncodeScalar = tEncode;
+			tDecodeScalar = tDecode;
+		}
+		bool identical = bench_identical(encoded, reference) && bench_identical(decoded, referenceDecoded);
+		allIdentical = allIdentical && identical;
+		printf("  snorm16 %-7s encode %8.2f us %5.1fx  decode %8.2f us %5.1fx  %s\n", simd_level_name(simd),
+			tEncode * 1e6, tEncodeScalar / tEncode, tDecode * 1e6, tDecodeScalar / tDecode, identical ? "identical" : "DIFFERS");
+	}
+
+	QuantisedMesh quantised;
+	Mesh restored;
+	Float3Array restoredNormals;
+	double tQuantise = bench_step(iterations, [] {}, [&] { quantise_mesh(mesh, normals, quantised); });
+	double tRestore = bench_step(iterations, [] {}, [&] { dequantise_mesh(quantised, restored, restoredNormals); });
+	printf("  quantise_mesh %8.2f us  dequantise_mesh %8.2f us\n", tQuantise * 1e6, tRestore * 1e6);
+	print_quantisation_report(path, measure_quantisation_error(mesh, normals, quantised));
+	return allIdentical ? 0 : 1;
+}
+
+// Small deterministic generator for benchmark queries, in [-1,1).
+struct BenchRandom
+{
+	uint32_t state;
+	explicit BenchRandom(uint32_t seed) : state(seed) {}
+	float next()
+	{
+		state = state * 1664525u + 1013904223u;
+		return (state >> 8) * (2.0f / 16777216.0f) - 1.0f;
+	}
+};
+
+// Loop-over-every-triangle versions of the BVH queries, for checking and as the baseline.
+inline bool bench_ray_brute(const Mesh& mesh, const float origin[3], const float direction[3], BvhRayHit& hit)
+{
+	bool found = false;
+	float best = FLT_MAX;
+	size_t i;
+	for (i = 0; i < mesh.triangleCount(); i++) {
+		const uint32_t* c = &mesh.indices[3 * i];
+		BvhTriangle tri;
+		const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+		int k;
+		for (k = 0; k < 3; k++) {
+			tri.v0[k] = arrays[k][c[0]];
+			tri.e1[k] = arrays[k][c[1]] - tri.v0[k];
+			tri.e2[k] = arrays[k][c[2]] - tri.v0[k];
+		}
+		float t, u, v;
+		if (bvh_ray_triangle(origin, direction, tri, 0.0f, best, t, u, v)) {
+			best = hit.t = t;
+			hit.triangle = (uint32_t)i;
+			found = true;
+		}
+	}
+	return found;
+}
+
+inline void bench_corners(const Mesh& mesh, size_t i, float a[3], float b[3], float c[3])
+{
+	const uint32_t* corners = &mesh.indices[3 * i];
+	const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+	int k;
+	for (k = 0; k < 3; k++) {
+		a[k] = arrays[k][corners[0]];
+		b[k] = arrays[k][corners[1]];
+		c[k] = arrays[k][corners[2]];
+	}
+}
+
+/*
+	BVH build time on one thread and on the pool, and ray, closest-point and
+	box query throughput against a loop over every triangle (whose answers
+	the BVH must match). Usage: --bench bvh [file.obj] [queries]
+*/
+inline int bench_bvh(int argc, char** argv)
+{
+	const char* path = argc > 0 ? argv[0] : "bunny.obj";
+	int queries = argc > 1 ? atoi(argv[1]) : 100000;
+	if (queries < 1) queries = 1;
+
+	std::vector<std::array<float, 3>> vertices;
+	std::vector<std::array<int, 3>> indices;
+	if (!load_obj_parallel(path, vertices, indices)) return 1;
+	Mesh mesh;
+	mesh_from_obj(vertices, indices, mesh);
+	mesh_normalise(mesh);
+
+	Bvh serial, parallel;
+	double tSerial = bench_step(10, [] {}, [&] { serial.build(mesh, false); });
+	double tParallel = bench_step(10, [] {}, [&] { parallel.build(mesh, true); });
+	const bool sameTree = serial.nodeCount() == parallel.nodeCount()
+		&& memcmp(serial.nodes(), parallel.nodes(), serial.nodeCount() * sizeof(BvhNode)) == 0;
+	const BvhStats stats = parallel.stats();
+	printf("\n%s: %zu faces\n", path, mesh.triangleCount());
+	printf("  build, 1 thread     %8.3f ms\n", tSerial * 1e3);
+	printf("  build, %2u threads   %8.3f ms  %5.2fx  %s\n", thread_pool().size(), tParallel * 1e3, tSerial / tParallel, sameTree ? "same tree" : "DIFFERENT TREE");
+	printf("  %zu nodes, %zu leaves, depth %d, SAH cost %.1f, %.1f KB\n", stats.nodes, stats.leaves, stats.depth, stats.sahCost, parallel.bytes() / 1024.0);
+
+	// Rays from a sphere of radius 3 towards random points inside the mesh's cube.
+	std::vector<float> rays(queries * 6);
+	BenchRandom random(1);
+	int q, k;
+	for (q = 0; q < queries; q++) {
+		float* ray = &rays[6 * q];
+		float length = 0.0f;
+		for (k = 0; k < 3; k++) { ray[k] = random.next(); length += ray[k] * ray[k]; }
+		length = sqrtf((std::max)(length, 1e-6f));
+		for (k = 0; k < 3; k++) { ray[k] *= 3.0f / length; ray[3 + k] = random.next() - ray[k]; }
+	}
+	int hits = 0;
+	double start = clock_seconds();
+	for (q = 0; q < queries; q++) {
+		BvhRayHit hit;
+		hits += parallel.intersectRay(&rays[6 * q], &rays[6 * q + 3], FLT_MAX, hit) ? 1 : 0;
+	}
+	double tRays = clock_seconds() - start;
+
+	const int checked = (std::min)(queries, 2000);
+	int mismatches = 0;
+	start = clock_seconds();
+	for (q = 0; q < checked; q++) {
+		BvhRayHit fast, slow;
+		bool a = parallel.intersectRay(&rays[6 * q], &rays[6 * q + 3], FLT_MAX, fast);
+		bool b = bench_ray_brute(mesh, &rays[6 * q], &rays[6 * q + 3], slow);
+		if (a != b || (a && fabsf(fast.t - slow.t) > 1e-5f)) mismatches++;
+	}
+	double tRaysBrute = (clock_seconds() - start) / checked * queries;
+	printf("  rays          %8.2f Mrays/s  %6.0fx brute force  %d%% hit  %s\n", queries / tRays * 1e-6, tRaysBrute / tRays,
+		100 * hits / queries, mismatches == 0 ? "matches" : "MISMATCH");
+	int failures = mismatches;
+
+	// Closest points to random points around the mesh.
+	std::vector<float> points(queries * 3);
+	for (q = 0; q < queries * 3; q++) points[q] = 1.5f * random.next();
+	double sum = 0.0;
+	start = clock_seconds();
+	for (q = 0; q < queries; q++) {
+		BvhClosestPoint closest;
+		if (parallel.closestPoint(&points[3 * q], FLT_MAX, closest)) sum += closest.distanceSquared;
+	}
+	double tClosest = clock_seconds() - start;
+
+	mismatches = 0;
+	start = clock_seconds();
+	for (q = 0; q < checked; q++) {
+		BvhClosestPoint closest;
+		parallel.closestPoint(&points[3 * q], FLT_MAX, closest);
+		float best = FLT_MAX;
+		size_t i;
+		for (i = 0; i < mesh.triangleCount(); i++) {
+			float a[3], b[3], c[3], p[3];
+			bench_corners(mesh, i, a, b, c);
+			bvh_closest_on_triangle(&points[3 * q], a, b, c, p);
+			const float d[3] = { p[0] - points[3 * q], p[1] - points[3 * q + 1], p[2] - points[3 * q + 2] };
+			best = (std::min)(best, bvh_dot(d, d));
+		}
+		if (fabsf(sqrtf(best) - sqrtf(closest.distanceSquared)) > 1e-5f) mismatches++;
+	}
+	double tClosestBrute = (clock_seconds() - start) / checked * queries;
+	printf("  closest point %8.2f Mq/s     %6.0fx brute force  %s\n", queries / tClosest * 1e-6, tClosestBrute / tClosest,
+		mismatches == 0 ? "matches" : "MISMATCH");
+	failures += mismatches;
+
+	// Boxes of side 0.2 at random points.
+	std::vector<uint32_t> found;
+	size_t overlaps = 0;
+	start = clock_seconds();
+	for (q = 0; q < queries; q++) {
+		const float* p = &points[3 * q];
+		const float min[3] = { p[0] - 0.1f, p[1] - 0.1f, p[2] - 0.1f }, max[3] = { p[0] + 0.1f, p[1] + 0.1f, p[2] + 0.1f };
+		found.clear();
+		overlaps += parallel.overlapBox(min, max, found);
+	}
+	double tBoxes = clock_seconds() - start;
+
+	mismatches = 0;
+	start = clock_seconds();
+	for (q = 0; q < checked; q++) {
+		const float* p = &points[3 * q];
+		const float min[3] = { p[0] - 0.1f, p[1] - 0.1f, p[2] - 0.1f }, max[3] = { p[0] + 0.1f, p[1] + 0.1f, p[2] + 0.1f };
+		const float half[3] = { 0.1f, 0.1f, 0.1f };
+		found.clear();
+		parallel.overlapBox(min, max, found);
+		size_t expected = 0, i;
+		for (i = 0; i < mesh.triangleCount(); i++) {
+			float a[3], b[3], c[3];
+			bench_corners(mesh, i, a, b, c);
+			if (bvh_triangle_box(a, b, c, p, half)) expected++;
+		}
+		if (expected != found.size()) mismatches++;
+	}
+	double tBoxesBrute = (clock_seconds() - start) / checked * queries;
+	printf("  box overlap   %8.2f Mq/s     %6.0fx brute force  %.1f triangles each  %s\n", queries / tBoxes * 1e-6, tBoxesBrute / tBoxes,
+		(double)overlaps / queries, mismatches == 0 ? "matches" : "MISMATCH");
+	failures += mismatches;
+	return sameTree && failures == 0 ? 0 : 1;
+}
+
+/*
+	Runs 'pacer' on the fake clock 'now' for 'seconds', marking it dirty
+	every 'inputEvery' seconds (0 for never) and taking 'drawSeconds' per
+	frame. Returns the frames drawn.
+*/
+inline int bench_pace(FramePacer& pacer, double& now, double seconds, double drawSeconds, double inputEvery)
+{
+	const double end = now + seconds;
+	double nextInput = inputEvery > 0.0 ? now : end;
+	int frames = 0;
+	while (now < end) {
+		while (nextInput <= now) {
+			pacer.markDirty();
+			nextInput += inputEvery;
+		}
+		if (pacer.frameDue()) {
+			pacer.beginFrame();
+			now += drawSeconds;
+			pacer.endFrame();
+			frames++;
+			continue;
+		}
+		const double wait = pacer.secondsUntilDue();
+		double next = (std::min)(nextInput, end);
+		if (wait >= 0.0) next = (std::min)(next, now + wait);
+		now = next;
+	}
+	return frames;
+}
+
+inline bool bench_pacer_check(const char* what, int frames, int expected)
+{
+	printf("  %-46s %3d frames  %s\n", what, frames, frames == expected ? "ok" : "FAIL");
+	if (frames != expected) printf("    expected %d\n", expected);
+	return frames == expected;
+}
+
+/*
+	FramePacer's schedule on a fake clock: dirty-only redraws, a capped
+	rate, a continuous rate and the restart after a stalled frame. Times are
+	powers of two, so the expected frame counts are exact.
+	Usage: --bench pacer
+*/
+inline int bench_pacer(int, char**)
+{
+	double now = 100.0;
+	FramePacer pacer([&now] { return now; }, 1.0);
+	const double draw = 1.0 / 64.0;
+	bool ok = true;
+
+	printf("\nFrame pacer, fake clock, %.3f ms per frame\n", draw * 1e3);
+	ok = bench_pacer_check("dirty only, no input for 1 s", bench_pace(pacer, now, 1.0, draw, 0.0), 1) && ok;
+	ok = bench_pacer_check("dirty only, input every 250 ms for 1 s", bench_pace(pacer, now, 1.0, draw, 0.25), 4) && ok;
+	ok = bench_pacer_check("dirty only, input every 1/128 s for 1 s", bench_pace(pacer, now, 1.0, draw, 1.0 / 128.0), 64) && ok;
+	if (pacer.secondsUntilDue() != -1.0) {
+		printf("  FAIL: a clean view without a rate is due in %.3f s, not never\n", pacer.secondsUntilDue());
+		ok = false;
+	}
+
+	pacer.setRate(8.0, false);
+	ok = bench_pacer_check("capped at 8 Hz, input every 1/128 s for 1 s", bench_pace(pacer, now, 1.0, draw, 1.0 / 128.0), 8) && ok;
+	ok = bench_pacer_check("capped at 8 Hz, last input pending, then none", bench_pace(pacer, now, 1.0, draw, 0.0), 1) && ok;
+
+	pacer.setRate(8.0, true);
+	ok = bench_pacer_check("continuous 8 Hz, no input for 2 s", bench_pace(pacer, now, 2.0, draw, 0.0), 16) && ok;
+	if (pacer.smoothedIntervalMilliseconds() != 125.0 || pacer.smoothedDrawMilliseconds() != draw * 1e3) {
+		printf("  FAIL: interval %.3f ms and draw %.3f ms, expected 125.000 and %.3f\n",
+			pacer.smoothedIntervalMilliseconds(), pacer.smoothedDrawMilliseconds(), draw * 1e3);
+		ok = false;
+	}
+
+	// One frame takes 5 s; the next is due at once, then the schedule restarts
+	// from it instead of drawing the 40 frames it missed.
+	while (!pacer.frameDue()) now += pacer.secondsUntilDue();
+	pacer.beginFrame();
+	now += 5.0;
+	pacer.endFrame();
+	ok = bench_pacer_check("continuous 8 Hz, 1 s after a 5 s frame", bench_pace(pacer, now, 1.0, draw, 0.0), 8) && ok;
+
+	printf("  %s\n", ok ? "schedule matches" : "SCHEDULE WRONG");
+	return ok ? 0 : 1;
+}
+
+inline int run_benchmark(int argc, char** argv)
+{
+	if (argc > 0 && strcmp(argv[0], "obj") == 0) return bench_obj(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "cache") == 0) return bench_cache(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "normalise") == 0) return bench_normalise(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "mesh") == 0) return bench_mesh(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "mipmap") == 0) return bench_mipmap(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "texformat") == 0) return bench_texformat(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "vcache") == 0) return bench_vcache(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "quantise") == 0) return bench_quantise(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "bvh") == 0) return bench_bvh(argc - 1, argv + 1);
+	if (argc > 0 && strcmp(argv[0], "pacer") == 0) return bench_pacer(argc - 1, argv + 1);
+
+	printf("Usage: --bench <name> [args]\n");
+	printf("  obj [file.obj] [iterations]   OBJ parse throughput\n");
+	printf("  cache [file.obj] [iterations] Cold start from OBJ vs mesh cache\n");
+	printf("  normalise [millions] [iterations]  SIMD normaliseVectors kernels\n");
+	printf("  mesh [file.obj] [iterations]  AoS vectors vs SoA Mesh preparation\n");
+	printf("  mipmap [file.ppm] [iterations]  Mipmap pyramid build, box and Kaiser\n");
+	printf("  texformat [file.ppm] [iterations]  Texture memory per format, BC1 encoder\n");
+	printf("  vcache [file.obj] [iterations]  Vertex cache, overdraw and fetch reordering\n");
+	printf("  quantise [file.obj] [iterations]  Quantised mesh kernels, size and error\n");
+	printf("  bvh [file.obj] [queries]      BVH build time and ray/closest-point/box query throughput\n");
+	printf("  pacer                         Frame pacer schedule on a fake clock\n");
+	return 1;
+}
@@ -0,0 +1,788 @@
+#pragma once
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include "mesh.hpp"
+#include "threadpool.hpp"
+
+
+// Bounding volume hierarchy over the triangles of a Mesh, for ray casts,
+// closest-point and box queries in O(log n) instead of a loop over every
+// triangle. Built top-down with a binned surface area heuristic (SAH); the
+// two halves of every large node, and the binning of the largest nodes, run
+// on the thread pool. The finished tree is stored depth-first in one array
+// of 32-byte nodes, so a traversal that goes left walks forward through
+// memory, and the triangles are copied into leaf order next to it.
+
+const int BVH_BINS = 16;                   // SAH candidate planes per axis, minus one.
+const uint32_t BVH_LEAF_SIZE = 4;          // Nodes this small are never split.
+const uint32_t BVH_MAX_LEAF_SIZE = 16;     // Nodes larger than this are always split.
+const float BVH_TRAVERSAL_COST = 1.0f;     // Cost of visiting a node, relative to one triangle test.
+const uint32_t BVH_PARALLEL_SIZE = 1024;   // Nodes at least this big build their halves in parallel...
+const uint32_t BVH_PARALLEL_BINNING = 16384;  // ...and bin their triangles in parallel from this size.
+const int BVH_STACK_SIZE = 64;           // Traversal stack; deep enough for any tree the builder makes...
+const int BVH_MEDIAN_DEPTH = BVH_STACK_SIZE - 34;  // ...because from this depth nodes split at the median, which halves them.
+
+struct BvhNode
+{
+	float min[3];
+	uint32_t offset;  // Leaf: first triangle. Interior: index of the right child; the left child is the next node.
+	float max[3];
+	uint32_t count;   // Triangles in a leaf, 0 for an interior node.
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode should fill half a cache line");
+
+// A triangle in leaf order, set up for the ray test: one corner and the two edges from it.
+struct BvhTriangle
+{
+	float v0[3];
+	float e1[3];
+	float e2[3];
+};
+
+struct BvhRayHit
+{
+	float t;           // Distance along the ray direction (in units of its length).
+	float u, v;        // Barycentric coordinates of the hit.
+	uint32_t triangle; // Index of the triangle in the mesh.
+};
+
+struct BvhClosestPoint
+{
+	float point[3];
+	float distanceSquared;
+	uint32_t triangle;
+};
+
+struct BvhStats
+{
+	size_t nodes;
+	size_t leaves;
+	int depth;
+	float sahCost;  // Expected cost of a random ray, in triangle tests.
+};
+
+inline float bvh_dot(const float a[3], const float b[3])
+{
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+inline void bvh_cross(const float a[3], const float b[3], float out[3])
+{
+	out[0] = a[1] * b[2] - a[2] * b[1];
+	out[1] = a[2] * b[0] - a[0] * b[2];
+	out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+// Half the surface area of a box (the SAH only compares areas).
+inline float bvh_half_area(const float min[3], const float max[3])
+{
+	const float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+	return dx < 0.0f ? 0.0f : dx * dy + dy * dz + dz * dx;
+}
+
+/*
+	Möller-Trumbore ray/triangle test, two-sided. Returns true and fills t,
+	u and v for a hit with tMin < t < tMax.
+*/
+inline bool bvh_ray_triangle(const float origin[3], const float direction[3], const BvhTriangle& tri, float tMin, float tMax, float& t, float& u, float& v)
+{
+	float p[3], q[3], s[3];
+	bvh_cross(direction, tri.e2, p);
+	const float det = bvh_dot(tri.e1, p);
+	if (fabsf(det) < 1e-12f) return false;
+	const float inverse = 1.0f / det;
+
+	s[0] = origin[0] - tri.v0[0];
+	s[1] = origin[1] - tri.v0[1];
+	s[2] = origin[2] - tri.v0[2];
+	u = bvh_dot(s, p) * inverse;
+	if (u < 0.0f || u > 1.0f) return false;
+
+	bvh_cross(s, tri.e1, q);
+	v = bvh_dot(direction, q) * inverse;
+	if (v < 0.0f || u + v > 1.0f) return false;
+
+	t = bvh_dot(tri.e2, q) * inverse;
+	return t > tMin && t < tMax;
+}
+
+/*
+	Closest point to p on triangle abc, by the Voronoi region p falls in
+	(Ericson, Real-Time Collision Detection, 5.1.5).
+*/
+inline void bvh_closest_on_triangle(const float p[3], const float a[3], const float b[3], const float c[3], float out[3])
+{
+	const float ab[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+	const float ac[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+	const float ap[3] = { p[0] - a[0], p[1] - a[1], p[2] - a[2] };
+	int k;
+
+	const float d1 = bvh_dot(ab, ap), d2 = bvh_dot(ac, ap);
+	if (d1 <= 0.0f && d2 <= 0.0f) { for (k = 0; k < 3; k++) out[k] = a[k]; return; }
+
+	const float bp[3] = { p[0] - b[0], p[1] - b[1], p[2] - b[2] };
+	const float d3 = bvh_dot(ab, bp), d4 = bvh_dot(ac, bp);
+	if (d3 >= 0.0f && d4 <= d3) { for (k = 0; k < 3; k++) out[k] = b[k]; return; }
+
+	const float vc = d1 * d4 - d3 * d2;
+	if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+		const float v = d1 / (d1 - d3);
+		for (k = 0; k < 3; k++) out[k] = a[k] + v * ab[k];
+		return;
+	}
+
+	const float cp[3] = { p[0] - c[0], p[1] - c[1], p[2] - c[2] };
+	const float d5 = bvh_dot(ab, cp), d6 = bvh_dot(ac, cp);
+	if (d6 >= 0.0f && d5 <= d6) { for (k = 0; k < 3; k++) out[k] = c[k]; return; }
+
+	const float vb = d5 * d2 - d1 * d6;
+	if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+		const float w = d2 / (d2 - d6);
+		for (k = 0; k < 3; k++) out[k] = a[k] + w * ac[k];
+		return;
+	}
+
+	const float va = d3 * d6 - d5 * d4;
+	if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) {
+		const float w = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+		for (k = 0; k < 3; k++) out[k] = b[k] + w * (c[k] - b[k]);
+		return;
+	}
+
+	const float denominator = 1.0f / (va + vb + vc);
+	const float v = vb * denominator, w = vc * denominator;
+	for (k = 0; k < 3; k++) out[k] = a[k] + ab[k] * v + ac[k] * w;
+}
+
+/*
+	Separating axis test between triangle abc and the box with the given
+	centre and half extents (Akenine-Möller): the three box axes, the
+	triangle normal and the nine edge/axis cross products.
+*/
+inline bool bvh_triangle_box(const float a[3], const float b[3], const float c[3], const float centre[3], const float half[3])
+{
+	const float v[3][3] = {
+		{ a[0] - centre[0], a[1] - centre[1], a[2] - centre[2] },
+		{ b[0] - centre[0], b[1] - centre[1], b[2] - centre[2] },
+		{ c[0] - centre[0], c[1] - centre[1], c[2] - centre[2] }
+	};
+	const float edges[3][3] = {
+		{ v[1][0] - v[0][0], v[1][1] - v[0][1], v[1][2] - v[0][2] },
+		{ v[2][0] - v[1][0], v[2][1] - v[1][1], v[2][2] - v[1][2] },
+		{ v[0][0] - v[2][0], v[0][1] - v[2][1], v[0][2] - v[2][2] }
+	};
+
+	float axes[13][3];
+	int count = 0, i, j;
+	for (i = 0; i < 3; i++) {
+		axes[count][0] = axes[count][1] = axes[count][2] = 0.0f;
+		axes[count++][i] = 1.0f;
+	}
+	bvh_cross(edges[0], edges[1], axes[count++]);
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			const float unit[3] = { j == 0 ? 1.0f : 0.0f, j == 1 ? 1.0f : 0.0f, j == 2 ? 1.0f : 0.0f };
+			bvh_cross(edges[i], unit, axes[count++]);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		const float* axis = axes[i];
+		const float p0 = bvh_dot(v[0], axis), p1 = bvh_dot(v[1], axis), p2 = bvh_dot(v[2], axis);
+		const float r = half[0] * fabsf(axis[0]) + half[1] * fabsf(axis[1]) + half[2] * fabsf(axis[2]);
+		if ((std::min)((std::min)(p0, p1), p2) > r || (std::max)((std::max)(p0, p1), p2) < -r) return false;
+	}
+	return true;
+}
+
+class Bvh
+{
+public:
+	Bvh() {}
+
+	Bvh(const Bvh&) = delete;
+	Bvh& operator=(const Bvh&) = delete;
+	Bvh(Bvh&&) = default;
+	Bvh& operator=(Bvh&&) = default;
+
+	/*
+		Builds the hierarchy over every triangle of 'mesh'. With 'parallel'
+		false everything runs on the calling thread; the tree is the same
+		either way.
+	*/
+	void build(const Mesh& mesh, bool parallel = true)
+	{
+		const uint32_t triangles = (uint32_t)mesh.triangleCount();
+		m_nodes.clear();
+		m_triangles.clear();
+		m_triangleIds.clear();
+		if (triangles == 0) return;
+
+		// Per-triangle bounds and centroids, the only input the builder looks at.
+		BuildState state;
+		state.parallel = parallel;
+		state.bounds.resize(triangles * 6);
+		state.centroids.resize(triangles * 3);
+		state.order.resize(triangles);
+		uint32_t i;
+		int k;
+		for (i = 0; i < triangles; i++) {
+			const uint32_t* corners = &mesh.indices[3 * i];
+			const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+			for (k = 0; k < 3; k++) {
+				const float a = arrays[k][corners[0]], b = arrays[k][corners[1]], c = arrays[k][corners[2]];
+				state.bounds[6 * i + k] = (std::min)((std::min)(a, b), c);
+				state.bounds[6 * i + 3 + k] = (std::max)((std::max)(a, b), c);
+				state.centroids[3 * i + k] = 0.5f * (state.bounds[6 * i + k] + state.bounds[6 * i + 3 + k]);
+			}
+			state.order[i] = i;
+		}
+
+		// A binary tree over n leaves has at most 2n - 1 nodes; children are
+		// allocated in pairs from a shared counter.
+		state.nodes.resize(2 * (size_t)triangles);
+		state.nodeCount = 1;
+		buildNode(state, 0, 0, rangeBounds(state, 0, triangles), 0);
+
+		// Flatten depth-first and copy the triangles into leaf order.
+		m_nodes.resize(state.nodeCount);
+		m_triangles.reserve(triangles);
+		m_triangleIds.reserve(triangles);
+		uint32_t next = 0;
+		flatten(state, mesh, 0, next);
+	}
+
+	bool empty() const { return m_nodes.size() == 0; }
+	size_t nodeCount() const { return m_nodes.size(); }
+	size_t bytes() const { return m_nodes.size() * sizeof(BvhNode) + m_triangles.size() * sizeof(BvhTriangle) + m_triangleIds.size() * sizeof(uint32_t); }
+	const BvhNode* nodes() const { return m_nodes.data(); }
+
+	BvhStats stats() const
+	{
+		BvhStats stats;
+		stats.nodes = m_nodes.size();
+		stats.leaves = 0;
+		stats.depth = 0;
+		stats.sahCost = 0.0f;
+		if (empty()) return stats;
+
+		// Each node costs its test times the chance a ray through the root hits it.
+		const float rootArea = (std::max)(bvh_half_area(m_nodes[0].min, m_nodes[0].max), 1e-30f);
+		std::vector<std::pair<uint32_t, int> > stack(1, std::make_pair(0u, 1));
+		while (!stack.empty()) {
+			const uint32_t index = stack.back().first;
+			const int depth = stack.back().second;
+			stack.pop_back();
+			const BvhNode& node = m_nodes[index];
+			const float chance = bvh_half_area(node.min, node.max) / rootArea;
+			stats.depth = (std::max)(stats.depth, depth);
+			if (node.count > 0) {
+				stats.leaves++;
+				stats.sahCost += chance * node.count;
+			} else {
+				stats.sahCost += chance * BVH_TRAVERSAL_COST;
+				stack.push_back(std::make_pair(index + 1, depth + 1));
+				stack.push_back(std::make_pair(node.offset, depth + 1));
+			}
+		}
+		return stats;
+	}
+
+	/*
+		Nearest triangle hit by the ray origin + t * direction with
+		0 < t < tMax. The direction need not be unit length.
+	*/
+	bool intersectRay(const float origin[3], const float direction[3], float tMax, BvhRayHit& hit) const
+	{
+		if (empty()) return false;
+
+		float inverse[3];
+		int k;
+		for (k = 0; k < 3; k++) inverse[k] = direction[k] != 0.0f ? 1.0f / direction[k] : (direction[k] < 0.0f ? -FLT_MAX : FLT_MAX);
+
+		bool found = false;
+		float best = tMax;
+		uint32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		uint32_t index = 0;
+		if (rayBox(m_nodes[0], origin, inverse, best) == FLT_MAX) return false;
+
+		while (true) {
+			const BvhNode& node = m_nodes[index];
+			if (node.count > 0) {
+				uint32_t i;
+				for (i = node.offset; i < node.offset + node.count; i++) {
+					float t, u, v;
+					if (bvh_ray_triangle(origin, direction, m_triangles[i], 0.0f, best, t, u, v)) {
+						best = t;
+						hit.t = t;
+						hit.u = u;
+						hit.v = v;
+						hit.triangle = m_triangleIds[i];
+						found = true;
+					}
+				}
+			} else {
+				// Visit the nearer child first; push the other if the ray reaches it.
+				uint32_t near = index + 1, far = node.offset;
+				float tNear = rayBox(m_nodes[near], origin, inverse, best);
+				float tFar = rayBox(m_nodes[far], origin, inverse, best);
+				if (tFar < tNear) {
+					std::swap(near, far);
+					std::swap(tNear, tFar);
+				}
+				if (tNear != FLT_MAX) {
+					if (tFar != FLT_MAX) {
+						assert(top < BVH_STACK_SIZE);
+						stack[top++] = far;
+					}
+					index = near;
+					continue;
+				}
+			}
+			if (top == 0) break;
+			index = stack[--top];
+		}
+		return found;
+	}
+
+	/*
+		Point on the mesh closest to p, searching no further than
+		sqrt(maxDistanceSquared). Returns false if nothing is that close.
+	*/
+	bool closestPoint(const float p[3], float maxDistanceSquared, BvhClosestPoint& closest) const
+	{
+		if (empty()) return false;
+
+		bool found = false;
+		float best = maxDistanceSquared;
+		uint32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		uint32_t index = 0;
+		if (boxDistanceSquared(m_nodes[0], p) > best) return false;
+
+		while (true) {
+			const BvhNode& node = m_nodes[index];
+			if (node.count > 0) {
+				uint32_t i;
+				for (i = node.offset; i < node.offset + node.count; i++) {
+					const BvhTriangle& tri = m_triangles[i];
+					const float b[3] = { tri.v0[0] + tri.e1[0], tri.v0[1] + tri.e1[1], tri.v0[2] + tri.e1[2] };
+					const float c[3] = { tri.v0[0] + tri.e2[0], tri.v0[1] + tri.e2[1], tri.v0[2] + tri.e2[2] };
+					float q[3];
+					bvh_closest_on_triangle(p, tri.v0, b, c, q);
+					const float d[3] = { q[0] - p[0], q[1] - p[1], q[2] - p[2] };
+					const float distance = bvh_dot(d, d);
+					if (distance < best || (!found && distance <= best)) {
+						best = distance;
+						memcpy(closest.point, q, sizeof(q));
+						closest.distanceSquared = distance;
+						closest.triangle = m_triangleIds[i];
+						found = true;
+					}
+				}
+			} else {
+				uint32_t near = index + 1, far = node.offset;
+				float dNear = boxDistanceSquared(m_nodes[near], p);
+				float dFar = boxDistanceSquared(m_nodes[far], p);
+				if (dFar < dNear) {
+					std::swap(near, far);
+					std::swap(dNear, dFar);
+				}
+				if (dNear <= best) {
+					if (dFar <= best) {
+						assert(top < BVH_STACK_SIZE);
+						stack[top++] = far;
+					}
+					index = near;
+					continue;
+				}
+			}
+
+			// Skip stacked nodes that a closer point found since has ruled out.
+			while (top > 0 && boxDistanceSquared(m_nodes[stack[top - 1]], p) > best) top--;
+			if (top == 0) break;
+			index = stack[--top];
+		}
+		return found;
+	}
+
+	/*
+		Appends to 'triangles' every mesh triangle that overlaps the box
+		[min, max] (an exact triangle/box test, not just their bounds).
+		Returns the number appended.
+	*/
+	size_t overlapBox(const float min[3], const float max[3], std::vector<uint32_t>& triangles) const
+	{
+		if (empty()) return 0;
+
+		const float centre[3] = { 0.5f * (min[0] + max[0]), 0.5f * (min[1] + max[1]), 0.5f * (min[2] + max[2]) };
+		const float half[3] = { 0.5f * (max[0] - min[0]), 0.5f * (max[1] - min[1]), 0.5f * (max[2] - min[2]) };
+		const size_t before = triangles.size();
+		uint32_t stack[BVH_STACK_SIZE];
+		int top = 0;
+		stack[top++] = 0;
+		while (top > 0) {
+			const BvhNode& node = m_nodes[stack[--top]];
+			if (node.min[0] > max[0] || node.max[0] < min[0] || node.min[1] > max[1] || node.max[1] < min[1]
+				|| node.min[2] > max[2] || node.max[2] < min[2]) continue;
+
+			if (node.count == 0) {
+				assert(top + 2 <= BVH_STACK_SIZE);
+				stack[top++] = node.offset;
+				stack[top++] = (uint32_t)(&node - m_nodes.data()) + 1;
+				continue;
+			}
+			uint32_t i;
+			for (i = node.offset; i < node.offset + node.count; i++) {
+				const BvhTriangle& tri = m_triangles[i];
+				const float b[3] = { tri.v0[0] + tri.e1[0], tri.v0[1] + tri.e1[1], tri.v0[2] + tri.e1[2] };
+				const float c[3] = { tri.v0[0] + tri.e2[0], tri.v0[1] + tri.e2[1], tri.v0[2] + tri.e2[2] };
+				if (bvh_triangle_box(tri.v0, b, c, centre, half)) triangles.push_back(m_triangleIds[i]);
+			}
+		}
+		return triangles.size() - before;
+	}
+
+private:
+	// Build-time node: children are a pair allocated together.
+	struct BuildNode
+	{
+		float min[3], max[3];
+		uint32_t first, count;  // Triangle range in BuildState::order.
+		uint32_t children;      // Index of the left child (right is next); 0 for a leaf.
+	};
+
+	struct BuildState
+	{
+		bool parallel;
+		std::vector<float> bounds;     // min xyz, max xyz per triangle.
+		std::vector<float> centroids;  // Centre of each triangle's bounds.
+		std::vector<uint32_t> order;   // Triangle indices, partitioned as the tree is built.
+		std::vector<BuildNode> nodes;
+		std::atomic<uint32_t> nodeCount;
+	};
+
+	// Bounds of a set of triangles (the triangles whose centroids fall in
+	// one slab of an axis, or a whole node).
+	struct Bin
+	{
+		float bounds[6];  // min xyz, max xyz
+		uint32_t count;
+
+		void reset()
+		{
+			bounds[0] = bounds[1] = bounds[2] = FLT_MAX;
+			bounds[3] = bounds[4] = bounds[5] = -FLT_MAX;
+			count = 0;
+		}
+
+		void add(const float* box)
+		{
+			int k;
+			for (k = 0; k < 3; k++) {
+				bounds[k] = (std::min)(bounds[k], box[k]);
+				bounds[3 + k] = (std::max)(bounds[3 + k], box[3 + k]);
+			}
+			count++;
+		}
+
+		void merge(const Bin& other)
+		{
+			if (other.count == 0) return;
+			int k;
+			for (k = 0; k < 3; k++) {
+				bounds[k] = (std::min)(bounds[k], other.bounds[k]);
+				bounds[3 + k] = (std::max)(bounds[3 + k], other.bounds[3 + k]);
+			}
+			count += other.count;
+		}
+	};
+
+	// A node's triangle bounds and the bounds of their centroids, which set up its bins.
+	struct Range
+	{
+		Bin triangles;
+		float centroidBounds[6];
+	};
+
+	// Slab of 'axis' a centroid falls in, for a node whose centroids start at
+	// 'origin' and span BVH_BINS / scale.
+	static int binIndex(float centroid, float origin, float scale)
+	{
+		return (std::min)((int)((centroid - origin) * scale), BVH_BINS - 1);
+	}
+
+	// Bins triangles [first, first + count) of the order along all three axes.
+	static void binRange(const BuildState& state, uint32_t first, uint32_t count, const float origin[3], const float scale[3], Bin bins[3][BVH_BINS])
+	{
+		int axis, b;
+		for (axis = 0; axis < 3; axis++)
+			for (b = 0; b < BVH_BINS; b++) bins[axis][b].reset();
+
+		uint32_t i;
+		for (i = first; i < first + count; i++) {
+			const uint32_t t = state.order[i];
+			const float* box = &state.bounds[6 * t];
+			const float* centroid = &state.centroids[3 * t];
+			for (axis = 0; axis < 3; axis++) {
+				if (scale[axis] == 0.0f) continue;
+				bins[axis][binIndex(centroid[axis], origin[axis], scale[axis])].add(box);
+			}
+		}
+	}
+
+	// binRange(), in chunks on the thread pool for the largest nodes.
+	static void binTriangles(const BuildState& state, uint32_t first, uint32_t count, const float origin[3], const float scale[3], Bin bins[3][BVH_BINS])
+	{
+		if (!state.parallel || count < BVH_PARALLEL_BINNING || thread_pool().size() < 2) {
+			binRange(state, first, count, origin, scale, bins);
+			return;
+		}
+
+		struct Partial { Bin bins[3][BVH_BINS]; };
+		const uint32_t chunks = thread_pool().size() * 2;
+		std::vector<Partial> partials(chunks);
+		thread_pool().run(chunks, [&](size_t c) {
+			const uint32_t begin = first + (uint32_t)((uint64_t)count * c / chunks);
+			const uint32_t end = first + (uint32_t)((uint64_t)count * (c + 1) / chunks);
+			binRange(state, begin, end - begin, origin, scale, partials[c].bins);
+		});
+
+		size_t c;
+		int axis, b;
+		for (axis = 0; axis < 3; axis++) {
+			for (b = 0; b < BVH_BINS; b++) {
+				bins[axis][b] = partials[0].bins[axis][b];
+				for (c = 1; c < chunks; c++) bins[axis][b].merge(partials[c].bins[axis][b]);
+			}
+		}
+	}
+
+	static void gatherCentroids(const BuildState& state, uint32_t first, uint32_t count, float bounds[6])
+	{
+		bounds[0] = bounds[1] = bounds[2] = FLT_MAX;
+		bounds[3] = bounds[4] = bounds[5] = -FLT_MAX;
+		uint32_t i;
+		int k;
+		for (i = first; i < first + count; i++) {
+			const float* centroid = &state.centroids[3 * state.order[i]];
+			for (k = 0; k < 3; k++) {
+				bounds[k] = (std::min)(bounds[k], centroid[k]);
+				bounds[3 + k] = (std::max)(bounds[3 + k], centroid[k]);
+			}
+		}
+	}
+
+	// Bounds of triangles [first, first + count), for the root and for
+	// ranges split without binning.
+	static Range rangeBounds(const BuildState& state, uint32_t first, uint32_t count)
+	{
+		Range range;
+		range.triangles.reset();
+		uint32_t i;
+		for (i = first; i < first + count; i++) range.triangles.add(&state.bounds[6 * state.order[i]]);
+		gatherCentroids(state, first, count, range.centroidBounds);
+		return range;
+	}
+
+	/*
+		Builds node 'index' over triangles [first, first + range.count) of the
+		order, whose bounds 'range' holds, at 'depth' below the root. The bins
+		give both children their triangle bounds, so only their centroid
+		bounds take another pass. From BVH_MEDIAN_DEPTH on, nodes split at
+		the median centroid instead, so no leaf is deeper than 32 more levels
+		and every traversal fits in BVH_STACK_SIZE.
+	*/
+	static void buildNode(BuildState& state, uint32_t index, uint32_t first, const Range& range, int depth)
+	{
+		const uint32_t count = range.triangles.count;
+		BuildNode& node = state.nodes[index];
+		memcpy(node.min, range.triangles.bounds, sizeof(node.min));
+		memcpy(node.max, range.triangles.bounds + 3, sizeof(node.max));
+		node.first = first;
+		node.count = count;
+		node.children = 0;
+		if (count <= BVH_LEAF_SIZE) return;
+		if (depth >= BVH_MEDIAN_DEPTH) {
+			if (count <= BVH_MAX_LEAF_SIZE) return;
+			splitMedian(state, node, first, range, depth);
+			return;
+		}
+
+		float origin[3], scale[3];
+		int axis, b;
+		for (axis = 0; axis < 3; axis++) {
+			const float extent = range.centroidBounds[3 + axis] - range.centroidBounds[axis];
+			origin[axis] = range.centroidBounds[axis];
+			scale[axis] = extent > 0.0f ? BVH_BINS / extent : 0.0f;
+		}
+		Bin bins[3][BVH_BINS];
+		binTriangles(state, first, count, origin, scale, bins);
+
+		// Sweep the bins from both sides; the split after bin b has bins
+		// [0, b] on its left and (b, BVH_BINS) on its right.
+		const float nodeArea = (std::max)(bvh_half_area(node.min, node.max), 1e-30f);
+		float bestCost = FLT_MAX;
+		int bestAxis = -1, bestSplit = 0;
+		for (axis = 0; axis < 3; axis++) {
+			if (scale[axis] == 0.0f) continue;
+			float rightCost[BVH_BINS];
+			Bin sweep;
+			sweep.reset();
+			for (b = BVH_BINS - 1; b > 0; b--) {
+				sweep.merge(bins[axis][b]);
+				rightCost[b] = sweep.count > 0 ? bvh_half_area(sweep.bounds, sweep.bounds + 3) * sweep.count : 0.0f;
+			}
+			sweep.reset();
+			for (b = 0; b < BVH_BINS - 1; b++) {
+				sweep.merge(bins[axis][b]);
+				const float leftCost = sweep.count > 0 ? bvh_half_area(sweep.bounds, sweep.bounds + 3) * sweep.count : 0.0f;
+				const float cost = BVH_TRAVERSAL_COST + (leftCost + rightCost[b + 1]) / nodeArea;
+				if (sweep.count > 0 && sweep.count < count && cost < bestCost) {
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		// Keep small nodes as leaves when splitting would not pay off.
+		if ((bestAxis < 0 || bestCost >= (float)count) && count <= BVH_MAX_LEAF_SIZE) return;
+
+		uint32_t middle;
+		Range left, right;
+		if (bestAxis < 0) {
+			// Every centroid in one place: split the range in half.
+			middle = first + count / 2;
+			left = rangeBounds(state, first, middle - first);
+			right = rangeBounds(state, middle, first + count - middle);
+		} else {
+			const float splitOrigin = origin[bestAxis], splitScale = scale[bestAxis];
+			const std::vector<float>& centroids = state.centroids;
+			uint32_t* begin = &state.order[first];
+			middle = first + (uint32_t)(std::partition(begin, begin + count, [&](uint32_t t) {
+				return binIndex(centroids[3 * t + bestAxis], splitOrigin, splitScale) <= bestSplit;
+			}) - begin);
+			left.triangles.reset();
+			right.triangles.reset();
+			for (b = 0; b < BVH_BINS; b++) (b <= bestSplit ? left.triangles : right.triangles).merge(bins[bestAxis][b]);
+			gatherCentroids(state, first, middle - first, left.centroidBounds);
+			gatherCentroids(state, middle, first + count - middle, right.centroidBounds);
+		}
+
+		buildChildren(state, node, first, middle, left, right, depth);
+	}
+
+	// Splits a node at the median centroid along its widest centroid axis,
+	// so each child gets half the triangles whatever their layout.
+	static void splitMedian(BuildState& state, BuildNode& node, uint32_t first, const Range& range, int depth)
+	{
+		const uint32_t count = range.triangles.count;
+		int axis = 0, k;
+		for (k = 1; k < 3; k++) {
+			if (range.centroidBounds[3 + k] - range.centroidBounds[k] > range.centroidBounds[3 + axis] - range.centroidBounds[axis]) axis = k;
+		}
+		const std::vector<float>& centroids = state.centroids;
+		uint32_t* begin = &state.order[first];
+		const uint32_t middle = first + count / 2;
+		std::nth_element(begin, &state.order[middle], begin + count, [&](uint32_t a, uint32_t b) {
+			return centroids[3 * a + axis] < centroids[3 * b + axis];
+		});
+		const Range left = rangeBounds(state, first, middle - first);
+		const Range right = rangeBounds(state, middle, first + count - middle);
+		buildChildren(state, node, first, middle, left, right, depth);
+	}
+
+	// Allocates the pair of children of 'node' and builds them over
+	// [first, middle) and [middle, ...), in parallel when the node is big.
+	static void buildChildren(BuildState& state, BuildNode& node, uint32_t first, uint32_t middle, const Range& left, const Range& right, int depth)
+	{
+		const uint32_t children = state.nodeCount.fetch_add(2);
+		node.children = children;
+		if (state.parallel && node.count >= BVH_PARALLEL_SIZE && thread_pool().size() > 1) {
+			thread_pool().run(2, [&](size_t c) {
+				if (c == 0) buildNode(state, children, first, left, depth + 1);
+				else buildNode(state, children + 1, middle, right, depth + 1);
+			});
+		} else {
+			buildNode(state, children, first, left, depth + 1);
+			buildNode(state, children + 1, middle, right, depth + 1);
+		}
+	}
+
+	// Writes build node 'index' and its subtree depth-first from m_nodes[next].
+	void flatten(const BuildState& state, const Mesh& mesh, uint32_t index, uint32_t& next)
+	{
+		const BuildNode& source = state.nodes[index];
+		const uint32_t at = next++;
+		BvhNode& node = m_nodes[at];
+		memcpy(node.min, source.min, sizeof(node.min));
+		memcpy(node.max, source.max, sizeof(node.max));
+
+		if (source.children == 0) {
+			node.offset = (uint32_t)m_triangles.size();
+			node.count = source.count;
+			uint32_t i;
+			for (i = source.first; i < source.first + source.count; i++) {
+				const uint32_t t = state.order[i];
+				const uint32_t* corners = &mesh.indices[3 * t];
+				BvhTriangle tri;
+				int k;
+				const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+				for (k = 0; k < 3; k++) {
+					tri.v0[k] = arrays[k][corners[0]];
+					tri.e1[k] = arrays[k][corners[1]] - tri.v0[k];
+					tri.e2[k] = arrays[k][corners[2]] - tri.v0[k];
+				}
+				m_triangles.push_back(tri);
+				m_triangleIds.push_back(t);
+			}
+			return;
+		}
+
+		node.count = 0;
+		flatten(state, mesh, source.children, next);
+		m_nodes[at].offset = next;
+		flatten(state, mesh, source.children + 1, next);
+	}
+
+	// Entry distance of the ray into the node's box, FLT_MAX if it misses
+	// or enters beyond tMax.
+	static float rayBox(const BvhNode& node, const float origin[3], const float inverse[3], float tMax)
+	{
+		float tNear = 0.0f, tFar = tMax;
+		int k;
+		for (k = 0; k < 3; k++) {
+			float t0 = (node.min[k] - origin[k]) * inverse[k];
+			float t1 = (node.max[k] - origin[k]) * inverse[k];
+			if (t0 > t1) std::swap(t0, t1);
+			tNear = (std::max)(tNear, t0);
+			tFar = (std::min)(tFar, t1);
+		}
+		return tNear <= tFar ? tNear : FLT_MAX;
+	}
+
+	static float boxDistanceSquared(const BvhNode& node, const float p[3])
+	{
+		float sum = 0.0f;
+		int k;
+		for (k = 0; k < 3; k++) {
+			const float d = (std::max)((std::max)(node.min[k] - p[k], 0.0f), p[k] - node.max[k]);
+			sum += d * d;
+		}
+		return sum;
+	}
+
+	AlignedArray<BvhNode> m_nodes;
+	std::vector<BvhTriangle> m_triangles;
+	std::vector<uint32_t> m_triangleIds;  // Mesh triangle of each entry of m_triangles.
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <math.h>
+
+
+// The view the keyboard and mouse steer: a gluLookAt eye and centre with
+// +y up, and the rotation of the model about the x, y and z axes in
+// degrees. All float, so steps can be finer than a whole unit.
+
+struct CameraState
+{
+	float eye[3];
+	float center[3];
+	float rotation[3];
+};
+
+inline CameraState camera_default()
+{
+	const CameraState camera = { { 5.0f, 5.0f, 10.0f }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } };
+	return camera;
+}
+
+// Moves the eye and the centre together, so the view direction stays the same.
+inline void camera_translate(CameraState& camera, float x, float y, float z)
+{
+	camera.eye[0] += x; camera.eye[1] += y; camera.eye[2] += z;
+	camera.center[0] += x; camera.center[1] += y; camera.center[2] += z;
+}
+
+// Moves only the eye, turning the view towards the fixed centre.
+inline void camera_move_eye(CameraState& camera, float x, float y, float z)
+{
+	camera.eye[0] += x; camera.eye[1] += y; camera.eye[2] += z;
+}
+
+// Turns the model about 'axis' (0-2), kept in [0, 360).
+inline void camera_rotate_model(CameraState& camera, int axis, float degrees)
+{
+	float angle = fmodf(camera.rotation[axis] + degrees, 360.0f);
+	if (angle < 0.0f) angle += 360.0f;
+	camera.rotation[axis] = angle;
+}
+
+/*
+	Pans the centre by a mouse drag of (dx, dy) window pixels (y down), at
+	'unitsPerPixel', keeping its x and y within +-limit.
+*/
+inline void camera_drag(CameraState& camera, float dx, float dy, float unitsPerPixel, float limit)
+{
+	float x = camera.center[0] + dx * unitsPerPixel;
+	float y = camera.center[1] - dy * unitsPerPixel;
+	camera.center[0] = x < -limit ? -limit : (x > limit ? limit : x);
+	camera.center[1] = y < -limit ? -limit : (y > limit ? limit : y);
+}
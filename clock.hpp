@@ -0,0 +1,11 @@
+#pragma once
+
+#include <chrono>
+
+
+// Seconds on the steady clock, for timing and for timestamps compared
+// within one run; the epoch is arbitrary.
+inline double clock_seconds()
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
@@ -0,0 +1,305 @@
+#pragma once
+
+#include <float.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "mesh.hpp"
+#include "transform.hpp"
+#include "vcache.hpp"
+
+
+// Triangle clusters for culling on the CPU. cluster_mesh() groups the
+// triangles by the axis their normal points along most and sorts each group
+// along a Morton curve, so that every run of CLUSTER_TRIANGLES consecutive
+// triangles covers a small patch of the surface facing one way, then orders
+// each run for the vertex cache. The clusters are implied by that order
+// (cluster k is triangles [k * CLUSTER_TRIANGLES, ...)), so a cached index
+// buffer keeps them. Each cluster gets a bounding sphere and a cone
+// bounding its face normals; every frame, clusters outside the view
+// frustum or facing entirely away from the eye are dropped and the
+// survivors are merged into as few index ranges as possible.
+
+const uint32_t CLUSTER_TRIANGLES = 64;
+
+struct MeshCluster
+{
+	float center[3];    // Bounding sphere.
+	float radius;
+	float coneAxis[3];  // Average face normal (unit length).
+	float coneCutoff;   // Sine of the widest normal's angle from the axis; 1 when the cone is too wide to cull.
+	uint32_t firstTriangle;
+	uint32_t triangleCount;
+};
+
+// A run of consecutive triangles to draw.
+struct MeshDrawRange
+{
+	uint32_t firstTriangle;
+	uint32_t triangleCount;
+};
+
+struct ClusterCullStats
+{
+	size_t clusters;
+	size_t frustumCulled;
+	size_t backfaceCulled;
+	size_t triangles;       // In all clusters.
+	size_t drawnTriangles;
+	size_t ranges;          // Draw calls after merging neighbouring clusters.
+	double milliseconds;    // Time spent culling.
+};
+
+// Spreads the low 10 bits of v out to every third bit.
+inline uint32_t morton_spread(uint32_t v)
+{
+	v &= 0x3FF;
+	v = (v | (v << 16)) & 0x030000FF;
+	v = (v | (v << 8)) & 0x0300F00F;
+	v = (v | (v << 4)) & 0x030C30C3;
+	v = (v | (v << 2)) & 0x09249249;
+	return v;
+}
+
+/*
+	Reorders the triangles of 'mesh' into spatially compact clusters of
+	CLUSTER_TRIANGLES (the last one may be smaller), each optimised for the
+	vertex cache and then for overdraw, and renumbers the vertices in fetch
+	order. Each run is optimised over its own vertices, numbered from 0, so
+	the passes cost time and memory in the size of the run, not the mesh.
+*/
+inline void cluster_mesh(Mesh& mesh)
+{
+	const size_t triangles = mesh.triangleCount();
+	if (triangles == 0) return;
+
+	float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+	const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+	size_t i;
+	int k;
+	for (i = 0; i < mesh.vertexCount(); i++) {
+		for (k = 0; k < 3; k++) {
+			minimum[k] = (std::min)(minimum[k], arrays[k][i]);
+			maximum[k] = (std::max)(maximum[k], arrays[k][i]);
+		}
+	}
+
+	// Sort key: the normal's dominant direction (one of six) above the Morton
+	// code of the centroid on a 1024^3 grid over the mesh bounds. Keeping the
+	// directions apart bounds each cluster's normal cone, so whole clusters
+	// can face away from the eye.
+	std::vector<std::pair<uint64_t, uint32_t> > keys(triangles);
+	for (i = 0; i < triangles; i++) {
+		const uint32_t* corners = &mesh.indices[3 * i];
+		float e1[3], e2[3];
+		uint32_t code = 0;
+		for (k = 0; k < 3; k++) {
+			const float extent = maximum[k] - minimum[k];
+			const float centroid = (arrays[k][corners[0]] + arrays[k][corners[1]] + arrays[k][corners[2]]) / 3.0f;
+			const float cell = extent > 0.0f ? (centroid - minimum[k]) / extent * 1023.0f : 0.0f;
+			code |= morton_spread((uint32_t)(std::min)((std::max)(cell, 0.0f), 1023.0f)) << k;
+			e1[k] = arrays[k][corners[1]] - arrays[k][corners[0]];
+			e2[k] = arrays[k][corners[2]] - arrays[k][corners[0]];
+		}
+		const float normal[3] = { e1[1] * e2[2] - e1[2] * e2[1], e1[2] * e2[0] - e1[0] * e2[2], e1[0] * e2[1] - e1[1] * e2[0] };
+		int axis = 0;
+		for (k = 1; k < 3; k++) {
+			if (fabsf(normal[k]) > fabsf(normal[axis])) axis = k;
+		}
+		const uint64_t direction = 2 * axis + (normal[axis] < 0.0f ? 1 : 0);
+		keys[i] = std::make_pair((direction << 30) | code, (uint32_t)i);
+	}
+	std::sort(keys.begin(), keys.end());
+
+	AlignedArray<uint32_t> sorted(mesh.indices.size());
+	for (i = 0; i < triangles; i++) {
+		for (k = 0; k < 3; k++) sorted[3 * i + k] = mesh.indices[3 * keys[i].second + k];
+	}
+	mesh.indices = std::move(sorted);
+
+	// 'local' maps a mesh vertex to its number in the current run and is
+	// reset after each run through 'global', the inverse map.
+	const uint32_t unused = 0xFFFFFFFFu;
+	std::vector<uint32_t> local(mesh.vertexCount(), unused), global, runIndices(3 * CLUSTER_TRIANGLES);
+	global.reserve(3 * CLUSTER_TRIANGLES);
+	Float3Array runPositions;
+	for (i = 0; i < triangles; i += CLUSTER_TRIANGLES) {
+		const size_t count = (std::min)((size_t)CLUSTER_TRIANGLES, triangles - i);
+		uint32_t* run = &mesh.indices[3 * i];
+		size_t j;
+		global.clear();
+		for (j = 0; j < 3 * count; j++) {
+			uint32_t& number = local[run[j]];
+			if (number == unused) {
+				number = (uint32_t)global.size();
+				global.push_back(run[j]);
+			}
+			runIndices[j] = number;
+		}
+		runPositions.resize(global.size());
+		for (j = 0; j < global.size(); j++) {
+			runPositions.x[j] = mesh.positions.x[global[j]];
+			runPositions.y[j] = mesh.positions.y[global[j]];
+			runPositions.z[j] = mesh.positions.z[global[j]];
+		}
+
+		optimise_vertex_cache(runIndices.data(), count, global.size());
+		optimise_overdraw(runIndices.data(), count, runPositions);
+
+		for (j = 0; j < 3 * count; j++) run[j] = global[runIndices[j]];
+		for (j = 0; j < global.size(); j++) local[global[j]] = unused;
+	}
+	optimise_vertex_fetch(mesh);
+}
+
+/*
+	Bounding spheres and normal cones of the clusters cluster_mesh() left in
+	the triangle order of 'mesh'.
+*/
+inline void compute_mesh_clusters(const Mesh& mesh, const Float3Array& faceNormals, std::vector<MeshCluster>& clusters)
+{
+	const size_t triangles = mesh.triangleCount();
+	clusters.resize((triangles + CLUSTER_TRIANGLES - 1) / CLUSTER_TRIANGLES);
+
+	const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+	const float* normals[3] = { faceNormals.x.data(), faceNormals.y.data(), faceNormals.z.data() };
+	size_t c;
+	for (c = 0; c < clusters.size(); c++) {
+		MeshCluster& cluster = clusters[c];
+		cluster.firstTriangle = (uint32_t)(c * CLUSTER_TRIANGLES);
+		cluster.triangleCount = (uint32_t)(std::min)((size_t)CLUSTER_TRIANGLES, triangles - cluster.firstTriangle);
+		const uint32_t* indices = &mesh.indices[3 * cluster.firstTriangle];
+		const size_t corners = 3 * (size_t)cluster.triangleCount;
+
+		// Sphere around the centre of the cluster's box.
+		float minimum[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, maximum[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+		float axis[3] = { 0.0f, 0.0f, 0.0f };
+		size_t i;
+		int k;
+		for (i = 0; i < corners; i++) {
+			for (k = 0; k < 3; k++) {
+				minimum[k] = (std::min)(minimum[k], arrays[k][indices[i]]);
+				maximum[k] = (std::max)(maximum[k], arrays[k][indices[i]]);
+			}
+		}
+		float radiusSquared = 0.0f;
+		for (k = 0; k < 3; k++) cluster.center[k] = 0.5f * (minimum[k] + maximum[k]);
+		for (i = 0; i < corners; i++) {
+			float d2 = 0.0f;
+			for (k = 0; k < 3; k++) {
+				const float d = arrays[k][indices[i]] - cluster.center[k];
+				d2 += d * d;
+			}
+			radiusSquared = (std::max)(radiusSquared, d2);
+		}
+		cluster.radius = sqrtf(radiusSquared);
+
+		// Cone: the average normal, opened up to the normal furthest from it.
+		for (i = 0; i < cluster.triangleCount; i++) {
+			for (k = 0; k < 3; k++) axis[k] += normals[k][cluster.firstTriangle + i];
+		}
+		const float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		float minimumDot = length > 0.0f ? 1.0f : -1.0f;
+		for (k = 0; k < 3; k++) cluster.coneAxis[k] = length > 0.0f ? axis[k] / length : 0.0f;
+		for (i = 0; i < cluster.triangleCount && minimumDot > 0.0f; i++) {
+			const float n[3] = { normals[0][cluster.firstTriangle + i], normals[1][cluster.firstTriangle + i], normals[2][cluster.firstTriangle + i] };
+			if (n[0] == 0.0f && n[1] == 0.0f && n[2] == 0.0f) continue;  // Degenerate triangle: never visible.
+			minimumDot = (std::min)(minimumDot, n[0] * cluster.coneAxis[0] + n[1] * cluster.coneAxis[1] + n[2] * cluster.coneAxis[2]);
+		}
+		cluster.coneCutoff = minimumDot > 0.0f ? sqrtf((std::max)(1.0f - minimumDot * minimumDot, 0.0f)) : 1.0f;
+	}
+}
+
+// View frustum in the space 'clip' maps from, as six planes (a, b, c, d) with
+// a*x + b*y + c*z + d >= 0 inside and (a, b, c) of unit length.
+struct Frustum
+{
+	float planes[6][4];
+};
+
+/*
+	Extracts the frustum planes of a projection * modelview matrix (Gribb and
+	Hartmann), so the planes are in the space the modelview maps from.
+*/
+inline Frustum frustum_from_matrix(const Mat4& clip)
+{
+	Frustum frustum;
+	const float* m = clip.m;
+	int p, k;
+	for (p = 0; p < 6; p++) {
+		const int row = p / 2;
+		const float sign = p % 2 == 0 ? 1.0f : -1.0f;
+		for (k = 0; k < 4; k++) frustum.planes[p][k] = m[k * 4 + 3] + sign * m[k * 4 + row];
+		const float length = sqrtf(frustum.planes[p][0] * frustum.planes[p][0] + frustum.planes[p][1] * frustum.planes[p][1] + frustum.planes[p][2] * frustum.planes[p][2]);
+		if (length > 0.0f) {
+			for (k = 0; k < 4; k++) frustum.planes[p][k] /= length;
+		}
+	}
+	return frustum;
+}
+
+inline bool frustum_contains_sphere(const Frustum& frustum, const float center[3], float radius)
+{
+	int p;
+	for (p = 0; p < 6; p++) {
+		const float* plane = frustum.planes[p];
+		if (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3] < -radius) return false;
+	}
+	return true;
+}
+
+/*
+	True if every triangle of the cluster faces away from 'eye' (conservative:
+	tested against the whole bounding sphere, as in meshoptimizer).
+*/
+inline bool cluster_backfacing(const MeshCluster& cluster, const float eye[3])
+{
+	const float d[3] = { cluster.center[0] - eye[0], cluster.center[1] - eye[1], cluster.center[2] - eye[2] };
+	const float distance = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	return d[0] * cluster.coneAxis[0] + d[1] * cluster.coneAxis[1] + d[2] * cluster.coneAxis[2] >= cluster.coneCutoff * distance + cluster.radius;
+}
+
+/*
+	Culls 'clusters' against the view of a projection and modelview matrix
+	and writes the triangle ranges left to draw, with neighbouring clusters
+	merged into one range.
+*/
+inline ClusterCullStats cull_mesh_clusters(const std::vector<MeshCluster>& clusters, const Mat4& projection, const Mat4& modelview, std::vector<MeshDrawRange>& ranges)
+{
+	ClusterCullStats stats = {};
+	ranges.clear();
+	stats.clusters = clusters.size();
+
+	// The eye in mesh space, from the inverse modelview.
+	const Frustum frustum = frustum_from_matrix(mat4_multiply(projection, modelview));
+	Mat4 inverse;
+	float eye[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const bool backfaces = mat4_inverse(modelview, inverse);
+	if (backfaces) mat4_transform(inverse, 0.0f, 0.0f, 0.0f, 1.0f, eye);
+
+	size_t c;
+	for (c = 0; c < clusters.size(); c++) {
+		const MeshCluster& cluster = clusters[c];
+		stats.triangles += cluster.triangleCount;
+		if (!frustum_contains_sphere(frustum, cluster.center, cluster.radius)) {
+			stats.frustumCulled++;
+			continue;
+		}
+		if (backfaces && cluster_backfacing(cluster, eye)) {
+			stats.backfaceCulled++;
+			continue;
+		}
+		stats.drawnTriangles += cluster.triangleCount;
+		if (!ranges.empty() && ranges.back().firstTriangle + ranges.back().triangleCount == cluster.firstTriangle) {
+			ranges.back().triangleCount += cluster.triangleCount;
+		} else {
+			MeshDrawRange range = { cluster.firstTriangle, cluster.triangleCount };
+			ranges.push_back(range);
+		}
+	}
+	stats.ranges = ranges.size();
+	return stats;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "mesh.hpp"
+
+
+// Unique undirected edges of a triangle mesh, with the edge statistics we
+// use for mesh QA.
+struct EdgeList
+{
+	std::vector<uint32_t> indices;      // Two vertex indices per unique edge, ready for GL_LINES.
+	std::vector<uint32_t> faceCounts;   // Number of triangles using each edge.
+	size_t boundaryEdges;               // Edges used by one triangle (holes, open borders).
+	size_t nonManifoldEdges;            // Edges used by three or more triangles.
+	size_t degenerateEdges;             // Triangle sides joining a vertex to itself (skipped).
+
+	EdgeList() : boundaryEdges(0), nonManifoldEdges(0), degenerateEdges(0) {}
+
+	size_t edgeCount() const { return faceCounts.size(); }
+};
+
+// Buckets up to this size are insertion sorted; larger ones use std::sort.
+const size_t EDGE_INSERTION_SORT_MAX = 16;
+
+/*
+	Builds the edge list: triangle sides are bucketed by their lower vertex
+	index (a counting sort), and each bucket is then sorted by the upper index
+	so that duplicates are adjacent. Linear in the triangle count when the
+	buckets are small; a hub vertex with k sides (the centre of a fan
+	triangulated polygon) costs O(k log k).
+*/
+inline void build_edge_list(const Mesh& mesh, EdgeList& edges)
+{
+	const size_t vertexCount = mesh.vertexCount();
+	const size_t triangles = mesh.triangleCount();
+	const uint32_t* indices = mesh.indices.data();
+
+	edges = EdgeList();
+
+	// Bucket offsets: how many sides start at each lower vertex.
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	size_t t;
+	int c;
+	for (t = 0; t < triangles; t++) {
+		for (c = 0; c < 3; c++) {
+			uint32_t a = indices[3 * t + c], b = indices[3 * t + (c + 1) % 3];
+			if (a == b) { edges.degenerateEdges++; continue; }
+			offsets[(a < b ? a : b) + 1]++;
+		}
+	}
+	size_t v;
+	for (v = 0; v < vertexCount; v++) offsets[v + 1] += offsets[v];
+
+	// Upper vertex of every side, grouped by lower vertex.
+	std::vector<uint32_t> upper(offsets[vertexCount]);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (t = 0; t < triangles; t++) {
+		for (c = 0; c < 3; c++) {
+			uint32_t a = indices[3 * t + c], b = indices[3 * t + (c + 1) % 3];
+			if (a == b) continue;
+			if (a < b) upper[fill[a]++] = b;
+			else upper[fill[b]++] = a;
+		}
+	}
+
+	edges.indices.reserve(upper.size());
+	edges.faceCounts.reserve(upper.size() / 2);
+	for (v = 0; v < vertexCount; v++) {
+		uint32_t* begin = upper.data() + offsets[v];
+		uint32_t* end = upper.data() + offsets[v + 1];
+
+		// A bucket holds the sides whose lower vertex is v, which on a closed
+		// mesh is about half the vertex's valence; insertion sort wins there.
+		uint32_t* i;
+		if ((size_t)(end - begin) > EDGE_INSERTION_SORT_MAX) {
+			std::sort(begin, end);
+		} else {
+			for (i = begin + 1; i < end; i++) {
+				uint32_t key = *i;
+				uint32_t* j = i;
+				while (j > begin && j[-1] > key) { *j = j[-1]; j--; }
+				*j = key;
+			}
+		}
+
+		for (i = begin; i < end; ) {
+			uint32_t* run = i;
+			while (run < end && *run == *i) run++;
+			uint32_t count = (uint32_t)(run - i);
+
+			edges.indices.push_back((uint32_t)v);
+			edges.indices.push_back(*i);
+			edges.faceCounts.push_back(count);
+			if (count == 1) edges.boundaryEdges++;
+			else if (count > 2) edges.nonManifoldEdges++;
+			i = run;
+		}
+	}
+}
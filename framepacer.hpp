@@ -0,0 +1,102 @@
+#pragma once
+
+#include <functional>
+#include "clock.hpp"
+
+
+// Decides when the window redraws. By default a frame is drawn only after
+// something marked the view dirty, so an unchanged view costs no CPU. A
+// fixed rate instead draws at most (and, when 'continuous', exactly) that
+// many frames per second, leaving the caller to sleep until the next one is
+// due. No GL or GLUT here: the clock is a parameter, so the scheduling can
+// be driven by a fake clock.
+
+class FramePacer
+{
+public:
+	typedef std::function<double()> Clock;  // Seconds, never going backwards.
+
+	/*
+		'smoothing' is the weight of the newest frame in the moving averages
+		of the frame interval and draw time (1 keeps only the last frame).
+	*/
+	explicit FramePacer(const Clock& clock = clock_seconds, double smoothing = 0.1)
+		: m_clock(clock), m_smoothing(smoothing), m_period(0.0), m_continuous(false), m_dirty(true),
+		m_nextFrame(0.0), m_frameStart(0.0), m_lastFrame(-1.0), m_interval(0.0), m_drawTime(0.0), m_frames(0) {}
+
+	/*
+		0 draws dirty frames as soon as asked. Otherwise frames are at least
+		1 / framesPerSecond apart, and with 'continuous' one is due every
+		period whether or not anything changed.
+	*/
+	void setRate(double framesPerSecond, bool continuous)
+	{
+		m_period = framesPerSecond > 0.0 ? 1.0 / framesPerSecond : 0.0;
+		m_continuous = continuous && m_period > 0.0;
+		m_nextFrame = m_clock();
+	}
+
+	double rate() const { return m_period > 0.0 ? 1.0 / m_period : 0.0; }
+	bool continuous() const { return m_continuous; }
+
+	void markDirty() { m_dirty = true; }
+	bool dirty() const { return m_dirty; }
+
+	bool frameDue() const { return secondsUntilDue() == 0.0; }
+
+	// 0 if a frame is due now, the wait if one will be, -1 if none will be until marked dirty.
+	double secondsUntilDue() const
+	{
+		if (!m_dirty && !m_continuous) return -1.0;
+		if (m_period == 0.0) return 0.0;
+		const double wait = m_nextFrame - m_clock();
+		return wait > 0.0 ? wait : 0.0;
+	}
+
+	void beginFrame()
+	{
+		m_frameStart = m_clock();
+		m_dirty = false;
+	}
+
+	/*
+		Updates the averages and schedules the next fixed-rate frame one
+		period after this one was due, so the rate holds on average. A frame
+		more than a period late restarts the schedule from when it began
+		rather than causing a burst of catch-up frames.
+	*/
+	void endFrame()
+	{
+		const double now = m_clock();
+		smooth(m_drawTime, now - m_frameStart);
+		if (m_lastFrame >= 0.0) smooth(m_interval, m_frameStart - m_lastFrame);
+		m_lastFrame = m_frameStart;
+		m_frames++;
+
+		if (m_period > 0.0)
+			m_nextFrame = m_nextFrame + m_period < m_frameStart ? m_frameStart + m_period : m_nextFrame + m_period;
+	}
+
+	// Moving averages, in milliseconds. The interval covers idle time between frames too.
+	double smoothedDrawMilliseconds() const { return m_drawTime * 1000.0; }
+	double smoothedIntervalMilliseconds() const { return m_interval * 1000.0; }
+	unsigned long long framesDrawn() const { return m_frames; }
+
+private:
+	void smooth(double& average, double sample)
+	{
+		average = average == 0.0 ? sample : average + m_smoothing * (sample - average);
+	}
+
+	Clock m_clock;
+	double m_smoothing;
+	double m_period;
+	bool m_continuous;
+	bool m_dirty;
+	double m_nextFrame;
+	double m_frameStart;
+	double m_lastFrame;
+	double m_interval;
+	double m_drawTime;
+	unsigned long long m_frames;
+};
@@ -0,0 +1,342 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __APPLE__
+#include <OpenGL/gl.h>
+#include <dlfcn.h>
+#else
+#ifdef _WIN32
+#include <windows.h>
+#endif
+#include <GL/gl.h>
+#ifndef _WIN32
+#include <GL/glx.h>
+#endif
+#endif
+
+
+// Loader for the GL entry points beyond OpenGL 1.1, which the Windows
+// headers and opengl32.lib do not export. Call gl_load_extensions() once a
+// context is current, then go through gl_extensions().
+
+#ifndef APIENTRY
+#define APIENTRY
+#endif
+
+#ifndef GL_ARRAY_BUFFER
+#define GL_ARRAY_BUFFER 0x8892
+#define GL_ELEMENT_ARRAY_BUFFER 0x8893
+#define GL_STATIC_DRAW 0x88E4
+#endif
+
+#ifndef GL_FRAMEBUFFER
+#define GL_FRAMEBUFFER 0x8D40
+#define GL_RENDERBUFFER 0x8D41
+#define GL_COLOR_ATTACHMENT0 0x8CE0
+#define GL_DEPTH_ATTACHMENT 0x8D00
+#define GL_FRAMEBUFFER_COMPLETE 0x8CD5
+#endif
+
+#ifndef GL_DEPTH_COMPONENT24
+#define GL_DEPTH_COMPONENT24 0x81A6
+#endif
+
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+#ifndef GL_GENERATE_MIPMAP
+#define GL_GENERATE_MIPMAP 0x8191
+#endif
+
+#ifndef GL_SRGB8
+#define GL_SRGB8 0x8C41
+#endif
+
+#ifndef GL_SLUMINANCE8
+#define GL_SLUMINANCE8 0x8C47
+#endif
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#define GL_COMPILE_STATUS 0x8B81
+#define GL_LINK_STATUS 0x8B82
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+
+#ifndef GL_DYNAMIC_DRAW
+#define GL_DYNAMIC_DRAW 0x88E8
+#endif
+
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+
+#ifndef GL_TIME_ELAPSED
+#define GL_TIME_ELAPSED 0x88BF
+#endif
+
+#ifndef GL_PRIMITIVES_GENERATED
+#define GL_PRIMITIVES_GENERATED 0x8C87
+#endif
+
+typedef void (APIENTRY *GLGenBuffersProc)(GLsizei n, GLuint* buffers);
+typedef void (APIENTRY *GLDeleteBuffersProc)(GLsizei n, const GLuint* buffers);
+typedef void (APIENTRY *GLBindBufferProc)(GLenum target, GLuint buffer);
+typedef void (APIENTRY *GLBufferDataProc)(GLenum target, ptrdiff_t size, const void* data, GLenum usage);
+typedef void (APIENTRY *GLGenFramebuffersProc)(GLsizei n, GLuint* framebuffers);
+typedef void (APIENTRY *GLDeleteFramebuffersProc)(GLsizei n, const GLuint* framebuffers);
+typedef void (APIENTRY *GLBindFramebufferProc)(GLenum target, GLuint framebuffer);
+typedef void (APIENTRY *GLFramebufferRenderbufferProc)(GLenum target, GLenum attachment, GLenum renderbufferTarget, GLuint renderbuffer);
+typedef GLenum (APIENTRY *GLCheckFramebufferStatusProc)(GLenum target);
+typedef void (APIENTRY *GLGenRenderbuffersProc)(GLsizei n, GLuint* renderbuffers);
+typedef void (APIENTRY *GLDeleteRenderbuffersProc)(GLsizei n, const GLuint* renderbuffers);
+typedef void (APIENTRY *GLBindRenderbufferProc)(GLenum target, GLuint renderbuffer);
+typedef void (APIENTRY *GLRenderbufferStorageProc)(GLenum target, GLenum internalFormat, GLsizei width, GLsizei height);
+typedef void (APIENTRY *GLCompressedTexImage2DProc)(GLenum target, GLint level, GLenum internalFormat, GLsizei width, GLsizei height, GLint border, GLsizei imageSize, const void* data);
+typedef GLuint (APIENTRY *GLCreateShaderProc)(GLenum type);
+typedef void (APIENTRY *GLShaderSourceProc)(GLuint shader, GLsizei count, const char* const* strings, const GLint* lengths);
+typedef void (APIENTRY *GLCompileShaderProc)(GLuint shader);
+typedef void (APIENTRY *GLGetShaderivProc)(GLuint shader, GLenum name, GLint* value);
+typedef void (APIENTRY *GLGetShaderInfoLogProc)(GLuint shader, GLsizei size, GLsizei* length, char* log);
+typedef void (APIENTRY *GLDeleteShaderProc)(GLuint shader);
+typedef GLuint (APIENTRY *GLCreateProgramProc)(void);
+typedef void (APIENTRY *GLAttachShaderProc)(GLuint program, GLuint shader);
+typedef void (APIENTRY *GLBindAttribLocationProc)(GLuint program, GLuint index, const char* name);
+typedef void (APIENTRY *GLLinkProgramProc)(GLuint program);
+typedef void (APIENTRY *GLGetProgramivProc)(GLuint program, GLenum name, GLint* value);
+typedef void (APIENTRY *GLGetProgramInfoLogProc)(GLuint program, GLsizei size, GLsizei* length, char* log);
+typedef void (APIENTRY *GLUseProgramProc)(GLuint program);
+typedef void (APIENTRY *GLDeleteProgramProc)(GLuint program);
+typedef void (APIENTRY *GLEnableVertexAttribArrayProc)(GLuint index);
+typedef void (APIENTRY *GLDisableVertexAttribArrayProc)(GLuint index);
+typedef void (APIENTRY *GLVertexAttribPointerProc)(GLuint index, GLint size, GLenum type, GLboolean normalized, GLsizei stride, const void* pointer);
+typedef void (APIENTRY *GLVertexAttribDivisorProc)(GLuint index, GLuint divisor);
+typedef void (APIENTRY *GLDrawElementsInstancedProc)(GLenum mode, GLsizei count, GLenum type, const void* indices, GLsizei instanceCount);
+typedef void (APIENTRY *GLGenQueriesProc)(GLsizei n, GLuint* queries);
+typedef void (APIENTRY *GLDeleteQueriesProc)(GLsizei n, const GLuint* queries);
+typedef void (APIENTRY *GLBeginQueryProc)(GLenum target, GLuint query);
+typedef void (APIENTRY *GLEndQueryProc)(GLenum target);
+typedef void (APIENTRY *GLGetQueryObjectuivProc)(GLuint query, GLenum name, GLuint* value);
+typedef void (APIENTRY *GLGetQueryObjectui64vProc)(GLuint query, GLenum name, uint64_t* value);
+
+struct GLExtensions
+{
+	bool loaded;
+
+	// OpenGL 1.5 / ARB_vertex_buffer_object
+	bool vertexBufferObjects;
+	GLGenBuffersProc GenBuffers;
+	GLDeleteBuffersProc DeleteBuffers;
+	GLBindBufferProc BindBuffer;
+	GLBufferDataProc BufferData;
+
+	// OpenGL 3.0 / ARB_framebuffer_object (same entry points, no suffix)
+	bool framebufferObjects;
+	GLGenFramebuffersProc GenFramebuffers;
+	GLDeleteFramebuffersProc DeleteFramebuffers;
+	GLBindFramebufferProc BindFramebuffer;
+	GLFramebufferRenderbufferProc FramebufferRenderbuffer;
+	GLCheckFramebufferStatusProc CheckFramebufferStatus;
+	GLGenRenderbuffersProc GenRenderbuffers;
+	GLDeleteRenderbuffersProc DeleteRenderbuffers;
+	GLBindRenderbufferProc BindRenderbuffer;
+	GLRenderbufferStorageProc RenderbufferStorage;
+
+	// OpenGL 1.3 / ARB_texture_compression, plus EXT_texture_compression_s3tc
+	bool textureCompressionS3tc;
+	GLCompressedTexImage2DProc CompressedTexImage2D;
+
+	// OpenGL 2.1 / EXT_texture_sRGB
+	bool textureSrgb;
+
+	// OpenGL 2.0 vertex shaders
+	bool shaders;
+	GLCreateShaderProc CreateShader;
+	GLShaderSourceProc ShaderSource;
+	GLCompileShaderProc CompileShader;
+	GLGetShaderivProc GetShaderiv;
+	GLGetShaderInfoLogProc GetShaderInfoLog;
+	GLDeleteShaderProc DeleteShader;
+	GLCreateProgramProc CreateProgram;
+	GLAttachShaderProc AttachShader;
+	GLBindAttribLocationProc BindAttribLocation;
+	GLLinkProgramProc LinkProgram;
+	GLGetProgramivProc GetProgramiv;
+	GLGetProgramInfoLogProc GetProgramInfoLog;
+	GLUseProgramProc UseProgram;
+	GLDeleteProgramProc DeleteProgram;
+	GLEnableVertexAttribArrayProc EnableVertexAttribArray;
+	GLDisableVertexAttribArrayProc DisableVertexAttribArray;
+	GLVertexAttribPointerProc VertexAttribPointer;
+
+	// OpenGL 3.3 / ARB_instanced_arrays with ARB_draw_instanced
+	bool instancedArrays;
+	GLVertexAttribDivisorProc VertexAttribDivisor;
+	GLDrawElementsInstancedProc DrawElementsInstanced;
+
+	// OpenGL 1.5 / ARB_occlusion_query query objects, for the queries below
+	bool queries;
+	GLGenQueriesProc GenQueries;
+	GLDeleteQueriesProc DeleteQueries;
+	GLBeginQueryProc BeginQuery;
+	GLEndQueryProc EndQuery;
+	GLGetQueryObjectuivProc GetQueryObjectuiv;
+
+	// OpenGL 3.3 / ARB_timer_query (GL_TIME_ELAPSED)
+	bool timerQueries;
+	GLGetQueryObjectui64vProc GetQueryObjectui64v;
+
+	// OpenGL 3.0 / EXT_transform_feedback (GL_PRIMITIVES_GENERATED)
+	bool primitiveQueries;
+};
+
+inline GLExtensions& gl_extensions()
+{
+	static GLExtensions extensions = {};
+	return extensions;
+}
+
+inline void* gl_get_proc(const char* name)
+{
+#ifdef _WIN32
+	void* proc = (void*)wglGetProcAddress(name);
+	// wglGetProcAddress signals failure with a few values besides NULL.
+	if (proc == (void*)1 || proc == (void*)2 || proc == (void*)3 || proc == (void*)-1) proc = NULL;
+	return proc;
+#elif defined(__APPLE__)
+	return dlsym(RTLD_DEFAULT, name);
+#else
+	return (void*)glXGetProcAddressARB((const GLubyte*)name);
+#endif
+}
+
+// OpenGL version of the current context, as major * 10 + minor.
+inline int gl_version()
+{
+	const char* version = (const char*)glGetString(GL_VERSION);
+	if (version == NULL || version[0] < '0' || version[0] > '9' || version[1] != '.') return 0;
+	return (version[0] - '0') * 10 + (version[2] - '0');
+}
+
+inline bool gl_has_extension(const char* name)
+{
+	const char* extensions = (const char*)glGetString(GL_EXTENSIONS);
+	if (extensions == NULL) return false;
+
+	size_t length = strlen(name);
+	const char* p = extensions;
+	while ((p = strstr(p, name)) != NULL) {
+		bool startsWord = p == extensions || p[-1] == ' ';
+		bool endsWord = p[length] == ' ' || p[length] == '\0';
+		if (startsWord && endsWord) return true;
+		p += length;
+	}
+	return false;
+}
+
+// Looks up 'name' and, failing that, its ARB-suffixed alias.
+inline void* gl_get_proc_arb(const char* name)
+{
+	void* proc = gl_get_proc(name);
+	if (proc == NULL) {
+		char arbName[128];
+		size_t length = strlen(name);
+		if (length + 4 > sizeof(arbName)) return NULL;
+		memcpy(arbName, name, length);
+		memcpy(arbName + length, "ARB", 4);
+		proc = gl_get_proc(arbName);
+	}
+	return proc;
+}
+
+inline GLExtensions& gl_load_extensions()
+{
+	GLExtensions& ext = gl_extensions();
+	if (ext.loaded) return ext;
+	ext.loaded = true;
+
+	if (gl_version() >= 15 || gl_has_extension("GL_ARB_vertex_buffer_object")) {
+		ext.GenBuffers = (GLGenBuffersProc)gl_get_proc_arb("glGenBuffers");
+		ext.DeleteBuffers = (GLDeleteBuffersProc)gl_get_proc_arb("glDeleteBuffers");
+		ext.BindBuffer = (GLBindBufferProc)gl_get_proc_arb("glBindBuffer");
+		ext.BufferData = (GLBufferDataProc)gl_get_proc_arb("glBufferData");
+		ext.vertexBufferObjects = ext.GenBuffers && ext.DeleteBuffers && ext.BindBuffer && ext.BufferData;
+	}
+
+	if (gl_version() >= 30 || gl_has_extension("GL_ARB_framebuffer_object")) {
+		ext.GenFramebuffers = (GLGenFramebuffersProc)gl_get_proc("glGenFramebuffers");
+		ext.DeleteFramebuffers = (GLDeleteFramebuffersProc)gl_get_proc("glDeleteFramebuffers");
+		ext.BindFramebuffer = (GLBindFramebufferProc)gl_get_proc("glBindFramebuffer");
+		ext.FramebufferRenderbuffer = (GLFramebufferRenderbufferProc)gl_get_proc("glFramebufferRenderbuffer");
+		ext.CheckFramebufferStatus = (GLCheckFramebufferStatusProc)gl_get_proc("glCheckFramebufferStatus");
+		ext.GenRenderbuffers = (GLGenRenderbuffersProc)gl_get_proc("glGenRenderbuffers");
+		ext.DeleteRenderbuffers = (GLDeleteRenderbuffersProc)gl_get_proc("glDeleteRenderbuffers");
+		ext.BindRenderbuffer = (GLBindRenderbufferProc)gl_get_proc("glBindRenderbuffer");
+		ext.RenderbufferStorage = (GLRenderbufferStorageProc)gl_get_proc("glRenderbufferStorage");
+		ext.framebufferObjects = ext.GenFramebuffers && ext.DeleteFramebuffers && ext.BindFramebuffer && ext.FramebufferRenderbuffer
+			&& ext.CheckFramebufferStatus && ext.GenRenderbuffers && ext.DeleteRenderbuffers && ext.BindRenderbuffer && ext.RenderbufferStorage;
+	}
+
+	if (gl_version() >= 13 || gl_has_extension("GL_ARB_texture_compression")) {
+		ext.CompressedTexImage2D = (GLCompressedTexImage2DProc)gl_get_proc_arb("glCompressedTexImage2D");
+		ext.textureCompressionS3tc = ext.CompressedTexImage2D && gl_has_extension("GL_EXT_texture_compression_s3tc");
+	}
+
+	ext.textureSrgb = gl_version() >= 21 || gl_has_extension("GL_EXT_texture_sRGB");
+
+	if (gl_version() >= 20) {
+		ext.CreateShader = (GLCreateShaderProc)gl_get_proc("glCreateShader");
+		ext.ShaderSource = (GLShaderSourceProc)gl_get_proc("glShaderSource");
+		ext.CompileShader = (GLCompileShaderProc)gl_get_proc("glCompileShader");
+		ext.GetShaderiv = (GLGetShaderivProc)gl_get_proc("glGetShaderiv");
+		ext.GetShaderInfoLog = (GLGetShaderInfoLogProc)gl_get_proc("glGetShaderInfoLog");
+		ext.DeleteShader = (GLDeleteShaderProc)gl_get_proc("glDeleteShader");
+		ext.CreateProgram = (GLCreateProgramProc)gl_get_proc("glCreateProgram");
+		ext.AttachShader = (GLAttachShaderProc)gl_get_proc("glAttachShader");
+		ext.BindAttribLocation = (GLBindAttribLocationProc)gl_get_proc("glBindAttribLocation");
+		ext.LinkProgram = (GLLinkProgramProc)gl_get_proc("glLinkProgram");
+		ext.GetProgramiv = (GLGetProgramivProc)gl_get_proc("glGetProgramiv");
+		ext.GetProgramInfoLog = (GLGetProgramInfoLogProc)gl_get_proc("glGetProgramInfoLog");
+		ext.UseProgram = (GLUseProgramProc)gl_get_proc("glUseProgram");
+		ext.DeleteProgram = (GLDeleteProgramProc)gl_get_proc("glDeleteProgram");
+		ext.EnableVertexAttribArray = (GLEnableVertexAttribArrayProc)gl_get_proc("glEnableVertexAttribArray");
+		ext.DisableVertexAttribArray = (GLDisableVertexAttribArrayProc)gl_get_proc("glDisableVertexAttribArray");
+		ext.VertexAttribPointer = (GLVertexAttribPointerProc)gl_get_proc("glVertexAttribPointer");
+		ext.shaders = ext.CreateShader && ext.ShaderSource && ext.CompileShader && ext.GetShaderiv && ext.GetShaderInfoLog && ext.DeleteShader
+			&& ext.CreateProgram && ext.AttachShader && ext.BindAttribLocation && ext.LinkProgram && ext.GetProgramiv && ext.GetProgramInfoLog
+			&& ext.UseProgram && ext.DeleteProgram && ext.EnableVertexAttribArray && ext.DisableVertexAttribArray && ext.VertexAttribPointer;
+	}
+
+	if (ext.shaders && (gl_version() >= 33 || (gl_has_extension("GL_ARB_instanced_arrays") && gl_has_extension("GL_ARB_draw_instanced")))) {
+		ext.VertexAttribDivisor = (GLVertexAttribDivisorProc)gl_get_proc_arb("glVertexAttribDivisor");
+		ext.DrawElementsInstanced = (GLDrawElementsInstancedProc)gl_get_proc_arb("glDrawElementsInstanced");
+		ext.instancedArrays = ext.VertexAttribDivisor && ext.DrawElementsInstanced;
+	}
+
+	if (gl_version() >= 15 || gl_has_extension("GL_ARB_occlusion_query")) {
+		ext.GenQueries = (GLGenQueriesProc)gl_get_proc_arb("glGenQueries");
+		ext.DeleteQueries = (GLDeleteQueriesProc)gl_get_proc_arb("glDeleteQueries");
+		ext.BeginQuery = (GLBeginQueryProc)gl_get_proc_arb("glBeginQuery");
+		ext.EndQuery = (GLEndQueryProc)gl_get_proc_arb("glEndQuery");
+		ext.GetQueryObjectuiv = (GLGetQueryObjectuivProc)gl_get_proc_arb("glGetQueryObjectuiv");
+		ext.queries = ext.GenQueries && ext.DeleteQueries && ext.BeginQuery && ext.EndQuery && ext.GetQueryObjectuiv;
+	}
+
+	if (ext.queries && (gl_version() >= 33 || gl_has_extension("GL_ARB_timer_query"))) {
+		ext.GetQueryObjectui64v = (GLGetQueryObjectui64vProc)gl_get_proc("glGetQueryObjectui64v");
+		ext.timerQueries = ext.GetQueryObjectui64v != NULL;
+	}
+
+	ext.primitiveQueries = ext.queries && (gl_version() >= 30 || gl_has_extension("GL_EXT_transform_feedback"));
+
+	return ext;
+}
@@ -0,0 +1,328 @@
+#pragma once
+
+#include <stddef.h>
+#include <array>
+#include <vector>
+#include "clusters.hpp"
+#include "glextensions.hpp"
+#include "mesh.hpp"
+#include "quantise.hpp"
+
+
+// Retained mesh: interleaved position/normal vertices and a triangle index
+// buffer, uploaded once and drawn with a single glDrawElements call.
+// Without buffer object support the same arrays are drawn from client memory.
+// The vertices are floats, or in MESH_FORMAT_QUANTISED QuantisedVertex
+// (12 bytes instead of 24) with 16-bit indices when the vertex count allows.
+
+const int GPU_MESH_FLOATS_PER_VERTEX = 6;  // px py pz nx ny nz
+
+struct GpuMesh
+{
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	GLsizei indexCount;
+	MeshFormat format;
+	GLenum indexType;  // GL_UNSIGNED_INT or GL_UNSIGNED_SHORT.
+	size_t bytes;      // Vertex and index data together.
+
+	// Only filled when buffer objects are unavailable.
+	std::vector<unsigned char> clientVertices;
+	std::vector<unsigned char> clientIndices;
+
+	GpuMesh() : vertexBuffer(0), indexBuffer(0), indexCount(0), format(MESH_FORMAT_FLOAT), indexType(GL_UNSIGNED_INT), bytes(0) {}
+};
+
+// Line index buffer drawn over the vertices of a GpuMesh (wireframe).
+// Vertex i of the mesh is vertex i of the buffer for both the flat and the
+// smooth layouts, so the same indices work whichever one is uploaded.
+struct GpuLines
+{
+	GLuint indexBuffer;
+	GLsizei indexCount;
+	std::vector<GLuint> clientIndices;  // Only filled when buffer objects are unavailable.
+
+	GpuLines() : indexBuffer(0), indexCount(0) {}
+};
+
+/*
+	Builds vertex and index arrays that give every triangle its own face
+	normal while still sharing vertices. With glShadeModel(GL_FLAT) a
+	triangle is lit using only its provoking (last) vertex, so each triangle
+	is rotated to end on a vertex that no other triangle has claimed yet, and
+	that vertex carries the face normal. Only triangles whose three corners
+	are all taken need a duplicated vertex.
+*/
+inline void build_flat_mesh(const Mesh& mesh, const Float3Array& faceNormals, std::vector<float>& interleaved, std::vector<GLuint>& indices)
+{
+	const size_t vertexCount = mesh.vertexCount();
+	interleaved.resize(vertexCount * GPU_MESH_FLOATS_PER_VERTEX);
+	interleaved.reserve((vertexCount + mesh.triangleCount() / 4) * GPU_MESH_FLOATS_PER_VERTEX);
+	indices.resize(mesh.indices.size());
+
+	size_t i;
+	for (i = 0; i < vertexCount; i++) {
+		float* vertex = &interleaved[i * GPU_MESH_FLOATS_PER_VERTEX];
+		vertex[0] = mesh.positions.x[i];
+		vertex[1] = mesh.positions.y[i];
+		vertex[2] = mesh.positions.z[i];
+		vertex[3] = vertex[4] = vertex[5] = 0.0f;
+	}
+
+	std::vector<bool> claimed(vertexCount, false);
+	for (i = 0; i < mesh.triangleCount(); i++) {
+		const GLuint corner[3] = { mesh.indices[3 * i], mesh.indices[3 * i + 1], mesh.indices[3 * i + 2] };
+
+		// Try each rotation; keeping the cyclic order preserves the winding.
+		int last = -1, c;
+		for (c = 2; c >= 0; c--) {
+			if (!claimed[corner[c]]) { last = c; break; }
+		}
+
+		GLuint provoking;
+		if (last >= 0) {
+			provoking = corner[last];
+			claimed[provoking] = true;
+		} else {
+			last = 2;
+			provoking = (GLuint)(interleaved.size() / GPU_MESH_FLOATS_PER_VERTEX);
+			const float vertex[] = { mesh.positions.x[corner[2]], mesh.positions.y[corner[2]], mesh.positions.z[corner[2]], 0.0f, 0.0f, 0.0f };
+			interleaved.insert(interleaved.end(), vertex, vertex + GPU_MESH_FLOATS_PER_VERTEX);
+		}
+
+		float* normal = &interleaved[provoking * GPU_MESH_FLOATS_PER_VERTEX + 3];
+		normal[0] = faceNormals.x[i];
+		normal[1] = faceNormals.y[i];
+		normal[2] = faceNormals.z[i];
+
+		indices[3 * i] = corner[(last + 1) % 3];
+		indices[3 * i + 1] = corner[(last + 2) % 3];
+		indices[3 * i + 2] = provoking;
+	}
+}
+
+/*
+	Builds vertex and index arrays for smooth shading: one vertex per mesh
+	vertex with its blended normal, indexed straight from the mesh.
+*/
+inline void build_smooth_mesh(const Mesh& mesh, const Float3Array& vertexNormals, std::vector<float>& interleaved, std::vector<GLuint>& indices)
+{
+	interleaved.resize(mesh.vertexCount() * GPU_MESH_FLOATS_PER_VERTEX);
+	if (!interleaved.empty()) interleave_positions_normals(mesh.positions, vertexNormals, &interleaved[0]);
+	indices.assign(mesh.indices.data(), mesh.indices.data() + mesh.indices.size());
+}
+
+inline void gpu_mesh_release(GpuMesh& mesh)
+{
+	GLExtensions& ext = gl_extensions();
+	if (mesh.vertexBuffer != 0) ext.DeleteBuffers(1, &mesh.vertexBuffer);
+	if (mesh.indexBuffer != 0) ext.DeleteBuffers(1, &mesh.indexBuffer);
+	mesh.vertexBuffer = 0;
+	mesh.indexBuffer = 0;
+	mesh.indexCount = 0;
+	mesh.bytes = 0;
+	std::vector<unsigned char>().swap(mesh.clientVertices);
+	std::vector<unsigned char>().swap(mesh.clientIndices);
+}
+
+// Copies raw vertex and index bytes into buffer objects, or keeps them in
+// client memory when buffer objects are unavailable.
+inline void gpu_mesh_store(GpuMesh& mesh, const void* vertices, size_t vertexBytes, const void* indices, size_t indexBytes)
+{
+	mesh.bytes = vertexBytes + indexBytes;
+
+	GLExtensions& ext = gl_load_extensions();
+	if (!ext.vertexBufferObjects) {
+		mesh.clientVertices.assign((const unsigned char*)vertices, (const unsigned char*)vertices + vertexBytes);
+		mesh.clientIndices.assign((const unsigned char*)indices, (const unsigned char*)indices + indexBytes);
+		return;
+	}
+
+	ext.GenBuffers(1, &mesh.vertexBuffer);
+	ext.BindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+	ext.BufferData(GL_ARRAY_BUFFER, vertexBytes, vertexBytes == 0 ? NULL : vertices, GL_STATIC_DRAW);
+	ext.BindBuffer(GL_ARRAY_BUFFER, 0);
+
+	ext.GenBuffers(1, &mesh.indexBuffer);
+	ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+	ext.BufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexBytes == 0 ? NULL : indices, GL_STATIC_DRAW);
+	ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+/*
+	Uploads interleaved vertices (GPU_MESH_FLOATS_PER_VERTEX floats each) and
+	triangle indices, converted to 'format'. Needs a current GL context.
+*/
+inline void gpu_mesh_upload(GpuMesh& mesh, const std::vector<float>& interleaved, const std::vector<GLuint>& indices, MeshFormat format = MESH_FORMAT_FLOAT)
+{
+	gpu_mesh_release(mesh);
+	mesh.indexCount = (GLsizei)indices.size();
+	mesh.format = format;
+	mesh.indexType = GL_UNSIGNED_INT;
+
+	if (format == MESH_FORMAT_FLOAT) {
+		gpu_mesh_store(mesh, interleaved.empty() ? NULL : &interleaved[0], interleaved.size() * sizeof(float),
+			indices.empty() ? NULL : &indices[0], indices.size() * sizeof(GLuint));
+		return;
+	}
+
+	std::vector<QuantisedVertex> vertices;
+	quantise_interleaved(interleaved, vertices);
+	const void* vertexData = vertices.empty() ? NULL : &vertices[0];
+	if (vertices.size() <= 0x10000) {
+		std::vector<GLushort> shortIndices(indices.begin(), indices.end());
+		mesh.indexType = GL_UNSIGNED_SHORT;
+		gpu_mesh_store(mesh, vertexData, vertices.size() * sizeof(QuantisedVertex),
+			shortIndices.empty() ? NULL : &shortIndices[0], shortIndices.size() * sizeof(GLushort));
+	} else {
+		gpu_mesh_store(mesh, vertexData, vertices.size() * sizeof(QuantisedVertex),
+			indices.empty() ? NULL : &indices[0], indices.size() * sizeof(GLuint));
+	}
+}
+
+/*
+	Points the vertex array at the positions of 'mesh'. Quantised positions
+	are snorm16, which fixed-function GL reads as plain integers, so the
+	modelview matrix is pushed and scaled by 1/32767 and GL_NORMALIZE is
+	enabled to undo the scale on the normals; gpu_mesh_unbind_positions()
+	restores both.
+*/
+inline void gpu_mesh_bind_positions(const GpuMesh& mesh, const unsigned char* vertexBase)
+{
+	glEnableClientState(GL_VERTEX_ARRAY);
+	if (mesh.format == MESH_FORMAT_FLOAT) {
+		glVertexPointer(3, GL_FLOAT, GPU_MESH_FLOATS_PER_VERTEX * sizeof(float), vertexBase);
+		return;
+	}
+	glVertexPointer(3, GL_SHORT, sizeof(QuantisedVertex), vertexBase + offsetof(QuantisedVertex, position));
+	glPushAttrib(GL_ENABLE_BIT | GL_TRANSFORM_BIT);
+	glEnable(GL_NORMALIZE);
+	glMatrixMode(GL_MODELVIEW);
+	glPushMatrix();
+	glScalef(1.0f / SNORM16_SCALE, 1.0f / SNORM16_SCALE, 1.0f / SNORM16_SCALE);
+}
+
+inline void gpu_mesh_unbind_positions(const GpuMesh& mesh)
+{
+	if (mesh.format != MESH_FORMAT_FLOAT) {
+		glMatrixMode(GL_MODELVIEW);
+		glPopMatrix();
+		glPopAttrib();
+	}
+	glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+/*
+	Binds the buffers and the position and normal arrays of 'mesh' for
+	glDrawElements, and returns the index pointer to draw with (an offset
+	into the index buffer, or client memory).
+*/
+inline const unsigned char* gpu_mesh_bind(const GpuMesh& mesh)
+{
+	GLExtensions& ext = gl_extensions();
+	const bool buffers = mesh.vertexBuffer != 0;
+	const unsigned char* vertexBase = buffers ? NULL : &mesh.clientVertices[0];
+
+	if (buffers) {
+		ext.BindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+		ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.indexBuffer);
+	}
+
+	gpu_mesh_bind_positions(mesh, vertexBase);
+	glEnableClientState(GL_NORMAL_ARRAY);
+	if (mesh.format == MESH_FORMAT_FLOAT)
+		glNormalPointer(GL_FLOAT, GPU_MESH_FLOATS_PER_VERTEX * sizeof(float), vertexBase + 3 * sizeof(float));
+	else
+		glNormalPointer(GL_BYTE, sizeof(QuantisedVertex), vertexBase + offsetof(QuantisedVertex, normal));
+
+	return buffers ? NULL : &mesh.clientIndices[0];
+}
+
+inline void gpu_mesh_unbind(const GpuMesh& mesh)
+{
+	glDisableClientState(GL_NORMAL_ARRAY);
+	gpu_mesh_unbind_positions(mesh);
+
+	if (mesh.vertexBuffer != 0) {
+		GLExtensions& ext = gl_extensions();
+		ext.BindBuffer(GL_ARRAY_BUFFER, 0);
+		ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
+
+/*
+	Draws the whole mesh, or with 'ranges' only those runs of triangles (one
+	glDrawElements call each), e.g. the clusters that survived culling.
+*/
+inline void gpu_mesh_draw(const GpuMesh& mesh, const std::vector<MeshDrawRange>* ranges = NULL)
+{
+	if (mesh.indexCount == 0 || (ranges != NULL && ranges->empty())) return;
+
+	const unsigned char* indexBase = gpu_mesh_bind(mesh);
+	if (ranges == NULL) {
+		glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, indexBase);
+	} else {
+		const size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		size_t i;
+		for (i = 0; i < ranges->size(); i++)
+			glDrawElements(GL_TRIANGLES, 3 * (*ranges)[i].triangleCount, mesh.indexType, indexBase + 3 * (*ranges)[i].firstTriangle * indexSize);
+	}
+	gpu_mesh_unbind(mesh);
+}
+
+inline void gpu_lines_release(GpuLines& lines)
+{
+	if (lines.indexBuffer != 0) gl_extensions().DeleteBuffers(1, &lines.indexBuffer);
+	lines.indexBuffer = 0;
+	lines.indexCount = 0;
+	std::vector<GLuint>().swap(lines.clientIndices);
+}
+
+/*
+	Uploads 'count' line indices (two per line). Needs a current GL context.
+*/
+inline void gpu_lines_upload(GpuLines& lines, const GLuint* indices, size_t count)
+{
+	gpu_lines_release(lines);
+	lines.indexCount = (GLsizei)count;
+
+	GLExtensions& ext = gl_load_extensions();
+	if (!ext.vertexBufferObjects) {
+		lines.clientIndices.assign(indices, indices + count);
+		return;
+	}
+
+	ext.GenBuffers(1, &lines.indexBuffer);
+	ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, lines.indexBuffer);
+	ext.BufferData(GL_ELEMENT_ARRAY_BUFFER, count * sizeof(GLuint), count == 0 ? NULL : indices, GL_STATIC_DRAW);
+	ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+/*
+	Draws 'lines' with the positions of 'mesh'. Normals are not sourced from
+	the buffer, so the lines keep the current glNormal like glBegin lines do.
+*/
+inline void gpu_lines_draw(const GpuMesh& mesh, const GpuLines& lines)
+{
+	if (lines.indexCount == 0) return;
+
+	GLExtensions& ext = gl_extensions();
+	const bool buffers = mesh.vertexBuffer != 0 && lines.indexBuffer != 0;
+	if (!buffers && (mesh.clientVertices.empty() || lines.clientIndices.empty())) return;
+	const unsigned char* vertexBase = buffers ? NULL : &mesh.clientVertices[0];
+	const GLuint* indexBase = buffers ? NULL : &lines.clientIndices[0];
+
+	if (buffers) {
+		ext.BindBuffer(GL_ARRAY_BUFFER, mesh.vertexBuffer);
+		ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, lines.indexBuffer);
+	}
+
+	gpu_mesh_bind_positions(mesh, vertexBase);
+	glDrawElements(GL_LINES, lines.indexCount, GL_UNSIGNED_INT, indexBase);
+	gpu_mesh_unbind_positions(mesh);
+
+	if (buffers) {
+		ext.BindBuffer(GL_ARRAY_BUFFER, 0);
+		ext.BindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+}
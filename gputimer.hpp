@@ -0,0 +1,233 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "glextensions.hpp"
+
+
+// GPU time and primitive counts of named passes of a frame, measured with
+// GL_TIME_ELAPSED and GL_PRIMITIVES_GENERATED queries. A frame's queries
+// are read back up to GPU_TIMER_LATENCY frames later, once the driver says
+// they are available, so timing never makes the CPU wait for the GPU. If
+// the oldest frame still has not finished when its queries are needed
+// again, the new frame goes untimed instead.
+//
+// Drivers without timer queries (older Mesa software drivers among them)
+// leave the timer unsupported and every call a no-op. Software drivers that
+// have them, like llvmpipe, rasterise when the frame is flushed rather than
+// inside the passes, so their times read near zero; the primitive counts
+// are still exact.
+
+const int GPU_TIMER_LATENCY = 4;  // Frames whose queries may be in flight.
+const int GPU_TIMER_PASSES = 8;   // Passes timed per frame; further passes are ignored.
+
+struct GpuPassStats
+{
+	const char* name;           // Must outlive the timer (a string literal).
+	uint32_t frames;            // Frames the pass was timed in.
+	double totalMilliseconds;
+	double maxMilliseconds;
+	uint64_t primitives;        // Total over 'frames'; 0 without primitive queries.
+};
+
+class GpuTimer
+{
+public:
+	GpuTimer() : m_enabled(false), m_created(false), m_supported(false), m_countsPrimitives(false),
+		m_recording(false), m_passOpen(false), m_frame(0), m_skippedFrames(0) {}
+
+	GpuTimer(const GpuTimer&) = delete;
+	GpuTimer& operator=(const GpuTimer&) = delete;
+
+	void setEnabled(bool enabled) { m_enabled = enabled; }
+	bool enabled() const { return m_enabled; }
+
+	// Whether the context has timer queries. Needs a current GL context.
+	bool supported() { create(); return m_supported; }
+	bool countsPrimitives() { create(); return m_countsPrimitives; }
+
+	/*
+		Starts timing a frame: first collects whatever earlier frames have
+		finished, then claims the query slot of GPU_TIMER_LATENCY frames ago.
+	*/
+	void beginFrame()
+	{
+		m_recording = false;
+		if (!m_enabled || !create()) return;
+		collect(false);
+		FrameSlot& slot = m_slots[m_frame % GPU_TIMER_LATENCY];
+		if (slot.pending) {
+			m_skippedFrames++;
+			return;
+		}
+		slot.passCount = 0;
+		m_recording = true;
+	}
+
+	/*
+		Returns whether the pass is being timed. A pass begun inside another
+		is not: GL allows one query per target at a time.
+	*/
+	bool beginPass(const char* name)
+	{
+		FrameSlot& slot = m_slots[m_frame % GPU_TIMER_LATENCY];
+		if (!m_recording || m_passOpen || slot.passCount == GPU_TIMER_PASSES) return false;
+
+		const GLExtensions& ext = gl_extensions();
+		const int query = slot.passCount;
+		slot.names[query] = name;
+		ext.BeginQuery(GL_TIME_ELAPSED, slot.timeQueries[query]);
+		if (m_countsPrimitives) ext.BeginQuery(GL_PRIMITIVES_GENERATED, slot.primitiveQueries[query]);
+		m_passOpen = true;
+		return true;
+	}
+
+	void endPass()
+	{
+		if (!m_passOpen) return;
+		const GLExtensions& ext = gl_extensions();
+		ext.EndQuery(GL_TIME_ELAPSED);
+		if (m_countsPrimitives) ext.EndQuery(GL_PRIMITIVES_GENERATED);
+		m_slots[m_frame % GPU_TIMER_LATENCY].passCount++;
+		m_passOpen = false;
+	}
+
+	void endFrame()
+	{
+		if (!m_recording) return;
+		endPass();
+		FrameSlot& slot = m_slots[m_frame % GPU_TIMER_LATENCY];
+		slot.pending = slot.passCount > 0;
+		m_frame++;
+		m_recording = false;
+	}
+
+	/*
+		Adds every finished frame's results to the totals, oldest first.
+		With 'wait' it also waits for the unfinished ones (for the end of a
+		run, when stalling no longer matters).
+	*/
+	void collect(bool wait)
+	{
+		if (!m_created || !m_supported) return;
+		const GLExtensions& ext = gl_extensions();
+		int age;
+		for (age = GPU_TIMER_LATENCY; age > 0; age--) {
+			FrameSlot& slot = m_slots[(m_frame + GPU_TIMER_LATENCY - age) % GPU_TIMER_LATENCY];
+			if (!slot.pending) continue;
+
+			// Queries finish in order, so the last pass being ready means they all are.
+			GLuint available = GL_FALSE;
+			if (!wait) ext.GetQueryObjectuiv(slot.timeQueries[slot.passCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!wait && !available) break;
+
+			int p;
+			for (p = 0; p < slot.passCount; p++) {
+				uint64_t nanoseconds = 0;
+				GLuint primitives = 0;
+				ext.GetQueryObjectui64v(slot.timeQueries[p], GL_QUERY_RESULT, &nanoseconds);
+				if (m_countsPrimitives) ext.GetQueryObjectuiv(slot.primitiveQueries[p], GL_QUERY_RESULT, &primitives);
+				add(slot.names[p], nanoseconds / 1e6, primitives);
+			}
+			slot.pending = false;
+		}
+	}
+
+	// Per-pass totals, in the order the passes were first timed.
+	const std::vector<GpuPassStats>& stats() const { return m_stats; }
+	uint32_t skippedFrames() const { return m_skippedFrames; }
+
+	void resetStats()
+	{
+		m_stats.clear();
+		m_skippedFrames = 0;
+	}
+
+	// Deletes the queries. Needs the context they were created in.
+	void release()
+	{
+		if (m_created && m_supported) {
+			const GLExtensions& ext = gl_extensions();
+			int s;
+			for (s = 0; s < GPU_TIMER_LATENCY; s++) {
+				ext.DeleteQueries(GPU_TIMER_PASSES, m_slots[s].timeQueries);
+				if (m_countsPrimitives) ext.DeleteQueries(GPU_TIMER_PASSES, m_slots[s].primitiveQueries);
+				m_slots[s].pending = false;
+			}
+		}
+		m_created = false;
+		m_recording = m_passOpen = false;
+	}
+
+private:
+	struct FrameSlot
+	{
+		GLuint timeQueries[GPU_TIMER_PASSES];
+		GLuint primitiveQueries[GPU_TIMER_PASSES];
+		const char* names[GPU_TIMER_PASSES];
+		int passCount;
+		bool pending;  // Queries issued but not yet collected.
+	};
+
+	// Creates the queries the first time the timer runs.
+	bool create()
+	{
+		if (m_created) return m_supported;
+		m_created = true;
+
+		const GLExtensions& ext = gl_load_extensions();
+		m_supported = ext.timerQueries;
+		m_countsPrimitives = ext.timerQueries && ext.primitiveQueries;
+		if (!m_supported) return false;
+
+		int s;
+		for (s = 0; s < GPU_TIMER_LATENCY; s++) {
+			ext.GenQueries(GPU_TIMER_PASSES, m_slots[s].timeQueries);
+			if (m_countsPrimitives) ext.GenQueries(GPU_TIMER_PASSES, m_slots[s].primitiveQueries);
+			m_slots[s].passCount = 0;
+			m_slots[s].pending = false;
+		}
+		return true;
+	}
+
+	void add(const char* name, double milliseconds, uint64_t primitives)
+	{
+		size_t i;
+		for (i = 0; i < m_stats.size() && m_stats[i].name != name; i++) {}
+		if (i == m_stats.size()) {
+			const GpuPassStats pass = { name, 0, 0.0, 0.0, 0 };
+			m_stats.push_back(pass);
+		}
+		GpuPassStats& pass = m_stats[i];
+		pass.frames++;
+		pass.totalMilliseconds += milliseconds;
+		if (milliseconds > pass.maxMilliseconds) pass.maxMilliseconds = milliseconds;
+		pass.primitives += primitives;
+	}
+
+	FrameSlot m_slots[GPU_TIMER_LATENCY];
+	std::vector<GpuPassStats> m_stats;
+	bool m_enabled;
+	bool m_created;
+	bool m_supported;
+	bool m_countsPrimitives;
+	bool m_recording;
+	bool m_passOpen;
+	uint32_t m_frame;
+	uint32_t m_skippedFrames;
+};
+
+// Times its own lifetime as one GPU pass of 'name'.
+class GpuTimerPass
+{
+public:
+	GpuTimerPass(GpuTimer& timer, const char* name) : m_timer(timer), m_open(timer.beginPass(name)) {}
+	~GpuTimerPass() { if (m_open) m_timer.endPass(); }
+
+	GpuTimerPass(const GpuTimerPass&) = delete;
+	GpuTimerPass& operator=(const GpuTimerPass&) = delete;
+
+private:
+	GpuTimer& m_timer;
+	bool m_open;
+};
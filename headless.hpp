@@ -0,0 +1,218 @@
+#pragma once
+
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "glextensions.hpp"
+
+#if defined(__linux__) && !defined(HEADLESS_NO_EGL)
+#define HEADLESS_EGL 1
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+
+// Offscreen rendering for "OpenGLCoursework --headless": a GL context with
+// no window, frame-time statistics and a PPM dump of the rendered image.
+//
+// On Linux the context is an EGL pbuffer on Mesa's surfaceless platform,
+// which needs no display server (llvmpipe renders it in software when there
+// is no GPU). Elsewhere, or when EGL fails, the caller creates a hidden GLUT
+// window and renders into a framebuffer object so the result does not
+// depend on the window being visible.
+//
+// Building on Linux therefore needs EGL as well as GLUT and GL, e.g.
+//   g++ -std=c++14 -O2 OpenGLCoursework.cpp -o OpenGLCoursework -lglut -lGLU -lGL -lEGL -lpthread
+// Define HEADLESS_NO_EGL to build without it (headless then needs a display).
+
+class HeadlessContext
+{
+public:
+	HeadlessContext() : m_framebuffer(0), m_colorBuffer(0), m_depthBuffer(0), m_backend("none")
+	{
+#ifdef HEADLESS_EGL
+		m_display = EGL_NO_DISPLAY;
+		m_context = EGL_NO_CONTEXT;
+		m_surface = EGL_NO_SURFACE;
+#endif
+	}
+	~HeadlessContext() { destroy(); }
+
+	/*
+		Creates and makes current a windowless context with a width x height
+		RGB8 colour buffer and a 24-bit depth buffer. Returns false when the
+		platform has no such context.
+	*/
+	bool create(int width, int height)
+	{
+#ifdef HEADLESS_EGL
+		PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+		if (getPlatformDisplay == NULL) return false;
+		m_display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+		EGLint major, minor;
+		if (m_display == EGL_NO_DISPLAY || !eglInitialize(m_display, &major, &minor)) {
+			m_display = EGL_NO_DISPLAY;
+			return false;
+		}
+
+		const EGLint configAttributes[] = {
+			EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+			EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8,
+			EGL_DEPTH_SIZE, 24,
+			EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+			EGL_NONE
+		};
+		const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+		EGLConfig config;
+		EGLint configCount = 0;
+		if (!eglChooseConfig(m_display, configAttributes, &config, 1, &configCount) || configCount == 0 || !eglBindAPI(EGL_OPENGL_API)) {
+			destroy();
+			return false;
+		}
+		m_context = eglCreateContext(m_display, config, EGL_NO_CONTEXT, NULL);
+		m_surface = eglCreatePbufferSurface(m_display, config, surfaceAttributes);
+		if (m_context == EGL_NO_CONTEXT || m_surface == EGL_NO_SURFACE || !eglMakeCurrent(m_display, m_surface, m_surface, m_context)) {
+			destroy();
+			return false;
+		}
+		m_backend = "EGL surfaceless pbuffer";
+		return true;
+#else
+		(void)width;
+		(void)height;
+		return false;
+#endif
+	}
+
+	/*
+		Redirects rendering in the current (window) context to a width x height
+		framebuffer object. Returns false if framebuffer objects are missing,
+		in which case the window's back buffer is used as is.
+	*/
+	bool createFramebuffer(int width, int height)
+	{
+		GLExtensions& ext = gl_load_extensions();
+		m_backend = "hidden GLUT window";
+		if (!ext.framebufferObjects) return false;
+
+		ext.GenRenderbuffers(1, &m_colorBuffer);
+		ext.BindRenderbuffer(GL_RENDERBUFFER, m_colorBuffer);
+		ext.RenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		ext.GenRenderbuffers(1, &m_depthBuffer);
+		ext.BindRenderbuffer(GL_RENDERBUFFER, m_depthBuffer);
+		ext.RenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		ext.BindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		ext.GenFramebuffers(1, &m_framebuffer);
+		ext.BindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+		ext.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorBuffer);
+		ext.FramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_depthBuffer);
+		if (ext.CheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+			destroyFramebuffer();
+			return false;
+		}
+		m_backend = "hidden GLUT window, framebuffer object";
+		return true;
+	}
+
+	void destroy()
+	{
+		destroyFramebuffer();
+#ifdef HEADLESS_EGL
+		if (m_display != EGL_NO_DISPLAY) {
+			eglMakeCurrent(m_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+			if (m_surface != EGL_NO_SURFACE) eglDestroySurface(m_display, m_surface);
+			if (m_context != EGL_NO_CONTEXT) eglDestroyContext(m_display, m_context);
+			eglTerminate(m_display);
+		}
+		m_display = EGL_NO_DISPLAY;
+		m_context = EGL_NO_CONTEXT;
+		m_surface = EGL_NO_SURFACE;
+#endif
+	}
+
+	const char* backend() const { return m_backend; }
+
+private:
+	HeadlessContext(const HeadlessContext&);
+	HeadlessContext& operator=(const HeadlessContext&);
+
+	void destroyFramebuffer()
+	{
+		GLExtensions& ext = gl_extensions();
+		if (m_framebuffer != 0) {
+			ext.BindFramebuffer(GL_FRAMEBUFFER, 0);
+			ext.DeleteFramebuffers(1, &m_framebuffer);
+		}
+		if (m_colorBuffer != 0) ext.DeleteRenderbuffers(1, &m_colorBuffer);
+		if (m_depthBuffer != 0) ext.DeleteRenderbuffers(1, &m_depthBuffer);
+		m_framebuffer = m_colorBuffer = m_depthBuffer = 0;
+	}
+
+#ifdef HEADLESS_EGL
+	EGLDisplay m_display;
+	EGLContext m_context;
+	EGLSurface m_surface;
+#endif
+	GLuint m_framebuffer;
+	GLuint m_colorBuffer;
+	GLuint m_depthBuffer;
+	const char* m_backend;
+};
+
+struct FrameTimeSummary
+{
+	double min;
+	double median;
+	double p99;
+	double mean;
+};
+
+// Summary of per-frame times (any unit); percentiles use the nearest rank.
+inline FrameTimeSummary summarise_frame_times(std::vector<double> times)
+{
+	FrameTimeSummary summary = {};
+	if (times.empty()) return summary;
+
+	std::sort(times.begin(), times.end());
+	const size_t n = times.size();
+	size_t p99 = (size_t)ceil(0.99 * n);
+	double total = 0.0;
+	size_t i;
+	for (i = 0; i < n; i++) total += times[i];
+
+	summary.min = times[0];
+	summary.median = n % 2 ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+	summary.p99 = times[(p99 > 0 ? p99 : 1) - 1];
+	summary.mean = total / n;
+	return summary;
+}
+
+/*
+	Reads the current read buffer and writes it as a binary PPM (P6),
+	flipping GL's bottom-up rows.
+*/
+inline bool save_framebuffer_ppm(const char* path, int width, int height)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 3);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.empty() ? NULL : &pixels[0]);
+
+	FILE* file = fopen(path, "wb");
+	if (file == NULL) {
+		printf("Could not write '%s'.\n", path);
+		return false;
+	}
+	bool ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+	int y;
+	for (y = height - 1; ok && y >= 0; y--) {
+		ok = fwrite(&pixels[(size_t)y * width * 3], 3, width, file) == (size_t)width;
+	}
+	ok = fclose(file) == 0 && ok;
+	if (!ok) printf("Could not write '%s'.\n", path);
+	return ok;
+}
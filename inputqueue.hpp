@@ -0,0 +1,105 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "clock.hpp"
+
+
+// Window input as timestamped events. The GLUT callbacks only push events;
+// the frame drains them all at once and applies them, so input costs
+// nothing between frames and a burst of mouse motion becomes one update.
+// The queue is a fixed ring for one producer thread and one consumer
+// thread, without locks; events pushed while it is full are dropped and
+// counted.
+
+enum InputEventType { INPUT_KEY, INPUT_SPECIAL_KEY, INPUT_BUTTON, INPUT_MOTION };
+
+struct InputEvent
+{
+	int type;     // InputEventType
+	int code;     // Key, GLUT special key or GLUT mouse button.
+	int state;    // GLUT_DOWN / GLUT_UP for buttons.
+	int x, y;     // Pointer position in window pixels, from the top left.
+	double time;  // Seconds on the steady clock when the callback ran.
+};
+
+inline InputEvent input_event(int type, int code, int state, int x, int y)
+{
+	const InputEvent event = { type, code, state, x, y, clock_seconds() };
+	return event;
+}
+
+class InputQueue
+{
+public:
+	// 'capacity' is rounded up to a power of two.
+	explicit InputQueue(size_t capacity = 256) : m_head(0), m_tail(0), m_dropped(0)
+	{
+		size_t size = 2;
+		while (size < capacity) size <<= 1;
+		m_events.resize(size);
+		m_mask = size - 1;
+	}
+
+	InputQueue(const InputQueue&) = delete;
+	InputQueue& operator=(const InputQueue&) = delete;
+
+	// Producer side. Returns false, dropping the event, if the queue is full.
+	bool push(const InputEvent& event)
+	{
+		const size_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail - m_head.load(std::memory_order_acquire) > m_mask) {
+			m_dropped.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		m_events[tail & m_mask] = event;
+		m_tail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Consumer side.
+	bool pop(InputEvent& event)
+	{
+		const size_t head = m_head.load(std::memory_order_relaxed);
+		if (head == m_tail.load(std::memory_order_acquire)) return false;
+		event = m_events[head & m_mask];
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	/*
+		Consumer side: moves every queued event into 'out', oldest first,
+		folding each run of consecutive motion events into its last one
+		(positions are absolute, so nothing is lost). Keeps the time of the
+		run's first event, so the delay from input to frame stays visible.
+		Returns the number of events popped, before folding.
+	*/
+	size_t drain(std::vector<InputEvent>& out)
+	{
+		out.clear();
+		size_t popped = 0;
+		InputEvent event;
+		while (pop(event)) {
+			popped++;
+			if (event.type == INPUT_MOTION && !out.empty() && out.back().type == INPUT_MOTION) {
+				const double first = out.back().time;
+				out.back() = event;
+				out.back().time = first;
+			} else {
+				out.push_back(event);
+			}
+		}
+		return popped;
+	}
+
+	uint32_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+	std::vector<InputEvent> m_events;
+	size_t m_mask;
+	std::atomic<size_t> m_head;  // Next event to pop, written by the consumer.
+	std::atomic<size_t> m_tail;  // Next slot to fill, written by the producer.
+	std::atomic<uint32_t> m_dropped;
+};
@@ -0,0 +1,493 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <queue>
+#include <vector>
+#include "clock.hpp"
+#include "mesh.hpp"
+#include "meshprep.hpp"
+
+
+// Level-of-detail chains by quadric edge collapse (Garland and Heckbert,
+// "Surface Simplification Using Quadric Error Metrics", 1997).
+//
+// Every vertex carries the sum of the squared distances to the planes of
+// its original triangles (a 4x4 quadric). Collapsing an edge merges its two
+// quadrics and moves the surviving vertex to the point that minimises the
+// sum, so the error stays relative to the original surface. Edges are
+// collapsed cheapest first until the triangle target is reached. Collapses
+// that would flip a triangle or pinch the surface into a non-manifold
+// shape are skipped, and open borders are held in place by extra planes
+// perpendicular to them.
+
+const int LOD_LEVELS = 3;
+const float LOD_FRACTIONS[LOD_LEVELS] = { 0.5f, 0.25f, 0.1f };  // Of the full triangle count.
+
+// Weight of the planes that keep open borders in place, relative to the
+// surface planes.
+const double LOD_BOUNDARY_WEIGHT = 100.0;
+
+// Symmetric 4x4 matrix: a00 a01 a02 a03 a11 a12 a13 a22 a23 a33.
+struct Quadric
+{
+	double q[10];
+};
+
+// Quadric of the plane n.p + d = 0 (unit n), times 'weight'.
+inline Quadric quadric_from_plane(double nx, double ny, double nz, double d, double weight)
+{
+	Quadric r;
+	r.q[0] = nx * nx * weight; r.q[1] = nx * ny * weight; r.q[2] = nx * nz * weight; r.q[3] = nx * d * weight;
+	r.q[4] = ny * ny * weight; r.q[5] = ny * nz * weight; r.q[6] = ny * d * weight;
+	r.q[7] = nz * nz * weight; r.q[8] = nz * d * weight;
+	r.q[9] = d * d * weight;
+	return r;
+}
+
+inline void quadric_add(Quadric& a, const Quadric& b)
+{
+	int i;
+	for (i = 0; i < 10; i++) a.q[i] += b.q[i];
+}
+
+// Weighted sum of squared plane distances at (x, y, z).
+inline double quadric_error(const Quadric& a, double x, double y, double z)
+{
+	const double* q = a.q;
+	return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+		+ q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+		+ q[7] * z * z + 2 * q[8] * z + q[9];
+}
+
+// Point minimising the quadric; false if the system is (nearly) singular.
+inline bool quadric_optimum(const Quadric& a, double out[3])
+{
+	const double* q = a.q;
+	// Solve [a00 a01 a02; a01 a11 a12; a02 a12 a22] p = -[a03 a13 a23] by Cramer's rule.
+	const double c0 = q[4] * q[7] - q[5] * q[5];
+	const double c1 = q[2] * q[5] - q[1] * q[7];
+	const double c2 = q[1] * q[5] - q[2] * q[4];
+	const double determinant = q[0] * c0 + q[1] * c1 + q[2] * c2;
+	const double scale = q[0] + q[4] + q[7];
+	if (fabs(determinant) <= 1e-12 * scale * scale * scale) return false;
+
+	const double bx = -q[3], by = -q[6], bz = -q[8];
+	out[0] = (bx * c0 + by * c1 + bz * c2) / determinant;
+	out[1] = (bx * c1 + by * (q[0] * q[7] - q[2] * q[2]) + bz * (q[1] * q[2] - q[0] * q[5])) / determinant;
+	out[2] = (bx * c2 + by * (q[1] * q[2] - q[0] * q[5]) + bz * (q[0] * q[4] - q[1] * q[1])) / determinant;
+	return true;
+}
+
+// One simplified level of a mesh.
+struct MeshLod
+{
+	Mesh mesh;
+	Float3Array faceNormals;
+	float error;     // Largest quadric error of any collapse so far (squared distance).
+	double seconds;  // Time spent reaching this level from the previous one.
+
+	MeshLod() : error(0.0f), seconds(0.0) {}
+};
+
+class QemSimplifier
+{
+public:
+	QemSimplifier() : m_liveTriangles(0), m_maxError(0.0) {}
+
+	QemSimplifier(const QemSimplifier&) = delete;
+	QemSimplifier& operator=(const QemSimplifier&) = delete;
+
+	// Sets up quadrics, adjacency and the collapse queue for 'mesh'.
+	void init(const Mesh& mesh)
+	{
+		const size_t vertexCount = mesh.vertexCount();
+		const size_t triangles = mesh.triangleCount();
+		m_x.assign(mesh.positions.x.data(), mesh.positions.x.data() + vertexCount);
+		m_y.assign(mesh.positions.y.data(), mesh.positions.y.data() + vertexCount);
+		m_z.assign(mesh.positions.z.data(), mesh.positions.z.data() + vertexCount);
+		m_indices.assign(mesh.indices.data(), mesh.indices.data() + mesh.indices.size());
+		m_triangleAlive.assign(triangles, 1);
+		m_vertexAlive.assign(vertexCount, 1);
+		m_stamp.assign(vertexCount, 0);
+		m_vertexTriangles.assign(vertexCount, std::vector<uint32_t>());
+		m_quadrics.assign(vertexCount, Quadric());
+		m_queue = std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> >();
+		m_liveTriangles = triangles;
+		m_maxError = 0.0;
+
+		size_t t;
+		int c;
+		for (t = 0; t < triangles; t++) {
+			const uint32_t* tri = &m_indices[3 * t];
+			if (tri[0] == tri[1] || tri[1] == tri[2] || tri[0] == tri[2]) {
+				m_triangleAlive[t] = 0;
+				m_liveTriangles--;
+				continue;
+			}
+			for (c = 0; c < 3; c++) m_vertexTriangles[tri[c]].push_back((uint32_t)t);
+
+			// Area-weighted plane quadric.
+			double n[3];
+			double area = triangleNormal(tri[0], tri[1], tri[2], n);
+			if (area <= 0.0) continue;
+			const double d = -(n[0] * m_x[tri[0]] + n[1] * m_y[tri[0]] + n[2] * m_z[tri[0]]);
+			const Quadric plane = quadric_from_plane(n[0], n[1], n[2], d, area);
+			for (c = 0; c < 3; c++) quadric_add(m_quadrics[tri[c]], plane);
+		}
+
+		// Border planes: through each open edge, perpendicular to its triangle.
+		for (t = 0; t < triangles; t++) {
+			if (!m_triangleAlive[t]) continue;
+			const uint32_t* tri = &m_indices[3 * t];
+			double n[3];
+			if (triangleNormal(tri[0], tri[1], tri[2], n) <= 0.0) continue;
+			for (c = 0; c < 3; c++) {
+				const uint32_t a = tri[c], b = tri[(c + 1) % 3];
+				if (sharedTriangles(a, b) != 1) continue;
+				const double ex = m_x[b] - m_x[a], ey = m_y[b] - m_y[a], ez = m_z[b] - m_z[a];
+				double px = ey * n[2] - ez * n[1], py = ez * n[0] - ex * n[2], pz = ex * n[1] - ey * n[0];
+				const double length = sqrt(px * px + py * py + pz * pz);
+				if (length <= 0.0) continue;
+				px /= length; py /= length; pz /= length;
+				const double d = -(px * m_x[a] + py * m_y[a] + pz * m_z[a]);
+				const Quadric plane = quadric_from_plane(px, py, pz, d, LOD_BOUNDARY_WEIGHT * (ex * ex + ey * ey + ez * ez));
+				quadric_add(m_quadrics[a], plane);
+				quadric_add(m_quadrics[b], plane);
+			}
+		}
+
+		for (t = 0; t < triangles; t++) {
+			if (!m_triangleAlive[t]) continue;
+			for (c = 0; c < 3; c++) {
+				const uint32_t a = m_indices[3 * t + c], b = m_indices[3 * t + (c + 1) % 3];
+				if (a < b || sharedTriangles(a, b) == 1) pushCandidate(a, b);  // Each edge once.
+			}
+		}
+	}
+
+	size_t liveTriangles() const { return m_liveTriangles; }
+	double maxError() const { return m_maxError; }
+
+	// Collapses edges, cheapest first, until at most 'target' triangles remain
+	// or no edge can be collapsed.
+	void collapseTo(size_t target)
+	{
+		while (m_liveTriangles > target && !m_queue.empty()) {
+			Candidate candidate = m_queue.top();
+			m_queue.pop();
+			if (!m_vertexAlive[candidate.a] || !m_vertexAlive[candidate.b]) continue;
+			if (m_stamp[candidate.a] != candidate.stampA || m_stamp[candidate.b] != candidate.stampB) continue;
+			collapse(candidate);
+		}
+	}
+
+	// Copies the surviving triangles into 'out', dropping unused vertices.
+	void extract(Mesh& out) const
+	{
+		std::vector<uint32_t> remap(m_x.size(), UINT32_MAX);
+		uint32_t vertexCount = 0;
+		size_t t;
+		int c;
+		for (t = 0; t < m_triangleAlive.size(); t++) {
+			if (!m_triangleAlive[t]) continue;
+			for (c = 0; c < 3; c++) {
+				const uint32_t v = m_indices[3 * t + c];
+				if (remap[v] == UINT32_MAX) remap[v] = vertexCount++;
+			}
+		}
+
+		out.positions.resize(vertexCount);
+		out.indices.resize(m_liveTriangles * 3);
+		size_t v;
+		for (v = 0; v < remap.size(); v++) {
+			if (remap[v] == UINT32_MAX) continue;
+			out.positions.x[remap[v]] = m_x[v];
+			out.positions.y[remap[v]] = m_y[v];
+			out.positions.z[remap[v]] = m_z[v];
+		}
+		size_t written = 0;
+		for (t = 0; t < m_triangleAlive.size(); t++) {
+			if (!m_triangleAlive[t]) continue;
+			for (c = 0; c < 3; c++) out.indices[written++] = remap[m_indices[3 * t + c]];
+		}
+	}
+
+private:
+	struct Candidate
+	{
+		double cost;
+		uint32_t a, b;
+		uint32_t stampA, stampB;
+		float position[3];
+
+		bool operator>(const Candidate& other) const { return cost > other.cost; }
+	};
+
+	// Unit normal of triangle abc in 'n'; returns its area (0 if degenerate).
+	double triangleNormal(uint32_t a, uint32_t b, uint32_t c, double n[3]) const
+	{
+		const double ux = m_x[b] - m_x[a], uy = m_y[b] - m_y[a], uz = m_z[b] - m_z[a];
+		const double vx = m_x[c] - m_x[a], vy = m_y[c] - m_y[a], vz = m_z[c] - m_z[a];
+		n[0] = uy * vz - uz * vy;
+		n[1] = uz * vx - ux * vz;
+		n[2] = ux * vy - uy * vx;
+		const double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length <= 0.0) return 0.0;
+		n[0] /= length; n[1] /= length; n[2] /= length;
+		return 0.5 * length;
+	}
+
+	bool triangleHas(uint32_t t, uint32_t v) const
+	{
+		return m_indices[3 * t] == v || m_indices[3 * t + 1] == v || m_indices[3 * t + 2] == v;
+	}
+
+	// Live triangles using both a and b.
+	int sharedTriangles(uint32_t a, uint32_t b) const
+	{
+		const std::vector<uint32_t>& around = m_vertexTriangles[a];
+		int count = 0;
+		size_t i;
+		for (i = 0; i < around.size(); i++) {
+			if (m_triangleAlive[around[i]] && triangleHas(around[i], b)) count++;
+		}
+		return count;
+	}
+
+	// Live vertices sharing a triangle with v (unsorted, may repeat).
+	void neighbours(uint32_t v, std::vector<uint32_t>& out) const
+	{
+		out.clear();
+		const std::vector<uint32_t>& around = m_vertexTriangles[v];
+		size_t i;
+		int c;
+		for (i = 0; i < around.size(); i++) {
+			if (!m_triangleAlive[around[i]]) continue;
+			for (c = 0; c < 3; c++) {
+				const uint32_t w = m_indices[3 * around[i] + c];
+				if (w != v) out.push_back(w);
+			}
+		}
+	}
+
+	void pushCandidate(uint32_t a, uint32_t b)
+	{
+		Quadric q = m_quadrics[a];
+		quadric_add(q, m_quadrics[b]);
+
+		// The optimum if it exists, else the better of the endpoints and the midpoint.
+		double best[3] = { m_x[a], m_y[a], m_z[a] }, cost;
+		if (quadric_optimum(q, best)) {
+			cost = quadric_error(q, best[0], best[1], best[2]);
+		} else {
+			const double options[3][3] = {
+				{ m_x[a], m_y[a], m_z[a] }, { m_x[b], m_y[b], m_z[b] },
+				{ 0.5 * (m_x[a] + m_x[b]), 0.5 * (m_y[a] + m_y[b]), 0.5 * (m_z[a] + m_z[b]) }
+			};
+			int i, k;
+			cost = 1e300;
+			for (i = 0; i < 3; i++) {
+				const double e = quadric_error(q, options[i][0], options[i][1], options[i][2]);
+				if (e < cost) { cost = e; for (k = 0; k < 3; k++) best[k] = options[i][k]; }
+			}
+		}
+
+		Candidate candidate;
+		candidate.cost = (std::max)(cost, 0.0);
+		candidate.a = a;
+		candidate.b = b;
+		candidate.stampA = m_stamp[a];
+		candidate.stampB = m_stamp[b];
+		candidate.position[0] = (float)best[0];
+		candidate.position[1] = (float)best[1];
+		candidate.position[2] = (float)best[2];
+		m_queue.push(candidate);
+	}
+
+	/*
+		True if moving 'moved' to 'position' flips or degenerates any live
+		triangle around it that does not also use 'other' (those disappear).
+	*/
+	bool wouldFlip(uint32_t moved, uint32_t other, const float position[3]) const
+	{
+		const std::vector<uint32_t>& around = m_vertexTriangles[moved];
+		size_t i;
+		for (i = 0; i < around.size(); i++) {
+			const uint32_t t = around[i];
+			if (!m_triangleAlive[t] || triangleHas(t, other)) continue;
+
+			double before[3], after[3];
+			if (triangleNormal(m_indices[3 * t], m_indices[3 * t + 1], m_indices[3 * t + 2], before) <= 0.0) continue;
+
+			double p[3][3];
+			int c;
+			for (c = 0; c < 3; c++) {
+				const uint32_t v = m_indices[3 * t + c];
+				p[c][0] = v == moved ? position[0] : m_x[v];
+				p[c][1] = v == moved ? position[1] : m_y[v];
+				p[c][2] = v == moved ? position[2] : m_z[v];
+			}
+			const double ux = p[1][0] - p[0][0], uy = p[1][1] - p[0][1], uz = p[1][2] - p[0][2];
+			const double vx = p[2][0] - p[0][0], vy = p[2][1] - p[0][1], vz = p[2][2] - p[0][2];
+			after[0] = uy * vz - uz * vy;
+			after[1] = uz * vx - ux * vz;
+			after[2] = ux * vy - uy * vx;
+			const double length = sqrt(after[0] * after[0] + after[1] * after[1] + after[2] * after[2]);
+			if (length <= 0.0) return true;
+			if ((before[0] * after[0] + before[1] * after[1] + before[2] * after[2]) / length < 0.2) return true;
+		}
+		return false;
+	}
+
+	void collapse(const Candidate& candidate)
+	{
+		const uint32_t a = candidate.a, b = candidate.b;
+
+		// Link condition: the only vertices adjacent to both ends are the
+		// apexes of the triangles on the edge, else the surface pinches.
+		neighbours(a, m_scratchA);
+		neighbours(b, m_scratchB);
+		std::sort(m_scratchA.begin(), m_scratchA.end());
+		m_scratchA.erase(std::unique(m_scratchA.begin(), m_scratchA.end()), m_scratchA.end());
+		std::sort(m_scratchB.begin(), m_scratchB.end());
+		m_scratchB.erase(std::unique(m_scratchB.begin(), m_scratchB.end()), m_scratchB.end());
+		size_t common = 0, i = 0, j = 0;
+		while (i < m_scratchA.size() && j < m_scratchB.size()) {
+			if (m_scratchA[i] < m_scratchB[j]) i++;
+			else if (m_scratchA[i] > m_scratchB[j]) j++;
+			else { common++; i++; j++; }
+		}
+		if (common != (size_t)sharedTriangles(a, b)) return;
+
+		if (wouldFlip(a, b, candidate.position) || wouldFlip(b, a, candidate.position)) return;
+
+		// Move a, fold b into it, and drop the triangles on the edge.
+		m_x[a] = candidate.position[0];
+		m_y[a] = candidate.position[1];
+		m_z[a] = candidate.position[2];
+		quadric_add(m_quadrics[a], m_quadrics[b]);
+		m_maxError = (std::max)(m_maxError, candidate.cost);
+
+		std::vector<uint32_t>& aroundA = m_vertexTriangles[a];
+		const std::vector<uint32_t>& aroundB = m_vertexTriangles[b];
+		for (i = 0; i < aroundB.size(); i++) {
+			const uint32_t t = aroundB[i];
+			if (!m_triangleAlive[t]) continue;
+			if (triangleHas(t, a)) {
+				m_triangleAlive[t] = 0;
+				m_liveTriangles--;
+				continue;
+			}
+			int c;
+			for (c = 0; c < 3; c++) {
+				if (m_indices[3 * t + c] == b) m_indices[3 * t + c] = a;
+			}
+			aroundA.push_back(t);
+		}
+		std::vector<uint32_t>().swap(m_vertexTriangles[b]);
+		m_vertexAlive[b] = 0;
+
+		// Compact a's list, then re-cost every edge leaving a.
+		size_t kept = 0;
+		for (i = 0; i < aroundA.size(); i++) {
+			if (m_triangleAlive[aroundA[i]]) aroundA[kept++] = aroundA[i];
+		}
+		aroundA.resize(kept);
+		m_stamp[a]++;
+
+		neighbours(a, m_scratchA);
+		std::sort(m_scratchA.begin(), m_scratchA.end());
+		m_scratchA.erase(std::unique(m_scratchA.begin(), m_scratchA.end()), m_scratchA.end());
+		for (i = 0; i < m_scratchA.size(); i++) pushCandidate(a, m_scratchA[i]);
+	}
+
+	std::vector<float> m_x, m_y, m_z;
+	std::vector<uint32_t> m_indices;
+	std::vector<unsigned char> m_triangleAlive;
+	std::vector<unsigned char> m_vertexAlive;
+	std::vector<uint32_t> m_stamp;                          // Bumped whenever a vertex moves.
+	std::vector<std::vector<uint32_t> > m_vertexTriangles;
+	std::vector<Quadric> m_quadrics;
+	std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate> > m_queue;
+	size_t m_liveTriangles;
+	double m_maxError;
+	std::vector<uint32_t> m_scratchA, m_scratchB;
+};
+
+/*
+	Simplifies 'mesh' to each of 'fractions' (decreasing) of its triangle
+	count in one pass, so each level continues from the one before. Levels
+	get face normals for flat shading.
+*/
+inline void build_lod_chain(const Mesh& mesh, const float* fractions, int count, std::vector<MeshLod>& lods)
+{
+	lods.clear();
+	lods.resize(count);
+
+	double start = clock_seconds();
+	QemSimplifier simplifier;
+	simplifier.init(mesh);
+
+	int i;
+	for (i = 0; i < count; i++) {
+		simplifier.collapseTo((size_t)(mesh.triangleCount() * fractions[i]));
+		simplifier.extract(lods[i].mesh);
+		compute_face_normals(lods[i].mesh, lods[i].faceNormals);
+		lods[i].error = (float)simplifier.maxError();
+
+		const double end = clock_seconds();
+		lods[i].seconds = end - start;
+		start = end;
+	}
+}
+
+// Prints triangle reduction and build time per level.
+inline void print_lod_report(const char* name, size_t triangles, const std::vector<MeshLod>& lods)
+{
+	size_t i;
+	for (i = 0; i < lods.size(); i++) {
+		const MeshLod& lod = lods[i];
+		printf("LOD %u of '%s': %zu triangles (%.1f%% of %zu), %zu vertices, error %.2g, %.1f ms\n",
+			(unsigned)(i + 1), name, lod.mesh.triangleCount(), 100.0 * lod.mesh.triangleCount() / (std::max)(triangles, (size_t)1),
+			triangles, lod.mesh.vertexCount(), sqrt(lod.error), lod.seconds * 1e3);
+	}
+}
+
+// Largest distance of any vertex from the origin: the bounding sphere the
+// level selection uses (the scene rotates the mesh about the origin).
+inline float mesh_bounding_radius(const Mesh& mesh)
+{
+	float radius = 0.0f;
+	size_t i;
+	for (i = 0; i < mesh.vertexCount(); i++) {
+		const float x = mesh.positions.x[i], y = mesh.positions.y[i], z = mesh.positions.z[i];
+		radius = (std::max)(radius, x * x + y * y + z * z);
+	}
+	return sqrtf(radius);
+}
+
+// Screen pixels each triangle should cover before a coarser level is used.
+const float LOD_PIXELS_PER_TRIANGLE = 2.0f;
+
+/*
+	Picks the level to draw for a sphere of 'radius' at 'distance' from the
+	eye, seen through a perspective projection with vertical field of view
+	'fovy' (degrees) onto a viewport 'viewportHeight' pixels high: the
+	coarsest level that still has a triangle for every
+	LOD_PIXELS_PER_TRIANGLE pixels the sphere covers. triangleCounts[0] is
+	the full mesh; returns an index into it.
+*/
+inline int select_lod(const size_t* triangleCounts, int levels, float radius, float distance, float fovy, int viewportHeight)
+{
+	if (distance <= radius || levels < 2) return 0;
+	const float projected = radius / (distance * tanf(fovy * 3.14159265f / 360.0f)) * (0.5f * viewportHeight);
+	const float budget = 3.14159265f * projected * projected / LOD_PIXELS_PER_TRIANGLE;
+
+	int level = 0;
+	while (level + 1 < levels && (float)triangleCounts[level + 1] >= budget) level++;
+	return level;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+// Read-only memory mapping of a whole file.
+// The mapped bytes are NOT null-terminated and stay valid until close().
+class MappedFile
+{
+public:
+	MappedFile() : m_data(NULL), m_size(0), m_open(false)
+#ifdef _WIN32
+		, m_file(INVALID_HANDLE_VALUE), m_mapping(NULL)
+#endif
+	{
+	}
+
+	explicit MappedFile(const char* path) : MappedFile()
+	{
+		open(path);
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool open(const char* path)
+	{
+		close();
+
+#ifdef _WIN32
+		m_file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (m_file == INVALID_HANDLE_VALUE) return false;
+
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(m_file, &size)) { close(); return false; }
+		m_size = (size_t)size.QuadPart;
+		m_open = true;
+		if (m_size == 0) return true;  // Empty files cannot be mapped, but are valid.
+
+		m_mapping = CreateFileMappingA(m_file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (m_mapping == NULL) { close(); return false; }
+
+		m_data = (const char*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0);
+		if (m_data == NULL) { close(); return false; }
+#else
+		int fd = ::open(path, O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat st;
+		if (fstat(fd, &st) != 0) { ::close(fd); return false; }
+		m_size = (size_t)st.st_size;
+		m_open = true;
+		if (m_size == 0) { ::close(fd); return true; }
+
+		void* addr = mmap(NULL, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);  // The mapping keeps its own reference to the file.
+		if (addr == MAP_FAILED) { m_size = 0; m_open = false; return false; }
+
+		m_data = (const char*)addr;
+		madvise(addr, m_size, MADV_SEQUENTIAL);
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (m_data != NULL) UnmapViewOfFile(m_data);
+		if (m_mapping != NULL) CloseHandle(m_mapping);
+		if (m_file != INVALID_HANDLE_VALUE) CloseHandle(m_file);
+		m_mapping = NULL;
+		m_file = INVALID_HANDLE_VALUE;
+#else
+		if (m_data != NULL) munmap((void*)m_data, m_size);
+#endif
+		m_data = NULL;
+		m_size = 0;
+		m_open = false;
+	}
+
+	bool isOpen() const { return m_open; }
+	const char* data() const { return m_data; }
+	const char* end() const { return m_data + m_size; }
+	size_t size() const { return m_size; }
+
+private:
+	const char* m_data;
+	size_t m_size;
+	bool m_open;
+#ifdef _WIN32
+	HANDLE m_file;
+	HANDLE m_mapping;
+#endif
+};
+
+
+// Size and last-modification time of a file, used to tell whether derived
+// files (caches) are still up to date. The time is in platform ticks and is
+// only meant to be compared for equality.
+struct FileStamp
+{
+	unsigned long long size;
+	long long mtime;
+};
+
+inline bool get_file_stamp(const char* path, FileStamp& stamp)
+{
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA info;
+	if (!GetFileAttributesExA(path, GetFileExInfoStandard, &info)) return false;
+	stamp.size = ((unsigned long long)info.nFileSizeHigh << 32) | info.nFileSizeLow;
+	stamp.mtime = (long long)(((unsigned long long)info.ftLastWriteTime.dwHighDateTime << 32) | info.ftLastWriteTime.dwLowDateTime);
+#else
+	struct stat st;
+	if (stat(path, &st) != 0) return false;
+	stamp.size = (unsigned long long)st.st_size;
+#ifdef __linux__
+	stamp.mtime = (long long)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+#else
+	stamp.mtime = (long long)st.st_mtime;
+#endif
+#endif
+	return true;
+}
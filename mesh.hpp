@@ -0,0 +1,191 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <new>
+#include <vector>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+
+// Structure-of-arrays triangle mesh. Positions (and normals) are kept as
+// separate x/y/z arrays so the per-component loops stream through memory
+// and vectorise; every array starts on a 32-byte boundary (one AVX register).
+
+const size_t MESH_ALIGNMENT = 32;
+
+// Growable array of trivially copyable values in 32-byte-aligned storage.
+// The allocation is padded to a whole number of 32-byte blocks (zero-filled),
+// so SIMD loops may read a partial block past size().
+template <typename T>
+class AlignedArray
+{
+public:
+	AlignedArray() : m_data(NULL), m_size(0), m_capacity(0) {}
+	explicit AlignedArray(size_t size) : AlignedArray() { resize(size); }
+	AlignedArray(const AlignedArray& other) : AlignedArray() { *this = other; }
+	AlignedArray(AlignedArray&& other) : m_data(other.m_data), m_size(other.m_size), m_capacity(other.m_capacity)
+	{
+		other.m_data = NULL;
+		other.m_size = other.m_capacity = 0;
+	}
+	~AlignedArray() { release(); }
+
+	AlignedArray& operator=(const AlignedArray& other)
+	{
+		if (this != &other) {
+			resize(other.m_size);
+			if (m_size > 0) memcpy(m_data, other.m_data, m_size * sizeof(T));
+		}
+		return *this;
+	}
+
+	AlignedArray& operator=(AlignedArray&& other)
+	{
+		if (this != &other) {
+			release();
+			m_data = other.m_data;
+			m_size = other.m_size;
+			m_capacity = other.m_capacity;
+			other.m_data = NULL;
+			other.m_size = other.m_capacity = 0;
+		}
+		return *this;
+	}
+
+	// Keeps the existing elements; new elements are zero.
+	void resize(size_t size)
+	{
+		if (size > m_capacity) {
+			size_t capacity = (std::max)(size, m_capacity + m_capacity / 2);
+			size_t bytes = (capacity * sizeof(T) + MESH_ALIGNMENT - 1) / MESH_ALIGNMENT * MESH_ALIGNMENT;
+			T* data = (T*)allocate(bytes);
+			memset(data, 0, bytes);
+			if (m_size > 0) memcpy(data, m_data, m_size * sizeof(T));
+			free_aligned(m_data);
+			m_data = data;
+			m_capacity = bytes / sizeof(T);
+		} else if (size > m_size) {
+			memset(m_data + m_size, 0, (size - m_size) * sizeof(T));
+		}
+		m_size = size;
+	}
+
+	void clear() { m_size = 0; }
+	void release() { free_aligned(m_data); m_data = NULL; m_size = m_capacity = 0; }
+
+	size_t size() const { return m_size; }
+	bool empty() const { return m_size == 0; }
+	T* data() { return m_data; }
+	const T* data() const { return m_data; }
+	T& operator[](size_t i) { return m_data[i]; }
+	const T& operator[](size_t i) const { return m_data[i]; }
+
+private:
+	static void* allocate(size_t bytes)
+	{
+#ifdef _WIN32
+		void* p = _aligned_malloc(bytes, MESH_ALIGNMENT);
+#else
+		void* p = NULL;
+		if (posix_memalign(&p, MESH_ALIGNMENT, bytes) != 0) p = NULL;
+#endif
+		if (p == NULL) throw std::bad_alloc();
+		return p;
+	}
+
+	static void free_aligned(void* p)
+	{
+#ifdef _WIN32
+		_aligned_free(p);
+#else
+		free(p);
+#endif
+	}
+
+	T* m_data;
+	size_t m_size;
+	size_t m_capacity;
+};
+
+// Three parallel float arrays (positions or normals).
+struct Float3Array
+{
+	AlignedArray<float> x, y, z;
+
+	size_t size() const { return x.size(); }
+	bool empty() const { return x.empty(); }
+	void resize(size_t size) { x.resize(size); y.resize(size); z.resize(size); }
+	void release() { x.release(); y.release(); z.release(); }
+};
+
+struct Mesh
+{
+	Float3Array positions;
+	AlignedArray<uint32_t> indices;  // 0-based, three per triangle.
+
+	size_t vertexCount() const { return positions.size(); }
+	size_t triangleCount() const { return indices.size() / 3; }
+	void release() { positions.release(); indices.release(); }
+};
+
+/*
+	Converts load_obj() output (packed xyz, 1-based indices) to a Mesh.
+	Returns false if a face refers to a vertex that does not exist.
+*/
+inline bool mesh_from_obj(const std::vector<std::array<float, 3>>& vertices, const std::vector<std::array<int, 3>>& vertexIndices, Mesh& mesh)
+{
+	mesh.positions.resize(vertices.size());
+	mesh.indices.resize(vertexIndices.size() * 3);
+
+	size_t i;
+	for (i = 0; i < vertices.size(); i++) {
+		mesh.positions.x[i] = vertices[i][0];
+		mesh.positions.y[i] = vertices[i][1];
+		mesh.positions.z[i] = vertices[i][2];
+	}
+
+	bool valid = true;
+	const uint32_t vertexCount = (uint32_t)vertices.size();
+	for (i = 0; i < vertexIndices.size(); i++) {
+		int c;
+		for (c = 0; c < 3; c++) {
+			uint32_t index = (uint32_t)(vertexIndices[i][c] - 1);
+			if (index >= vertexCount) { index = 0; valid = false; }
+			mesh.indices[3 * i + c] = index;
+		}
+	}
+	return valid;
+}
+
+/*
+	Writes position and normal per vertex as px py pz nx ny nz, the layout the
+	GL vertex buffers use. 'out' must hold 6 * positions.size() floats.
+*/
+inline void interleave_positions_normals(const Float3Array& positions, const Float3Array& normals, float* out)
+{
+	const size_t count = positions.size();
+	const float* px = positions.x.data();
+	const float* py = positions.y.data();
+	const float* pz = positions.z.data();
+	const float* nx = normals.x.data();
+	const float* ny = normals.y.data();
+	const float* nz = normals.z.data();
+
+	size_t i;
+	for (i = 0; i < count; i++) {
+		float* v = out + 6 * i;
+		v[0] = px[i];
+		v[1] = py[i];
+		v[2] = pz[i];
+		v[3] = nx[i];
+		v[4] = ny[i];
+		v[5] = nz[i];
+	}
+}
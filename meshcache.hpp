@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include "mappedfile.hpp"
+#include "mesh.hpp"
+
+
+// Binary cache of a prepared mesh, stored next to the source as
+// "<source>.meshcache". Layout (little-endian, every section 4-byte aligned):
+//
+//    MeshCacheHeader
+//    float    positions x[vertexCount], y[vertexCount], z[vertexCount]   already normalised
+//    uint32_t indices[triangleCount][3]                                   0-based, clustered cache-optimised order
+//    float    normals x[triangleCount], y[triangleCount], z[triangleCount]   unit face normals
+//
+// The arrays are stored in the Mesh (structure-of-arrays) order, so loading
+// is one copy per array. The header records the size and mtime of the source
+// file and the preparation steps the mesh went through; the cache is only
+// used while the source still matches and the loader asks for the same
+// steps. Simplified levels of the mesh (see lod.hpp) are cached the same
+// way, one file per level.
+
+const uint32_t MESH_CACHE_MAGIC = 0x4853454D;  // "MESH"
+const uint32_t MESH_CACHE_VERSION = 5;
+
+// Preparation steps, recorded in MeshCacheHeader::steps.
+const uint32_t MESH_CACHE_NORMALISED = 1;  // Scaled into the [-1, 1] cube.
+const uint32_t MESH_CACHE_CLUSTERED = 2;   // cluster_mesh() order, optimised for the vertex cache and overdraw.
+const uint32_t MESH_CACHE_PREPARED = MESH_CACHE_NORMALISED | MESH_CACHE_CLUSTERED;
+
+struct MeshCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t vertexCount;
+	uint32_t triangleCount;
+	uint32_t steps;     // MESH_CACHE_* steps applied before saving.
+	uint32_t reserved;  // 0; keeps the 64-bit fields aligned.
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+};
+
+// "<source>.meshcache", or "<source>.lod<N>.meshcache" for level N > 0.
+inline std::string mesh_cache_path(const char* sourcePath, int lod = 0)
+{
+	if (lod == 0) return std::string(sourcePath) + ".meshcache";
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".lod%d.meshcache", lod);
+	return std::string(sourcePath) + suffix;
+}
+
+/*
+	Loads the cache for 'sourcePath' if it exists, is up to date and went
+	through exactly the preparation 'steps'. Returns false (leaving the
+	outputs untouched) when the cache is missing, stale, prepared
+	differently or malformed.
+*/
+inline bool load_mesh_cache(const char* sourcePath, Mesh& mesh, Float3Array& faceNormals, uint32_t steps, int lod = 0)
+{
+	FileStamp stamp;
+	if (!get_file_stamp(sourcePath, stamp)) return false;
+
+	std::string cachePath = mesh_cache_path(sourcePath, lod);
+	MappedFile file(cachePath.c_str());
+	if (!file.isOpen() || file.size() < sizeof(MeshCacheHeader)) return false;
+
+	MeshCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION) return false;
+	if (header.sourceSize != stamp.size || header.sourceMtime != stamp.mtime) {
+		printf("Mesh cache '%s' is stale.\n", cachePath.c_str());
+		return false;
+	}
+	if (header.steps != steps) {
+		printf("Mesh cache '%s' was prepared differently.\n", cachePath.c_str());
+		return false;
+	}
+
+	const size_t vertexBytes = (size_t)header.vertexCount * sizeof(float);
+	const size_t indexBytes = (size_t)header.triangleCount * 3 * sizeof(uint32_t);
+	const size_t normalBytes = (size_t)header.triangleCount * sizeof(float);
+	if (file.size() != sizeof(header) + 3 * vertexBytes + indexBytes + 3 * normalBytes) return false;
+
+	const char* p = file.data() + sizeof(header);
+	const uint32_t* indices = (const uint32_t*)(p + 3 * vertexBytes);
+	size_t i;
+	for (i = 0; i < (size_t)header.triangleCount * 3; i++) {
+		if (indices[i] >= header.vertexCount) return false;
+	}
+
+	Mesh loaded;
+	Float3Array normals;
+	loaded.positions.resize(header.vertexCount);
+	loaded.indices.resize((size_t)header.triangleCount * 3);
+	normals.resize(header.triangleCount);
+
+	float* destinations[3] = { loaded.positions.x.data(), loaded.positions.y.data(), loaded.positions.z.data() };
+	int k;
+	for (k = 0; k < 3; k++, p += vertexBytes) {
+		if (vertexBytes > 0) memcpy(destinations[k], p, vertexBytes);
+	}
+	if (indexBytes > 0) memcpy(loaded.indices.data(), p, indexBytes);
+	p += indexBytes;
+	float* normalDestinations[3] = { normals.x.data(), normals.y.data(), normals.z.data() };
+	for (k = 0; k < 3; k++, p += normalBytes) {
+		if (normalBytes > 0) memcpy(normalDestinations[k], p, normalBytes);
+	}
+
+	mesh = std::move(loaded);
+	faceNormals = std::move(normals);
+
+	printf("Loaded mesh cache '%s'.\n", cachePath.c_str());
+	return true;
+}
+
+/*
+	Writes the cache for 'sourcePath', recording the preparation 'steps' the
+	mesh went through. The file is written under a temporary name and
+	renamed, so a crash never leaves a truncated cache behind.
+*/
+inline bool save_mesh_cache(const char* sourcePath, const Mesh& mesh, const Float3Array& faceNormals, uint32_t steps, int lod = 0)
+{
+	FileStamp stamp;
+	if (!get_file_stamp(sourcePath, stamp)) return false;
+
+	MeshCacheHeader header;
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexCount = (uint32_t)mesh.vertexCount();
+	header.triangleCount = (uint32_t)mesh.triangleCount();
+	header.steps = steps;
+	header.reserved = 0;
+	header.sourceSize = stamp.size;
+	header.sourceMtime = stamp.mtime;
+
+	std::string cachePath = mesh_cache_path(sourcePath, lod);
+	std::string tempPath = cachePath + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL) {
+		printf("Could not write mesh cache '%s'.\n", cachePath.c_str());
+		return false;
+	}
+
+	const AlignedArray<float>* sections[] = { &mesh.positions.x, &mesh.positions.y, &mesh.positions.z };
+	const AlignedArray<float>* normalSections[] = { &faceNormals.x, &faceNormals.y, &faceNormals.z };
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	int k;
+	for (k = 0; k < 3; k++) {
+		if (ok && !sections[k]->empty()) ok = fwrite(sections[k]->data(), sizeof(float), sections[k]->size(), file) == sections[k]->size();
+	}
+	if (ok && !mesh.indices.empty()) ok = fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size();
+	for (k = 0; k < 3; k++) {
+		if (ok && !normalSections[k]->empty()) ok = fwrite(normalSections[k]->data(), sizeof(float), normalSections[k]->size(), file) == normalSections[k]->size();
+	}
+	ok = fclose(file) == 0 && ok;
+
+	remove(cachePath.c_str());  // rename() does not replace existing files on Windows.
+	if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		remove(tempPath.c_str());
+		printf("Could not write mesh cache '%s'.\n", cachePath.c_str());
+		return false;
+	}
+	return true;
+}
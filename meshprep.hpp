@@ -0,0 +1,162 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+#include "mesh.hpp"
+#include "simdbounds.hpp"
+
+
+// Mesh preparation steps run once after loading, so that display() only has
+// to submit data.
+
+/*
+	Componentwise bounds of the mesh positions (all zero for an empty mesh).
+*/
+inline void mesh_bounds(const Mesh& mesh, float minimum[3], float maximum[3], SimdLevel level = simd_level())
+{
+	const float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+	int k;
+	for (k = 0; k < 3; k++) {
+		minimum[k] = maximum[k] = mesh.vertexCount() > 0 ? arrays[k][0] : 0.0f;
+		bounds_array(arrays[k], mesh.vertexCount(), minimum[k], maximum[k], level);
+	}
+}
+
+/*
+	Scales the vertices to fit in the [-1,1] cube, keeping the aspect ratio.
+	One min/max pass per array, then one fused scale-and-bias pass.
+*/
+inline void mesh_normalise(Mesh& mesh, SimdLevel level = simd_level())
+{
+	if (mesh.vertexCount() == 0) return;
+
+	float minimum[3], maximum[3];
+	mesh_bounds(mesh, minimum, maximum, level);
+
+	float range = (std::max)((std::max)(maximum[0] - minimum[0], maximum[2] - minimum[2]), maximum[1] - minimum[1]);
+	if (range <= 0) range = 1;
+
+	float scale = 2 / range;
+	float* arrays[3] = { mesh.positions.x.data(), mesh.positions.y.data(), mesh.positions.z.data() };
+	int k;
+	for (k = 0; k < 3; k++)
+		scale_bias_array(arrays[k], mesh.vertexCount(), scale, -minimum[k] * scale - 1, level);
+}
+
+/*
+	Unit surface normal of every triangle (cross product of two edges).
+	Degenerate triangles get a zero normal.
+*/
+inline void compute_face_normals(const Mesh& mesh, Float3Array& faceNormals)
+{
+	const size_t triangles = mesh.triangleCount();
+	faceNormals.resize(triangles);
+
+	const float* px = mesh.positions.x.data();
+	const float* py = mesh.positions.y.data();
+	const float* pz = mesh.positions.z.data();
+	const uint32_t* indices = mesh.indices.data();
+	float* outX = faceNormals.x.data();
+	float* outY = faceNormals.y.data();
+	float* outZ = faceNormals.z.data();
+
+	size_t i;
+	for (i = 0; i < triangles; i++) {
+		const uint32_t a = indices[3 * i], b = indices[3 * i + 1], c = indices[3 * i + 2];
+
+		float vx = px[b] - px[a], vy = py[b] - py[a], vz = pz[b] - pz[a];
+		float wx = px[c] - px[a], wy = py[c] - py[a], wz = pz[c] - pz[a];
+
+		float nx = (vy * wz) - (vz * wy);
+		float ny = (vz * wx) - (vx * wz);
+		float nz = (vx * wy) - (vy * wx);
+
+		float length = sqrtf(nx * nx + ny * ny + nz * nz);
+		float scale = length > 0 ? 1.0f / length : 0.0f;
+		outX[i] = nx * scale;
+		outY[i] = ny * scale;
+		outZ[i] = nz * scale;
+	}
+}
+
+// How face normals are blended into smooth per-vertex normals.
+enum NormalWeighting
+{
+	NORMALS_AREA_WEIGHTED,   // Larger triangles count more.
+	NORMALS_ANGLE_WEIGHTED   // Each face counts by its corner angle at the vertex; independent of tessellation.
+};
+
+// Angle between the edge vectors u and v leaving a triangle corner.
+inline float corner_angle(float ux, float uy, float uz, float vx, float vy, float vz)
+{
+	float lengths = sqrtf((ux * ux + uy * uy + uz * uz) * (vx * vx + vy * vy + vz * vz));
+	if (lengths <= 0) return 0.0f;
+	float cosine = (ux * vx + uy * vy + uz * vz) / lengths;
+	return acosf((std::max)(-1.0f, (std::min)(1.0f, cosine)));
+}
+
+/*
+	Smooth unit normal of every vertex, blended from the normals of the faces
+	around it. Vertices not used by any face get a zero normal.
+*/
+inline void compute_vertex_normals(const Mesh& mesh, NormalWeighting weighting, Float3Array& vertexNormals)
+{
+	// Sums are scattered to three vertices per face, so they are gathered in
+	// packed xyz (12 bytes per vertex, so its three sums usually share a
+	// cache line instead of touching three) and only split into the
+	// separate arrays by the final normalising pass.
+	std::vector<float> sums(mesh.vertexCount() * 3, 0.0f);
+
+	const float* px = mesh.positions.x.data();
+	const float* py = mesh.positions.y.data();
+	const float* pz = mesh.positions.z.data();
+	const uint32_t* indices = mesh.indices.data();
+
+	size_t i;
+	for (i = 0; i < mesh.triangleCount(); i++) {
+		const uint32_t p[3] = { indices[3 * i], indices[3 * i + 1], indices[3 * i + 2] };
+
+		// Edge vectors a->b, a->c and b->c.
+		float abx = px[p[1]] - px[p[0]], aby = py[p[1]] - py[p[0]], abz = pz[p[1]] - pz[p[0]];
+		float acx = px[p[2]] - px[p[0]], acy = py[p[2]] - py[p[0]], acz = pz[p[2]] - pz[p[0]];
+		float bcx = px[p[2]] - px[p[1]], bcy = py[p[2]] - py[p[1]], bcz = pz[p[2]] - pz[p[1]];
+
+		// The cross product's length is twice the triangle's area.
+		float fx = (aby * acz) - (abz * acy);
+		float fy = (abz * acx) - (abx * acz);
+		float fz = (abx * acy) - (aby * acx);
+
+		float weights[3] = { 1.0f, 1.0f, 1.0f };
+		if (weighting == NORMALS_ANGLE_WEIGHTED) {
+			float length = sqrtf(fx * fx + fy * fy + fz * fz);
+			if (length <= 0) continue;
+			weights[0] = corner_angle(abx, aby, abz, acx, acy, acz) / length;
+			weights[1] = corner_angle(-abx, -aby, -abz, bcx, bcy, bcz) / length;
+			weights[2] = corner_angle(-acx, -acy, -acz, -bcx, -bcy, -bcz) / length;
+		}
+
+		int c;
+		for (c = 0; c < 3; c++) {
+			float* sum = &sums[3 * p[c]];
+			sum[0] += fx * weights[c];
+			sum[1] += fy * weights[c];
+			sum[2] += fz * weights[c];
+		}
+	}
+
+	vertexNormals.resize(mesh.vertexCount());
+	float* nx = vertexNormals.x.data();
+	float* ny = vertexNormals.y.data();
+	float* nz = vertexNormals.z.data();
+	for (i = 0; i < mesh.vertexCount(); i++) {
+		const float* sum = &sums[3 * i];
+		float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] + sum[2] * sum[2]);
+		float scale = length > 0 ? 1.0f / length : 0.0f;
+		nx[i] = sum[0] * scale;
+		ny[i] = sum[1] * scale;
+		nz[i] = sum[2] * scale;
+	}
+}
@@ -0,0 +1,425 @@
+#pragma once
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "mappedfile.hpp"
+#include "simdbounds.hpp"
+
+
+// CPU mipmap pyramids for 8-bit sRGB images (interleaved channels, top row
+// first, as PpmImage provides them).
+//
+// Filtering happens in linear light: the base level is decoded once into
+// one float plane per channel, every level is reduced from the previous
+// one, and each result is encoded back to 8-bit sRGB. Averaging the 8-bit
+// values directly would darken every level (most visibly on high-contrast
+// detail like the mandrill's whiskers).
+
+enum MipFilter { MIP_FILTER_BOX, MIP_FILTER_KAISER };
+
+inline const char* mip_filter_name(MipFilter filter)
+{
+	return filter == MIP_FILTER_KAISER ? "kaiser" : "box";
+}
+
+// Filter named by the MIP_FILTER environment variable ("box" or "kaiser"),
+// box by default.
+inline MipFilter mip_filter_from_env()
+{
+	const char* name = getenv("MIP_FILTER");
+	return name != NULL && strcmp(name, "kaiser") == 0 ? MIP_FILTER_KAISER : MIP_FILTER_BOX;
+}
+
+struct MipLevel
+{
+	int width;
+	int height;
+	std::vector<unsigned char> pixels;   // Interleaved channels, rows packed (or BC1 blocks, see texformat.hpp).
+};
+
+inline double srgb_decode(double c)
+{
+	return c <= 0.04045 ? c / 12.92 : pow((c + 0.055) / 1.055, 2.4);
+}
+
+const int SRGB_ENCODE_BUCKETS = 16384;
+
+/*
+	Conversion tables, built once (thread-safely) on first use. Encoding
+	looks up the code at the start of the value's bucket and steps past any
+	threshold inside it; buckets are narrower than the gap between any two
+	thresholds, so that is at most one step.
+*/
+struct SrgbTables
+{
+	float toLinear[256];                              // sRGB code value -> linear intensity.
+	float thresholds[255];                            // Linear value halfway (in sRGB) between codes i and i + 1.
+	unsigned char encodeStart[SRGB_ENCODE_BUCKETS];   // Code for linear value bucket / SRGB_ENCODE_BUCKETS.
+
+	SrgbTables()
+	{
+		int i;
+		for (i = 0; i < 256; i++) toLinear[i] = (float)srgb_decode(i / 255.0);
+		for (i = 0; i < 255; i++) thresholds[i] = (float)srgb_decode((i + 0.5) / 255.0);
+		for (i = 0; i < SRGB_ENCODE_BUCKETS; i++) {
+			encodeStart[i] = (unsigned char)(std::upper_bound(thresholds, thresholds + 255, (float)i / SRGB_ENCODE_BUCKETS) - thresholds);
+		}
+	}
+};
+
+inline const SrgbTables& srgb_tables()
+{
+	static const SrgbTables tables;
+	return tables;
+}
+
+// Linear intensity -> nearest sRGB code value, rounding exactly as encoding
+// with pow() and rounding would.
+inline unsigned char linear_to_srgb(float value)
+{
+	if (!(value > 0.0f)) return 0;
+	if (value >= 1.0f) return 255;
+	const SrgbTables& tables = srgb_tables();
+	int code = tables.encodeStart[(int)(value * SRGB_ENCODE_BUCKETS)];
+	while (code < 255 && tables.thresholds[code] <= value) code++;
+	return (unsigned char)code;
+}
+
+// out[x] = average of the 2x2 block at (2x, 2x + 1) in row0 and row1.
+inline void mip_box_row_scalar(const float* row0, const float* row1, float* out, int outWidth)
+{
+	int x;
+	for (x = 0; x < outWidth; x++) out[x] = ((row0[2 * x] + row0[2 * x + 1]) + (row1[2 * x] + row1[2 * x + 1])) * 0.25f;
+}
+
+#ifdef SIMD_X86
+
+// Even and odd columns are separated with shuffles, so the sums happen in
+// the same order as the scalar version and the results are identical.
+SIMD_TARGET_SSE2 inline void mip_box_row_sse2(const float* row0, const float* row1, float* out, int outWidth)
+{
+	const __m128 quarter = _mm_set1_ps(0.25f);
+	const int blocks = outWidth / 4;
+	int b;
+	for (b = 0; b < blocks; b++) {
+		const __m128 a0 = _mm_loadu_ps(row0 + 8 * b), b0 = _mm_loadu_ps(row0 + 8 * b + 4);
+		const __m128 a1 = _mm_loadu_ps(row1 + 8 * b), b1 = _mm_loadu_ps(row1 + 8 * b + 4);
+		const __m128 h0 = _mm_add_ps(_mm_shuffle_ps(a0, b0, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a0, b0, _MM_SHUFFLE(3, 1, 3, 1)));
+		const __m128 h1 = _mm_add_ps(_mm_shuffle_ps(a1, b1, _MM_SHUFFLE(2, 0, 2, 0)), _mm_shuffle_ps(a1, b1, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm_storeu_ps(out + 4 * b, _mm_mul_ps(_mm_add_ps(h0, h1), quarter));
+	}
+	mip_box_row_scalar(row0 + 8 * blocks, row1 + 8 * blocks, out + 4 * blocks, outWidth - 4 * blocks);
+}
+
+SIMD_TARGET_AVX inline void mip_box_row_avx(const float* row0, const float* row1, float* out, int outWidth)
+{
+	const __m256 quarter = _mm256_set1_ps(0.25f);
+	const int blocks = outWidth / 8;
+	int b;
+	for (b = 0; b < blocks; b++) {
+		const __m256 a0 = _mm256_loadu_ps(row0 + 16 * b), b0 = _mm256_loadu_ps(row0 + 16 * b + 8);
+		const __m256 a1 = _mm256_loadu_ps(row1 + 16 * b), b1 = _mm256_loadu_ps(row1 + 16 * b + 8);
+		// Regroup 128-bit halves so the in-lane shuffles yield columns in order.
+		const __m256 lo0 = _mm256_permute2f128_ps(a0, b0, 0x20), hi0 = _mm256_permute2f128_ps(a0, b0, 0x31);
+		const __m256 lo1 = _mm256_permute2f128_ps(a1, b1, 0x20), hi1 = _mm256_permute2f128_ps(a1, b1, 0x31);
+		const __m256 h0 = _mm256_add_ps(_mm256_shuffle_ps(lo0, hi0, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(lo0, hi0, _MM_SHUFFLE(3, 1, 3, 1)));
+		const __m256 h1 = _mm256_add_ps(_mm256_shuffle_ps(lo1, hi1, _MM_SHUFFLE(2, 0, 2, 0)), _mm256_shuffle_ps(lo1, hi1, _MM_SHUFFLE(3, 1, 3, 1)));
+		_mm256_storeu_ps(out + 8 * b, _mm256_mul_ps(_mm256_add_ps(h0, h1), quarter));
+	}
+	_mm256_zeroupper();
+	mip_box_row_scalar(row0 + 16 * blocks, row1 + 16 * blocks, out + 8 * blocks, outWidth - 8 * blocks);
+}
+
+#endif
+
+inline void mip_box_row(const float* row0, const float* row1, float* out, int outWidth, SimdLevel level = simd_level())
+{
+#ifdef SIMD_X86
+	if (level == SIMD_AVX) { mip_box_row_avx(row0, row1, out, outWidth); return; }
+	if (level == SIMD_SSE2) { mip_box_row_sse2(row0, row1, out, outWidth); return; }
+#endif
+	mip_box_row_scalar(row0, row1, out, outWidth);
+}
+
+/*
+	Halves one plane with the 2x2 box filter. An odd last row or column is
+	dropped; a side of 1 is averaged with itself.
+*/
+inline void mip_box_plane(const float* src, int width, int height, float* dst, SimdLevel level = simd_level())
+{
+	const int outWidth = (std::max)(1, width / 2), outHeight = (std::max)(1, height / 2);
+	int y;
+	for (y = 0; y < outHeight; y++) {
+		const float* row0 = src + (size_t)(2 * y) * width;
+		const float* row1 = src + (size_t)(std::min)(2 * y + 1, height - 1) * width;
+		if (width == 1) {
+			dst[y] = ((row0[0] + row0[0]) + (row1[0] + row1[0])) * 0.25f;
+			continue;
+		}
+		mip_box_row(row0, row1, dst + (size_t)y * outWidth, outWidth, level);
+	}
+}
+
+// Zeroth-order modified Bessel function of the first kind (series).
+inline double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+	int k;
+	for (k = 1; k < 25; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+	}
+	return sum;
+}
+
+/*
+	Kaiser-windowed sinc for halving: 8 taps, alpha = 4. Keeps more detail
+	than the box filter without its blockiness, at a few times the cost.
+	weights[k] applies to source column 2x - 3 + k of output column x.
+*/
+struct MipKaiserKernel
+{
+	float weights[8];
+
+	MipKaiserKernel()
+	{
+		const double pi = 3.14159265358979, alpha = 4.0;
+		double total = 0.0;
+		int k;
+		for (k = 0; k < 8; k++) {
+			// Source column centre relative to the output centre, in output pixels.
+			double t = (k - 3.5) / 2.0;
+			double r = t / 2.0;
+			double window = bessel_i0(alpha * sqrt((std::max)(0.0, 1.0 - r * r))) / bessel_i0(alpha);
+			weights[k] = (float)(sin(pi * t) / (pi * t) * window);
+			total += weights[k];
+		}
+		for (k = 0; k < 8; k++) weights[k] = (float)(weights[k] / total);
+	}
+};
+
+inline const float* mip_kaiser_weights()
+{
+	static const MipKaiserKernel kernel;
+	return kernel.weights;
+}
+
+// Halves one plane with the separable Kaiser filter, clamping at the edges.
+inline void mip_kaiser_plane(const float* src, int width, int height, float* dst)
+{
+	const int outWidth = (std::max)(1, width / 2), outHeight = (std::max)(1, height / 2);
+	const float* weights = mip_kaiser_weights();
+	std::vector<float> rows((size_t)outWidth * height);
+
+	int x, y, k;
+	for (y = 0; y < height; y++) {
+		const float* in = src + (size_t)y * width;
+		float* out = &rows[(size_t)y * outWidth];
+		for (x = 0; x < outWidth; x++) {
+			float sum = 0.0f;
+			for (k = 0; k < 8; k++) sum += weights[k] * in[(std::min)((std::max)(2 * x - 3 + k, 0), width - 1)];
+			out[x] = sum;
+		}
+	}
+	for (y = 0; y < outHeight; y++) {
+		float* out = dst + (size_t)y * outWidth;
+		for (x = 0; x < outWidth; x++) out[x] = 0.0f;
+		for (k = 0; k < 8; k++) {
+			const float* in = &rows[(size_t)(std::min)((std::max)(2 * y - 3 + k, 0), height - 1) * outWidth];
+			for (x = 0; x < outWidth; x++) out[x] += weights[k] * in[x];
+		}
+		// The negative lobes can overshoot.
+		for (x = 0; x < outWidth; x++) out[x] = (std::min)((std::max)(out[x], 0.0f), 1.0f);
+	}
+}
+
+/*
+	Builds the full pyramid, down to 1x1, from an 8-bit sRGB image with
+	'channels' interleaved channels. levels[0] is a copy of the image.
+*/
+inline void build_mipmaps(const unsigned char* pixels, int width, int height, int channels, MipFilter filter, std::vector<MipLevel>& levels, SimdLevel level = simd_level())
+{
+	levels.clear();
+	levels.resize(1);
+	levels[0].width = width;
+	levels[0].height = height;
+	levels[0].pixels.assign(pixels, pixels + (size_t)width * height * channels);
+
+	const float* toLinear = srgb_tables().toLinear;
+	std::vector<std::vector<float> > planes(channels), next(channels);
+	size_t i;
+	int c;
+	for (c = 0; c < channels; c++) {
+		planes[c].resize((size_t)width * height);
+		for (i = 0; i < planes[c].size(); i++) planes[c][i] = toLinear[pixels[i * channels + c]];
+	}
+
+	while (width > 1 || height > 1) {
+		const int outWidth = (std::max)(1, width / 2), outHeight = (std::max)(1, height / 2);
+		MipLevel mip;
+		mip.width = outWidth;
+		mip.height = outHeight;
+		mip.pixels.resize((size_t)outWidth * outHeight * channels);
+
+		for (c = 0; c < channels; c++) {
+			next[c].resize((size_t)outWidth * outHeight);
+			if (filter == MIP_FILTER_KAISER) mip_kaiser_plane(&planes[c][0], width, height, &next[c][0]);
+			else mip_box_plane(&planes[c][0], width, height, &next[c][0], level);
+			for (i = 0; i < next[c].size(); i++) mip.pixels[i * channels + c] = linear_to_srgb(next[c][i]);
+		}
+
+		planes.swap(next);
+		width = outWidth;
+		height = outHeight;
+		levels.push_back(std::move(mip));
+	}
+}
+
+
+// Pyramid cache stored next to the source image as "<source>.mipcache":
+// a MipCacheHeader followed by every level's data, largest first. Levels
+// are either raw pixels or BC1 blocks (see texformat.hpp), so compressed
+// textures skip the encoder on later runs too. Like the mesh cache it is
+// only used while the source size and mtime match.
+
+const uint32_t MIP_CACHE_MAGIC = 0x5350494D;  // "MIPS"
+const uint32_t MIP_CACHE_VERSION = 2;
+
+enum MipEncoding { MIP_ENCODING_RAW, MIP_ENCODING_BC1 };
+
+// Bytes of one level: packed pixels, or 8 bytes per 4x4 block for BC1.
+inline size_t mip_level_bytes(int width, int height, int channels, MipEncoding encoding)
+{
+	if (encoding == MIP_ENCODING_BC1) return (size_t)((width + 3) / 4) * ((height + 3) / 4) * 8;
+	return (size_t)width * height * channels;
+}
+
+struct MipCacheHeader
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t filter;
+	uint32_t channels;
+	uint32_t width;
+	uint32_t height;
+	uint32_t levelCount;
+	uint32_t encoding;
+	uint64_t sourceSize;
+	int64_t sourceMtime;
+};
+
+inline std::string mip_cache_path(const char* sourcePath)
+{
+	return std::string(sourcePath) + ".mipcache";
+}
+
+// Level count and total bytes of a full pyramid.
+inline size_t mip_pyramid_bytes(int width, int height, int channels, MipEncoding encoding, uint32_t& levelCount)
+{
+	size_t bytes = 0;
+	levelCount = 0;
+	while (true) {
+		bytes += mip_level_bytes(width, height, channels, encoding);
+		levelCount++;
+		if (width == 1 && height == 1) break;
+		width = (std::max)(1, width / 2);
+		height = (std::max)(1, height / 2);
+	}
+	return bytes;
+}
+
+/*
+	Loads the cached pyramid for 'sourcePath' built with 'filter' and stored
+	with 'encoding'. Returns false when the cache is missing, stale, built
+	another way or malformed.
+*/
+inline bool load_mip_cache(const char* sourcePath, MipFilter filter, MipEncoding encoding, int& channels, std::vector<MipLevel>& levels)
+{
+	FileStamp stamp;
+	if (!get_file_stamp(sourcePath, stamp)) return false;
+
+	std::string cachePath = mip_cache_path(sourcePath);
+	MappedFile file(cachePath.c_str());
+	if (!file.isOpen() || file.size() < sizeof(MipCacheHeader)) return false;
+
+	MipCacheHeader header;
+	memcpy(&header, file.data(), sizeof(header));
+	if (header.magic != MIP_CACHE_MAGIC || header.version != MIP_CACHE_VERSION || header.filter != (uint32_t)filter || header.encoding != (uint32_t)encoding) return false;
+	if (header.sourceSize != stamp.size || header.sourceMtime != stamp.mtime) {
+		printf("Mipmap cache '%s' is stale.\n", cachePath.c_str());
+		return false;
+	}
+	if (header.width < 1 || header.height < 1 || header.width > 65536 || header.height > 65536 || (header.channels != 1 && header.channels != 3)) return false;
+
+	uint32_t levelCount;
+	size_t bytes = mip_pyramid_bytes(header.width, header.height, header.channels, encoding, levelCount);
+	if (header.levelCount != levelCount || file.size() != sizeof(header) + bytes) return false;
+
+	std::vector<MipLevel> loaded(levelCount);
+	const unsigned char* p = (const unsigned char*)file.data() + sizeof(header);
+	int w = header.width, h = header.height;
+	uint32_t i;
+	for (i = 0; i < levelCount; i++) {
+		size_t size = mip_level_bytes(w, h, header.channels, encoding);
+		loaded[i].width = w;
+		loaded[i].height = h;
+		loaded[i].pixels.assign(p, p + size);
+		p += size;
+		w = (std::max)(1, w / 2);
+		h = (std::max)(1, h / 2);
+	}
+
+	channels = header.channels;
+	levels.swap(loaded);
+	printf("Loaded mipmap cache '%s'.\n", cachePath.c_str());
+	return true;
+}
+
+// Writes the pyramid cache for 'sourcePath' (temporary file, then rename).
+inline bool save_mip_cache(const char* sourcePath, MipFilter filter, MipEncoding encoding, int channels, const std::vector<MipLevel>& levels)
+{
+	FileStamp stamp;
+	if (levels.empty() || !get_file_stamp(sourcePath, stamp)) return false;
+
+	MipCacheHeader header;
+	header.magic = MIP_CACHE_MAGIC;
+	header.version = MIP_CACHE_VERSION;
+	header.filter = (uint32_t)filter;
+	header.channels = (uint32_t)channels;
+	header.width = (uint32_t)levels[0].width;
+	header.height = (uint32_t)levels[0].height;
+	header.levelCount = (uint32_t)levels.size();
+	header.encoding = (uint32_t)encoding;
+	header.sourceSize = stamp.size;
+	header.sourceMtime = stamp.mtime;
+
+	std::string cachePath = mip_cache_path(sourcePath);
+	std::string tempPath = cachePath + ".tmp";
+	FILE* file = fopen(tempPath.c_str(), "wb");
+	if (file == NULL) {
+		printf("Could not write mipmap cache '%s'.\n", cachePath.c_str());
+		return false;
+	}
+
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	size_t i;
+	for (i = 0; ok && i < levels.size(); i++) {
+		ok = fwrite(&levels[i].pixels[0], 1, levels[i].pixels.size(), file) == levels[i].pixels.size();
+	}
+	ok = fclose(file) == 0 && ok;
+
+	remove(cachePath.c_str());  // rename() does not replace existing files on Windows.
+	if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0) {
+		remove(tempPath.c_str());
+		printf("Could not write mipmap cache '%s'.\n", cachePath.c_str());
+		return false;
+	}
+	return true;
+}
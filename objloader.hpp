@@ -1,8 +1,12 @@
 #pragma once
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <array>
 #include <vector>
+#include "mappedfile.hpp"
+#include "threadpool.hpp"
 
 
 // Very, VERY simple OBJ loader.
@@ -54,3 +58,271 @@ inline bool load_obj(const char* path, std::vector<std::array<float, 3>>& vertic
 	printf("Done.\n");
 	return true;
 }
+
+
+// Hand-written scanners used by load_obj_mapped(). They work directly on the
+// mapped file (which is not null-terminated), so every read checks 'end'.
+inline bool obj_is_blank(char c)
+{
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+inline const char* obj_skip_blanks(const char* p, const char* end)
+{
+	while (p < end && obj_is_blank(*p)) p++;
+	return p;
+}
+
+inline const char* obj_skip_line(const char* p, const char* end)
+{
+	const char* eol = (const char*)memchr(p, '\n', end - p);
+	return eol ? eol + 1 : end;
+}
+
+// Parses a decimal float. Numbers with at most 7 significant digits and a
+// small exponent (all of ours) take the exact fast path: one correctly rounded
+// float division or multiplication. Anything else falls back to strtof(), so
+// the result is always bit-identical to what fscanf("%f") produces.
+inline const char* obj_parse_float(const char* p, const char* end, float& out)
+{
+	static const float powers[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+
+	const char* start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+
+	unsigned long long mantissa = 0;
+	int digits = 0, exponent = 0;
+	bool any = false;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (mantissa != 0 || *p != '0') digits++;
+		if (digits <= 19) mantissa = mantissa * 10 + (*p - '0'); else exponent++;
+		p++; any = true;
+	}
+	if (p < end && *p == '.') {
+		p++;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (mantissa != 0 || *p != '0') digits++;
+			if (digits <= 19) { mantissa = mantissa * 10 + (*p - '0'); exponent--; }
+			p++; any = true;
+		}
+	}
+	if (any && p < end && (*p == 'e' || *p == 'E')) {
+		const char* q = p + 1;
+		bool negExp = false;
+		if (q < end && (*q == '-' || *q == '+')) negExp = (*q++ == '-');
+		if (q < end && *q >= '0' && *q <= '9') {
+			int e = 0;
+			while (q < end && *q >= '0' && *q <= '9') { if (e < 10000) e = e * 10 + (*q - '0'); q++; }
+			exponent += negExp ? -e : e;
+			p = q;
+		}
+	}
+
+	if (any && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10) {
+		float value = (float)mantissa;
+		value = exponent < 0 ? value / powers[-exponent] : value * powers[exponent];
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// Slow path: inf/nan, long mantissas, large exponents.
+	char buffer[64];
+	size_t length = 0;
+	p = start;
+	while (p < end && !obj_is_blank(*p) && *p != '\n' && length < sizeof(buffer) - 1) buffer[length++] = *p++;
+	buffer[length] = '\0';
+	char* parsedEnd;
+	out = strtof(buffer, &parsedEnd);
+	if (parsedEnd == buffer) return NULL;
+	return start + (parsedEnd - buffer);
+}
+
+// Parses a decimal integer.
+inline const char* obj_parse_int(const char* p, const char* end, int& out)
+{
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) negative = (*p++ == '-');
+	if (p == end || *p < '0' || *p > '9') return NULL;
+
+	int value = 0;
+	while (p < end && *p >= '0' && *p <= '9') value = value * 10 + (*p++ - '0');
+	out = negative ? -value : value;
+	return p;
+}
+
+// Parses the v/f records in [p, end), which must start at a line boundary.
+// Polygons are fan-triangulated and texture/normal references ("1/2/3") are
+// skipped. Negative face indices are relative to the vertices seen so far,
+// counted from 'vertexBase'. Returns the number of relative indices found.
+inline size_t obj_parse_records(const char* p, const char* end, std::vector<std::array<float, 3>>& vertices, std::vector<std::array<int, 3>>& vertexIndices, int vertexBase)
+{
+	size_t relative = 0;
+	const int firstVertex = (int)vertices.size();
+
+	while (p < end)
+	{
+		p = obj_skip_blanks(p, end);
+		if (p + 1 >= end || !obj_is_blank(p[1]) || (p[0] != 'v' && p[0] != 'f'))
+		{
+			p = obj_skip_line(p, end);
+			continue;
+		}
+
+		const char* q = p + 1;
+		if (p[0] == 'v')
+		{
+			std::array<float, 3> vertex;
+			int i;
+			for (i = 0; i < 3 && q != NULL; i++) {
+				q = obj_skip_blanks(q, end);
+				q = obj_parse_float(q, end, vertex[i]);
+			}
+			if (q != NULL) vertices.push_back(vertex);
+		}
+		else
+		{
+			std::array<int, 3> vertexIndex;
+			int corners = 0;
+			while (true) {
+				q = obj_skip_blanks(q, end);
+				int index;
+				const char* next = obj_parse_int(q, end, index);
+				if (next == NULL) break;
+				q = next;
+				while (q < end && *q == '/') {  // Skip "/vt/vn".
+					q++;
+					while (q < end && (*q == '-' || (*q >= '0' && *q <= '9'))) q++;
+				}
+
+				if (index < 0) {
+					index += vertexBase + ((int)vertices.size() - firstVertex) + 1;
+					relative++;
+				}
+
+				if (corners < 3) {
+					vertexIndex[corners] = index;
+				} else {
+					vertexIndex[1] = vertexIndex[2];
+					vertexIndex[2] = index;
+				}
+				if (++corners >= 3) vertexIndices.push_back(vertexIndex);
+			}
+		}
+
+		p = obj_skip_line(p, end);
+	}
+
+	return relative;
+}
+
+
+// Single-pass OBJ loader over a memory-mapped file, with the same outputs as
+// load_obj() but no stdio calls or allocations per line.
+inline bool load_obj_mapped(const char* path, std::vector<std::array<float, 3>>& vertices, std::vector<std::array<int, 3>>& vertexIndices)
+{
+	printf("Loading OBJ file '%s' ... ", path);
+
+	MappedFile file(path);
+	if (!file.isOpen())
+	{
+		printf("Could not open file. Is the path correct?\n");
+		return false;
+	}
+
+	obj_parse_records(file.data(), file.end(), vertices, vertexIndices, (int)vertices.size());
+
+	printf("Done.\n");
+	return true;
+}
+
+
+// Smallest chunk load_obj_parallel() splits a file into by default: a few
+// chunks per thread balance the load, but smaller ones cost more than they
+// save.
+const size_t OBJ_MIN_CHUNK_BYTES = 256 * 1024;
+
+// Multi-threaded variant of load_obj_mapped(). The file is split at line
+// boundaries, each chunk is parsed on the thread pool and the results are
+// concatenated in file order, so the outputs match the serial loader exactly.
+// 'threads' limits the parallelism (0 = the whole pool); 'minChunkBytes'
+// is lowered by the benchmark to force small files into several chunks.
+inline bool load_obj_parallel(const char* path, std::vector<std::array<float, 3>>& vertices, std::vector<std::array<int, 3>>& vertexIndices, unsigned threads = 0,
+	size_t minChunkBytes = OBJ_MIN_CHUNK_BYTES)
+{
+	printf("Loading OBJ file '%s' ... ", path);
+
+	MappedFile file(path);
+	if (!file.isOpen())
+	{
+		printf("Could not open file. Is the path correct?\n");
+		return false;
+	}
+
+	ThreadPool& pool = thread_pool();
+	if (threads == 0 || threads > pool.size()) threads = pool.size();
+
+	// A few chunks per thread for load balancing.
+	const size_t minChunk = minChunkBytes > 0 ? minChunkBytes : 1;
+	size_t chunks = threads * 4;
+	if (chunks > file.size() / minChunk) chunks = file.size() / minChunk;
+	if (chunks < 1) chunks = 1;
+
+	std::vector<const char*> bounds(chunks + 1);
+	bounds[0] = file.data();
+	bounds[chunks] = file.end();
+	size_t c;
+	for (c = 1; c < chunks; c++) {
+		const char* split = file.data() + file.size() * c / chunks;
+		if (split < bounds[c - 1]) split = bounds[c - 1];
+		bounds[c] = obj_skip_line(split, file.end());
+	}
+
+	struct Chunk
+	{
+		std::vector<std::array<float, 3>> vertices;
+		std::vector<std::array<int, 3>> vertexIndices;
+		size_t relative;
+	};
+	std::vector<Chunk> parsed(chunks);
+
+	pool.run(threads, [&](size_t worker) {
+		size_t i;
+		for (i = worker; i < chunks; i += threads)
+			parsed[i].relative = obj_parse_records(bounds[i], bounds[i + 1], parsed[i].vertices, parsed[i].vertexIndices, 0);
+	});
+
+	// Global offsets of every chunk in the outputs.
+	std::vector<size_t> vertexOffset(chunks + 1), faceOffset(chunks + 1);
+	vertexOffset[0] = vertices.size();
+	faceOffset[0] = vertexIndices.size();
+	for (c = 0; c < chunks; c++) {
+		vertexOffset[c + 1] = vertexOffset[c] + parsed[c].vertices.size();
+		faceOffset[c + 1] = faceOffset[c] + parsed[c].vertexIndices.size();
+	}
+	vertices.resize(vertexOffset[chunks]);
+	vertexIndices.resize(faceOffset[chunks]);
+
+	pool.run(threads, [&](size_t worker) {
+		size_t i;
+		for (i = worker; i < chunks; i += threads) {
+			Chunk& chunk = parsed[i];
+			if (chunk.relative > 0) {
+				// Relative indices need the number of vertices before this
+				// chunk, which is only known now, so parse it again.
+				chunk.vertices.clear();
+				chunk.vertexIndices.clear();
+				obj_parse_records(bounds[i], bounds[i + 1], chunk.vertices, chunk.vertexIndices, (int)vertexOffset[i]);
+			}
+			if (!chunk.vertices.empty())
+				memcpy(&vertices[vertexOffset[i]], chunk.vertices.data(), chunk.vertices.size() * sizeof(chunk.vertices[0]));
+			if (!chunk.vertexIndices.empty())
+				memcpy(&vertexIndices[faceOffset[i]], chunk.vertexIndices.data(), chunk.vertexIndices.size() * sizeof(chunk.vertexIndices[0]));
+			std::vector<std::array<float, 3>>().swap(chunk.vertices);
+			std::vector<std::array<int, 3>>().swap(chunk.vertexIndices);
+		}
+	});
+
+	printf("Done.\n");
+	return true;
+}
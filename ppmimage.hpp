@@ -0,0 +1,179 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include "mappedfile.hpp"
+
+
+// Memory-mapped reader for PPM/PGM images: binary P6 (RGB) and P5 (grey),
+// and their ASCII forms P3 and P2. Rows are top row first, as stored.
+//
+// 8-bit binary files with a maximum value of 255 are used in place: pixels()
+// points straight into the mapping. Anything else (ASCII, 16-bit samples,
+// other maximum values) is decoded row by row with readRows(), so callers
+// can stream a band at a time instead of holding a second full copy.
+
+const int PPM_MAX_DIMENSION = 1 << 16;
+
+class PpmImage
+{
+public:
+	PpmImage() : m_width(0), m_height(0), m_channels(0), m_maxValue(0), m_ascii(false), m_pixels(NULL), m_cursor(NULL), m_nextRow(0) {}
+
+	PpmImage(const PpmImage&) = delete;
+	PpmImage& operator=(const PpmImage&) = delete;
+
+	/*
+		Maps and validates 'path'. Returns false (with a message) if the file
+		is missing, not a PPM/PGM, or shorter than its header says.
+	*/
+	bool open(const char* path)
+	{
+		close();
+		if (!m_file.open(path)) {
+			printf("Could not open image '%s'.\n", path);
+			return false;
+		}
+
+		const char* p = m_file.data();
+		const char* end = m_file.end();
+		if (m_file.size() < 2 || p[0] != 'P' || (p[1] != '2' && p[1] != '3' && p[1] != '5' && p[1] != '6')) {
+			printf("'%s' is not a PPM or PGM image.\n", path);
+			close();
+			return false;
+		}
+		m_ascii = p[1] == '2' || p[1] == '3';
+		m_channels = (p[1] == '3' || p[1] == '6') ? 3 : 1;
+		p += 2;
+
+		int* fields[3] = { &m_width, &m_height, &m_maxValue };
+		int i;
+		for (i = 0; i < 3; i++) {
+			if (!readNumber(p, end, *fields[i])) {
+				printf("'%s' has a malformed header.\n", path);
+				close();
+				return false;
+			}
+		}
+		if (m_width < 1 || m_height < 1 || m_width > PPM_MAX_DIMENSION || m_height > PPM_MAX_DIMENSION || m_maxValue < 1 || m_maxValue > 65535) {
+			printf("'%s' has invalid dimensions (%dx%d, maximum value %d).\n", path, m_width, m_height, m_maxValue);
+			close();
+			return false;
+		}
+
+		// Exactly one whitespace character separates the header from binary data.
+		if (p >= end || !isSpace(*p)) {
+			printf("'%s' has a malformed header.\n", path);
+			close();
+			return false;
+		}
+		p++;
+
+		if (!m_ascii) {
+			const unsigned long long required = (unsigned long long)rowBytes() * m_height * sampleBytes();
+			if ((unsigned long long)(end - p) < required) {
+				printf("'%s' is truncated: %dx%d needs %llu bytes of pixels, the file has %llu.\n", path, m_width, m_height, required, (unsigned long long)(end - p));
+				close();
+				return false;
+			}
+			if (m_maxValue == 255) m_pixels = (const unsigned char*)p;
+		}
+		m_cursor = p;
+		m_nextRow = 0;
+		return true;
+	}
+
+	void close()
+	{
+		m_file.close();
+		m_width = m_height = m_channels = m_maxValue = 0;
+		m_ascii = false;
+		m_pixels = NULL;
+		m_cursor = NULL;
+		m_nextRow = 0;
+	}
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+	int channels() const { return m_channels; }        // 3 for PPM, 1 for PGM.
+	size_t rowBytes() const { return (size_t)m_width * m_channels; }
+
+	// The 8-bit pixels inside the mapping, or NULL if they need decoding.
+	const unsigned char* pixels() const { return m_pixels; }
+
+	/*
+		Decodes the next 'rows' rows into 'out' (rowBytes() per row, samples
+		scaled to 0-255). Returns false on malformed ASCII data or when asked
+		for rows past the end of the image.
+	*/
+	bool readRows(int rows, unsigned char* out)
+	{
+		if (rows < 0 || m_nextRow + rows > m_height) return false;
+		const size_t count = rowBytes() * rows;
+		const char* end = m_file.end();
+		size_t i;
+
+		if (m_pixels != NULL) {
+			memcpy(out, m_cursor, count);
+			m_cursor += count;
+		} else if (!m_ascii && m_maxValue < 256) {
+			const unsigned char* src = (const unsigned char*)m_cursor;
+			for (i = 0; i < count; i++) out[i] = scale(src[i]);
+			m_cursor += count;
+		} else if (!m_ascii) {
+			// 16-bit samples are big-endian.
+			const unsigned char* src = (const unsigned char*)m_cursor;
+			for (i = 0; i < count; i++) out[i] = scale((src[2 * i] << 8) | src[2 * i + 1]);
+			m_cursor += 2 * count;
+		} else {
+			for (i = 0; i < count; i++) {
+				int value;
+				if (!readNumber(m_cursor, end, value) || value > m_maxValue) return false;
+				out[i] = scale(value);
+			}
+		}
+		m_nextRow += rows;
+		return true;
+	}
+
+private:
+	static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f'; }
+
+	// Reads a decimal number, skipping whitespace and '#' comments before it.
+	static bool readNumber(const char*& p, const char* end, int& value)
+	{
+		while (p < end) {
+			if (isSpace(*p)) p++;
+			else if (*p == '#') { while (p < end && *p != '\n' && *p != '\r') p++; }
+			else break;
+		}
+		if (p >= end || *p < '0' || *p > '9') return false;
+		value = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			value = value * 10 + (*p - '0');
+			if (value > 0xFFFFFF) return false;
+			p++;
+		}
+		return true;
+	}
+
+	size_t sampleBytes() const { return m_maxValue < 256 ? 1 : 2; }
+
+	unsigned char scale(int value) const
+	{
+		if (value > m_maxValue) value = m_maxValue;
+		return (unsigned char)((value * 255 + m_maxValue / 2) / m_maxValue);
+	}
+
+	MappedFile m_file;
+	int m_width;
+	int m_height;
+	int m_channels;
+	int m_maxValue;
+	bool m_ascii;
+	const unsigned char* m_pixels;
+	const char* m_cursor;   // Start of the next row's data.
+	int m_nextRow;
+};
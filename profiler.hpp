@@ -0,0 +1,231 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
+
+
+// CPU timings of named phases of a frame. A ProfileScope records one sample
+// when it goes out of scope into a fixed ring buffer that any thread may
+// write without locking; the oldest samples are overwritten. While the
+// profiler is disabled a scope costs one relaxed load and a branch.
+
+struct ProfileSample
+{
+	const char* name;    // Must outlive the profiler (a string literal).
+	int64_t start;       // Nanoseconds on the steady clock.
+	int64_t end;
+	uint32_t frame;      // Frame number when the scope opened.
+	uint32_t thread;     // Small id per recording thread, in order of first use.
+};
+
+// Per-phase totals over a run of frames, in the order the phases first appear.
+struct ProfilePhase
+{
+	const char* name;
+	uint32_t calls;
+	double totalMilliseconds;
+	double maxMilliseconds;     // Longest single frame's total.
+	double meanMilliseconds;    // Per frame in the run.
+};
+
+inline int64_t profile_now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline uint32_t profile_thread_id()
+{
+	static std::atomic<uint32_t> next(0);
+	thread_local uint32_t id = next.fetch_add(1, std::memory_order_relaxed);
+	return id;
+}
+
+class FrameProfiler
+{
+public:
+	// 'capacity' is rounded up to a power of two.
+	explicit FrameProfiler(size_t capacity = 8192) : m_head(0), m_frame(0), m_enabled(false)
+	{
+		size_t size = 1;
+		while (size < capacity) size <<= 1;
+		m_slots = std::vector<Slot>(size);
+		m_mask = size - 1;
+	}
+
+	FrameProfiler(const FrameProfiler&) = delete;
+	FrameProfiler& operator=(const FrameProfiler&) = delete;
+
+	void setEnabled(bool enabled) { m_enabled.store(enabled, std::memory_order_relaxed); }
+	bool enabled() const { return m_enabled.load(std::memory_order_relaxed); }
+
+	// Starts the next frame; samples opened after this carry its number.
+	void beginFrame() { m_frame.fetch_add(1, std::memory_order_relaxed); }
+	uint32_t frame() const { return m_frame.load(std::memory_order_relaxed); }
+
+	/*
+		Claims the next slot and fills it. Each slot has a sequence number
+		that is odd while it is being written, so a reader can tell a torn
+		sample from a finished one and skip it.
+	*/
+	void record(const char* name, int64_t start, int64_t end, uint32_t frame)
+	{
+		const uint64_t index = m_head.fetch_add(1, std::memory_order_relaxed);
+		Slot& slot = m_slots[index & m_mask];
+		slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+		slot.sample.name = name;
+		slot.sample.start = start;
+		slot.sample.end = end;
+		slot.sample.frame = frame;
+		slot.sample.thread = profile_thread_id();
+		slot.sequence.store(2 * index + 2, std::memory_order_release);
+	}
+
+	/*
+		Copies the finished samples still in the ring into 'out', oldest
+		first. Samples being overwritten while this runs are left out.
+	*/
+	void snapshot(std::vector<ProfileSample>& out) const
+	{
+		out.clear();
+		const uint64_t head = m_head.load(std::memory_order_acquire);
+		const uint64_t count = (std::min)(head, (uint64_t)m_slots.size());
+		out.reserve((size_t)count);
+		uint64_t index;
+		for (index = head - count; index < head; index++) {
+			const Slot& slot = m_slots[index & m_mask];
+			if (slot.sequence.load(std::memory_order_acquire) != 2 * index + 2) continue;
+			ProfileSample sample = slot.sample;
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot.sequence.load(std::memory_order_relaxed) != 2 * index + 2) continue;
+			out.push_back(sample);
+		}
+	}
+
+	// Forgets every sample. Not safe while other threads are recording.
+	void clear()
+	{
+		size_t i;
+		for (i = 0; i < m_slots.size(); i++) m_slots[i].sequence.store(0, std::memory_order_relaxed);
+		m_head.store(0, std::memory_order_relaxed);
+	}
+
+private:
+	struct Slot
+	{
+		Slot() : sample(), sequence(0) {}
+		Slot(const Slot&) : sample(), sequence(0) {}
+
+		ProfileSample sample;
+		std::atomic<uint64_t> sequence;
+	};
+
+	std::vector<Slot> m_slots;
+	size_t m_mask;
+	std::atomic<uint64_t> m_head;
+	std::atomic<uint32_t> m_frame;
+	std::atomic<bool> m_enabled;
+};
+
+// Times its own lifetime as one sample of 'name'.
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler& profiler, const char* name)
+		: m_profiler(profiler.enabled() ? &profiler : NULL), m_name(name), m_start(0), m_frame(0)
+	{
+		if (!m_profiler) return;
+		m_frame = profiler.frame();
+		m_start = profile_now();
+	}
+
+	~ProfileScope()
+	{
+		if (m_profiler) m_profiler->record(m_name, m_start, profile_now(), m_frame);
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	FrameProfiler* m_profiler;
+	const char* m_name;
+	int64_t m_start;
+	uint32_t m_frame;
+};
+
+/*
+	Totals 'samples' per phase name over frames [firstFrame, lastFrame].
+	Names are compared by pointer, so each phase should use one literal.
+*/
+inline void profile_phases(const std::vector<ProfileSample>& samples, uint32_t firstFrame, uint32_t lastFrame, std::vector<ProfilePhase>& out)
+{
+	out.clear();
+	std::vector<double> frameTotal;
+	std::vector<uint32_t> frameOf;
+	size_t i, p;
+	for (i = 0; i < samples.size(); i++) {
+		const ProfileSample& sample = samples[i];
+		if (sample.frame < firstFrame || sample.frame > lastFrame) continue;
+		for (p = 0; p < out.size() && out[p].name != sample.name; p++) {}
+		if (p == out.size()) {
+			const ProfilePhase phase = { sample.name, 0, 0.0, 0.0, 0.0 };
+			out.push_back(phase);
+			frameTotal.push_back(0.0);
+			frameOf.push_back(sample.frame);
+		}
+		// Samples arrive roughly in frame order, so close a phase's frame when the next one starts.
+		if (frameOf[p] != sample.frame) {
+			out[p].maxMilliseconds = (std::max)(out[p].maxMilliseconds, frameTotal[p]);
+			frameTotal[p] = 0.0;
+			frameOf[p] = sample.frame;
+		}
+		const double milliseconds = (sample.end - sample.start) / 1e6;
+		out[p].calls++;
+		out[p].totalMilliseconds += milliseconds;
+		frameTotal[p] += milliseconds;
+	}
+
+	const double frames = lastFrame >= firstFrame ? lastFrame - firstFrame + 1.0 : 1.0;
+	for (p = 0; p < out.size(); p++) {
+		out[p].maxMilliseconds = (std::max)(out[p].maxMilliseconds, frameTotal[p]);
+		out[p].meanMilliseconds = out[p].totalMilliseconds / frames;
+	}
+}
+
+/*
+	Writes 'samples' as complete ("X") events in the Chrome trace event
+	format, which chrome://tracing and Perfetto open. Times are in
+	microseconds from the first sample. Returns false if the file cannot be
+	written.
+*/
+inline bool profile_write_chrome_trace(const char* path, const std::vector<ProfileSample>& samples)
+{
+	FILE* file = fopen(path, "w");
+	if (!file) {
+		printf("Could not write the trace '%s'.\n", path);
+		return false;
+	}
+
+	int64_t origin = 0;
+	size_t i;
+	for (i = 0; i < samples.size(); i++)
+		if (i == 0 || samples[i].start < origin) origin = samples[i].start;
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	for (i = 0; i < samples.size(); i++) {
+		const ProfileSample& sample = samples[i];
+		fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}%s\n",
+			sample.name, sample.thread, (sample.start - origin) / 1e3, (sample.end - sample.start) / 1e3, sample.frame,
+			i + 1 < samples.size() ? "," : "");
+	}
+	fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+	bool ok = ferror(file) == 0;
+	if (fclose(file) != 0) ok = false;
+	if (!ok) printf("Could not write the trace '%s'.\n", path);
+	return ok;
+}
@@ -0,0 +1,333 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "mesh.hpp"
+#include "simdbounds.hpp"
+
+
+// Compact vertex storage. After normaliseVectors() every position lies in
+// [-1,1], so a 16-bit signed normalised integer (snorm16) keeps it to
+// 1/65534 of the mesh size, and a unit normal needs only two numbers once
+// it is folded onto an octahedron. A QuantisedMesh takes 10 bytes per
+// vertex instead of 24, plus 2-byte indices whenever every vertex can be
+// addressed with 16 bits.
+//
+// The renderer keeps the float Mesh on the CPU and only the GPU buffers are
+// quantised (QuantisedVertex below); QuantisedMesh and its octahedral
+// normals are measured against the float mesh by "--bench quantise".
+
+enum MeshFormat
+{
+	MESH_FORMAT_FLOAT,     // 32-bit float positions and normals, 32-bit indices.
+	MESH_FORMAT_QUANTISED  // snorm16 positions, snorm8 normals, 16-bit indices when they fit.
+};
+
+inline const char* mesh_format_name(MeshFormat format)
+{
+	return format == MESH_FORMAT_QUANTISED ? "quantised" : "float";
+}
+
+// Format named by the MESH_FORMAT environment variable, float by default.
+inline MeshFormat mesh_format_from_env()
+{
+	const char* name = getenv("MESH_FORMAT");
+	return name != NULL && strcmp(name, "quantised") == 0 ? MESH_FORMAT_QUANTISED : MESH_FORMAT_FLOAT;
+}
+
+const float SNORM16_SCALE = 32767.0f;
+const float SNORM8_SCALE = 127.0f;
+
+// Rounds to nearest (even on ties), like _mm_cvtps_epi32, so the scalar and
+// SIMD encoders agree bit for bit.
+inline int16_t snorm16_encode(float value)
+{
+	return (int16_t)lrintf((std::min)((std::max)(value, -1.0f), 1.0f) * SNORM16_SCALE);
+}
+
+inline float snorm16_decode(int16_t value)
+{
+	return (std::max)(value * (1.0f / SNORM16_SCALE), -1.0f);
+}
+
+inline int8_t snorm8_encode(float value)
+{
+	return (int8_t)lrintf((std::min)((std::max)(value, -1.0f), 1.0f) * SNORM8_SCALE);
+}
+
+inline void snorm16_encode_array_scalar(const float* values, size_t count, int16_t* out)
+{
+	size_t i;
+	for (i = 0; i < count; i++) out[i] = snorm16_encode(values[i]);
+}
+
+inline void snorm16_decode_array_scalar(const int16_t* values, size_t count, float* out)
+{
+	size_t i;
+	for (i = 0; i < count; i++) out[i] = snorm16_decode(values[i]);
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET_SSE2 inline void snorm16_encode_array_sse2(const float* values, size_t count, int16_t* out)
+{
+	const __m128 lo = _mm_set1_ps(-1.0f), hi = _mm_set1_ps(1.0f), scale = _mm_set1_ps(SNORM16_SCALE);
+	const size_t blocks = count / 8;
+	size_t b;
+	for (b = 0; b < blocks; b++) {
+		const float* p = values + 8 * b;
+		const __m128 a = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(p), lo), hi), scale);
+		const __m128 c = _mm_mul_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(p + 4), lo), hi), scale);
+		_mm_storeu_si128((__m128i*)(out + 8 * b), _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(c)));
+	}
+	snorm16_encode_array_scalar(values + 8 * blocks, count - 8 * blocks, out + 8 * blocks);
+}
+
+SIMD_TARGET_SSE2 inline void snorm16_decode_array_sse2(const int16_t* values, size_t count, float* out)
+{
+	const __m128 lo = _mm_set1_ps(-1.0f), scale = _mm_set1_ps(1.0f / SNORM16_SCALE);
+	const size_t blocks = count / 8;
+	size_t b;
+	for (b = 0; b < blocks; b++) {
+		const __m128i q = _mm_loadu_si128((const __m128i*)(values + 8 * b));
+		// Sign-extend each half to 32 bits: put the value in the top half, shift down.
+		const __m128i a = _mm_srai_epi32(_mm_unpacklo_epi16(q, q), 16);
+		const __m128i c = _mm_srai_epi32(_mm_unpackhi_epi16(q, q), 16);
+		_mm_storeu_ps(out + 8 * b, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(a), scale), lo));
+		_mm_storeu_ps(out + 8 * b + 4, _mm_max_ps(_mm_mul_ps(_mm_cvtepi32_ps(c), scale), lo));
+	}
+	snorm16_decode_array_scalar(values + 8 * blocks, count - 8 * blocks, out + 8 * blocks);
+}
+
+#endif
+
+// snorm16 of every value. There is no AVX version: AVX has no 256-bit
+// integer packs, so it would be SSE2 with wider loads.
+inline void snorm16_encode_array(const float* values, size_t count, int16_t* out, SimdLevel level = simd_level())
+{
+#ifdef SIMD_X86
+	if (level >= SIMD_SSE2) { snorm16_encode_array_sse2(values, count, out); return; }
+#endif
+	snorm16_encode_array_scalar(values, count, out);
+}
+
+inline void snorm16_decode_array(const int16_t* values, size_t count, float* out, SimdLevel level = simd_level())
+{
+#ifdef SIMD_X86
+	if (level >= SIMD_SSE2) { snorm16_decode_array_sse2(values, count, out); return; }
+#endif
+	snorm16_decode_array_scalar(values, count, out);
+}
+
+/*
+	Octahedral encoding of a unit normal: project onto the octahedron
+	|x| + |y| + |z| = 1, and fold the lower half over the diagonals so the
+	whole sphere maps onto the [-1,1] square. Both coordinates are snorm16.
+*/
+inline void octahedral_encode(float x, float y, float z, int16_t& u, int16_t& v)
+{
+	const float sum = fabsf(x) + fabsf(y) + fabsf(z);
+	float px = sum > 0.0f ? x / sum : 0.0f, py = sum > 0.0f ? y / sum : 0.0f;
+	if (z < 0.0f) {
+		const float fx = (1.0f - fabsf(py)) * (px >= 0.0f ? 1.0f : -1.0f);
+		const float fy = (1.0f - fabsf(px)) * (py >= 0.0f ? 1.0f : -1.0f);
+		px = fx;
+		py = fy;
+	}
+	u = snorm16_encode(px);
+	v = snorm16_encode(py);
+}
+
+inline void octahedral_decode(int16_t u, int16_t v, float normal[3])
+{
+	float x = snorm16_decode(u), y = snorm16_decode(v);
+	const float z = 1.0f - fabsf(x) - fabsf(y);
+	const float fold = (std::max)(-z, 0.0f);
+	x += x >= 0.0f ? -fold : fold;
+	y += y >= 0.0f ? -fold : fold;
+
+	const float length = sqrtf(x * x + y * y + z * z);
+	const float scale = length > 0.0f ? 1.0f / length : 0.0f;
+	normal[0] = x * scale;
+	normal[1] = y * scale;
+	normal[2] = z * scale;
+}
+
+// A mesh in the compact format. Normals are per vertex and optional.
+struct QuantisedMesh
+{
+	AlignedArray<int16_t> x, y, z;           // snorm16 positions.
+	AlignedArray<int16_t> normalU, normalV;  // Octahedral snorm16 normals.
+	AlignedArray<uint16_t> indices16;        // Used when every vertex fits in 16 bits...
+	AlignedArray<uint32_t> indices32;        // ...and these otherwise.
+
+	size_t vertexCount() const { return x.size(); }
+	size_t triangleCount() const { return (indices16.size() + indices32.size()) / 3; }
+	uint32_t index(size_t i) const { return indices16.empty() ? indices32[i] : indices16[i]; }
+
+	size_t bytes() const
+	{
+		return (x.size() + y.size() + z.size() + normalU.size() + normalV.size()) * sizeof(int16_t)
+			+ indices16.size() * sizeof(uint16_t) + indices32.size() * sizeof(uint32_t);
+	}
+};
+
+// Bytes of the same mesh with float positions and normals and 32-bit indices.
+inline size_t float_mesh_bytes(const Mesh& mesh, const Float3Array& normals)
+{
+	return (mesh.vertexCount() + normals.size()) * 3 * sizeof(float) + mesh.indices.size() * sizeof(uint32_t);
+}
+
+inline void quantise_mesh(const Mesh& mesh, const Float3Array& normals, QuantisedMesh& out, SimdLevel level = simd_level())
+{
+	const size_t count = mesh.vertexCount();
+	out.x.resize(count);
+	out.y.resize(count);
+	out.z.resize(count);
+	snorm16_encode_array(mesh.positions.x.data(), count, out.x.data(), level);
+	snorm16_encode_array(mesh.positions.y.data(), count, out.y.data(), level);
+	snorm16_encode_array(mesh.positions.z.data(), count, out.z.data(), level);
+
+	out.normalU.resize(normals.size());
+	out.normalV.resize(normals.size());
+	size_t i;
+	for (i = 0; i < normals.size(); i++)
+		octahedral_encode(normals.x[i], normals.y[i], normals.z[i], out.normalU[i], out.normalV[i]);
+
+	if (count <= 0x10000) {
+		out.indices32.clear();
+		out.indices16.resize(mesh.indices.size());
+		for (i = 0; i < mesh.indices.size(); i++) out.indices16[i] = (uint16_t)mesh.indices[i];
+	} else {
+		out.indices16.clear();
+		out.indices32 = mesh.indices;
+	}
+}
+
+inline void dequantise_mesh(const QuantisedMesh& quantised, Mesh& mesh, Float3Array& normals, SimdLevel level = simd_level())
+{
+	const size_t count = quantised.vertexCount();
+	mesh.positions.resize(count);
+	snorm16_decode_array(quantised.x.data(), count, mesh.positions.x.data(), level);
+	snorm16_decode_array(quantised.y.data(), count, mesh.positions.y.data(), level);
+	snorm16_decode_array(quantised.z.data(), count, mesh.positions.z.data(), level);
+
+	normals.resize(quantised.normalU.size());
+	size_t i;
+	for (i = 0; i < normals.size(); i++) {
+		float n[3];
+		octahedral_decode(quantised.normalU[i], quantised.normalV[i], n);
+		normals.x[i] = n[0];
+		normals.y[i] = n[1];
+		normals.z[i] = n[2];
+	}
+
+	mesh.indices.resize(quantised.triangleCount() * 3);
+	for (i = 0; i < mesh.indices.size(); i++) mesh.indices[i] = quantised.index(i);
+}
+
+// Angle in degrees between two unit vectors.
+inline double normal_error_degrees(float ax, float ay, float az, float bx, float by, float bz)
+{
+	const double cosine = (std::min)((std::max)((double)ax * bx + (double)ay * by + (double)az * bz, -1.0), 1.0);
+	return acos(cosine) * 180.0 / 3.14159265358979;
+}
+
+// How far the compact mesh is from the float original.
+struct QuantisationError
+{
+	double maxPosition;       // Largest coordinate error, in mesh units ([-1,1] cube).
+	double rmsPosition;
+	double maxNormalDegrees;  // Largest angle between an original and a decoded normal.
+	double meanNormalDegrees;
+	double maxSnorm8Degrees;  // The same for the snorm8 normals the quantised GPU buffers carry.
+	size_t floatBytes;
+	size_t quantisedBytes;
+};
+
+inline QuantisationError measure_quantisation_error(const Mesh& mesh, const Float3Array& normals, const QuantisedMesh& quantised)
+{
+	Mesh decoded;
+	Float3Array decodedNormals;
+	dequantise_mesh(quantised, decoded, decodedNormals);
+
+	QuantisationError error;
+	memset(&error, 0, sizeof(error));
+	double squares = 0.0;
+	size_t i;
+	for (i = 0; i < mesh.vertexCount(); i++) {
+		const double d[3] = { (double)decoded.positions.x[i] - mesh.positions.x[i], (double)decoded.positions.y[i] - mesh.positions.y[i],
+			(double)decoded.positions.z[i] - mesh.positions.z[i] };
+		int k;
+		for (k = 0; k < 3; k++) {
+			error.maxPosition = (std::max)(error.maxPosition, fabs(d[k]));
+			squares += d[k] * d[k];
+		}
+	}
+	error.rmsPosition = mesh.vertexCount() > 0 ? sqrt(squares / (3.0 * mesh.vertexCount())) : 0.0;
+
+	double angles = 0.0;
+	for (i = 0; i < normals.size(); i++) {
+		const float nx = normals.x[i], ny = normals.y[i], nz = normals.z[i];
+		if (nx == 0.0f && ny == 0.0f && nz == 0.0f) continue;  // Unused vertex.
+		const double angle = normal_error_degrees(nx, ny, nz, decodedNormals.x[i], decodedNormals.y[i], decodedNormals.z[i]);
+		error.maxNormalDegrees = (std::max)(error.maxNormalDegrees, angle);
+		angles += angle;
+
+		float b[3] = { snorm8_encode(nx) / SNORM8_SCALE, snorm8_encode(ny) / SNORM8_SCALE, snorm8_encode(nz) / SNORM8_SCALE };
+		const float length = sqrtf(b[0] * b[0] + b[1] * b[1] + b[2] * b[2]);
+		if (length > 0.0f)
+			error.maxSnorm8Degrees = (std::max)(error.maxSnorm8Degrees, normal_error_degrees(nx, ny, nz, b[0] / length, b[1] / length, b[2] / length));
+	}
+	error.meanNormalDegrees = normals.size() > 0 ? angles / normals.size() : 0.0;
+	error.floatBytes = float_mesh_bytes(mesh, normals);
+	error.quantisedBytes = quantised.bytes();
+	return error;
+}
+
+inline void print_quantisation_report(const char* name, const QuantisationError& error)
+{
+	printf("Quantised '%s': %.1f KB -> %.1f KB (%.2fx), position error max %.2g rms %.2g, "
+		"octahedral normals max %.3g deg mean %.3g deg, snorm8 normals max %.3g deg\n",
+		name, error.floatBytes / 1024.0, error.quantisedBytes / 1024.0, (double)error.floatBytes / (std::max)(error.quantisedBytes, (size_t)1),
+		error.maxPosition, error.rmsPosition, error.maxNormalDegrees, error.meanNormalDegrees, error.maxSnorm8Degrees);
+}
+
+// Interleaved GPU vertex of the quantised format: snorm16 position padded
+// to 8 bytes and snorm8 normal padded to 4, so every attribute starts on a
+// 4-byte boundary. Fixed-function GL cannot decode octahedral normals, so
+// the GPU gets xyz; signed byte normals are normalised to [-1,1] by GL.
+struct QuantisedVertex
+{
+	int16_t position[4];
+	int8_t normal[4];
+};
+static_assert(sizeof(QuantisedVertex) == 12, "QuantisedVertex must be packed into 12 bytes");
+
+/*
+	Converts interleaved float vertices (px py pz nx ny nz) to the quantised
+	GPU layout.
+*/
+inline void quantise_interleaved(const std::vector<float>& interleaved, std::vector<QuantisedVertex>& out)
+{
+	out.resize(interleaved.size() / 6);
+	size_t i;
+	for (i = 0; i < out.size(); i++) {
+		const float* v = &interleaved[6 * i];
+		QuantisedVertex& q = out[i];
+		q.position[0] = snorm16_encode(v[0]);
+		q.position[1] = snorm16_encode(v[1]);
+		q.position[2] = snorm16_encode(v[2]);
+		q.position[3] = 0;
+		q.normal[0] = snorm8_encode(v[3]);
+		q.normal[1] = snorm8_encode(v[4]);
+		q.normal[2] = snorm8_encode(v[5]);
+		q.normal[3] = 0;
+	}
+}
@@ -0,0 +1,340 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "clock.hpp"
+#include "glextensions.hpp"
+#include "gpumesh.hpp"
+#include "mesh.hpp"
+#include "transform.hpp"
+
+
+// A scene of many placed copies (instances) of a few meshes. Meshes are
+// uploaded once into a registry and referred to by index; every instance
+// has its own transform and material. Drawing sorts the instances by a
+// render key (mesh, then material), so each run sharing both is one batch:
+// a single glDrawElementsInstanced call, with the transforms streamed from
+// a per-instance attribute buffer to a small vertex shader, when the GL has
+// instanced arrays; otherwise one glDrawElements per instance with the mesh
+// arrays and material still bound once per batch.
+
+const GLuint SCENE_INSTANCE_ATTRIBUTE = 12;  // Four consecutive attributes, one per matrix column.
+
+struct SceneMaterial
+{
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	float shininess;
+};
+
+struct SceneInstance
+{
+	uint32_t mesh;
+	uint32_t material;
+	Mat4 transform;
+};
+
+struct SceneDrawStats
+{
+	size_t instances;
+	size_t batches;
+	size_t drawCalls;
+	size_t triangles;
+	double submitMilliseconds;  // CPU time spent issuing the frame's GL calls.
+	bool instanced;
+};
+
+// Sort key of an instance: mesh first, as rebinding buffers costs more than a material change.
+inline uint64_t scene_render_key(uint32_t mesh, uint32_t material)
+{
+	return ((uint64_t)mesh << 32) | material;
+}
+
+// GL_LIGHT0 and the material as the fixed-function pipeline lights a vertex
+// (directional light, infinite viewer), after the instance transform.
+const char* const SCENE_VERTEX_SHADER =
+	"#version 120\n"
+	"attribute vec4 instanceColumn0;\n"
+	"attribute vec4 instanceColumn1;\n"
+	"attribute vec4 instanceColumn2;\n"
+	"attribute vec4 instanceColumn3;\n"
+	"void main()\n"
+	"{\n"
+	"	mat4 instance = mat4(instanceColumn0, instanceColumn1, instanceColumn2, instanceColumn3);\n"
+	"	vec4 eye = gl_ModelViewMatrix * (instance * gl_Vertex);\n"
+	"	vec3 n = normalize(gl_NormalMatrix * (mat3(instance[0].xyz, instance[1].xyz, instance[2].xyz) * gl_Normal));\n"
+	"	vec3 l = normalize(gl_LightSource[0].position.xyz);\n"
+	"	float diffuse = max(dot(n, l), 0.0);\n"
+	"	float specular = diffuse > 0.0 ? pow(max(dot(n, normalize(gl_LightSource[0].halfVector.xyz)), 0.0), gl_FrontMaterial.shininess) : 0.0;\n"
+	"	vec4 color = gl_FrontMaterial.emission + gl_FrontMaterial.ambient * (gl_LightModel.ambient + gl_LightSource[0].ambient)\n"
+	"		+ gl_FrontMaterial.diffuse * gl_LightSource[0].diffuse * diffuse + gl_FrontMaterial.specular * gl_LightSource[0].specular * specular;\n"
+	"	gl_FrontColor = vec4(color.rgb, gl_FrontMaterial.diffuse.a);\n"
+	"	gl_Position = gl_ProjectionMatrix * eye;\n"
+	"}\n";
+
+class Scene
+{
+public:
+	Scene() : m_instanceBuffer(0), m_program(0), m_programBuilt(false), m_dirty(true), m_uploaded(false), m_instancing(true) {}
+
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	/*
+		Uploads 'mesh' with smooth 'vertexNormals' under 'name' and returns its
+		index. A name already in the registry returns the existing mesh.
+		Needs a current GL context.
+	*/
+	uint32_t addMesh(const std::string& name, const Mesh& mesh, const Float3Array& vertexNormals)
+	{
+		int existing = findMesh(name);
+		if (existing >= 0) return (uint32_t)existing;
+
+		std::vector<float> interleaved;
+		std::vector<GLuint> indices;
+		build_smooth_mesh(mesh, vertexNormals, interleaved, indices);
+		m_meshes.push_back(GpuMesh());
+		gpu_mesh_upload(m_meshes.back(), interleaved, indices);
+		m_names.push_back(name);
+		return (uint32_t)(m_meshes.size() - 1);
+	}
+
+	int findMesh(const std::string& name) const
+	{
+		size_t i;
+		for (i = 0; i < m_names.size(); i++) {
+			if (m_names[i] == name) return (int)i;
+		}
+		return -1;
+	}
+
+	uint32_t addMaterial(const SceneMaterial& material)
+	{
+		m_materials.push_back(material);
+		return (uint32_t)(m_materials.size() - 1);
+	}
+
+	uint32_t addInstance(uint32_t mesh, uint32_t material, const Mat4& transform)
+	{
+		SceneInstance instance = { mesh, material, transform };
+		m_instances.push_back(instance);
+		m_dirty = true;
+		return (uint32_t)(m_instances.size() - 1);
+	}
+
+	void clearInstances()
+	{
+		m_instances.clear();
+		m_dirty = true;
+	}
+
+	size_t meshCount() const { return m_meshes.size(); }
+	size_t materialCount() const { return m_materials.size(); }
+	size_t instanceCount() const { return m_instances.size(); }
+
+	// Instanced draws when the GL supports them; off forces the per-instance path.
+	void setInstancing(bool enabled) { m_instancing = enabled; }
+	bool instancing() const { return m_instancing && buildProgram(); }
+
+	/*
+		Draws every instance under the current modelview matrix, with
+		lighting as set up by the caller. GL_COLOR_MATERIAL is turned off so
+		each batch's material applies.
+	*/
+	SceneDrawStats draw()
+	{
+		double start = clock_seconds();
+		SceneDrawStats stats = {};
+		stats.instances = m_instances.size();
+		stats.instanced = instancing();
+		prepare(stats.instanced);
+		stats.batches = m_batches.size();
+
+		glPushAttrib(GL_ENABLE_BIT | GL_LIGHTING_BIT);
+		glDisable(GL_COLOR_MATERIAL);
+		glEnable(GL_NORMALIZE);  // The instance transforms scale, so the fallback path has to renormalise.
+		glShadeModel(GL_SMOOTH);
+		size_t b;
+		for (b = 0; b < m_batches.size(); b++) {
+			const Batch& batch = m_batches[b];
+			const GpuMesh& mesh = m_meshes[batch.mesh];
+			if (mesh.indexCount == 0) continue;
+
+			const SceneMaterial& material = m_materials[batch.material];
+			glMaterialfv(GL_FRONT, GL_AMBIENT, material.ambient);
+			glMaterialfv(GL_FRONT, GL_DIFFUSE, material.diffuse);
+			glMaterialfv(GL_FRONT, GL_SPECULAR, material.specular);
+			glMaterialf(GL_FRONT, GL_SHININESS, material.shininess);
+
+			const unsigned char* indexBase = gpu_mesh_bind(mesh);
+			if (stats.instanced) {
+				drawInstanced(batch, mesh, indexBase);
+				stats.drawCalls++;
+			} else {
+				uint32_t i;
+				for (i = batch.first; i < batch.first + batch.count; i++) {
+					glPushMatrix();
+					glMultMatrixf(&m_transforms[16 * i]);
+					glDrawElements(GL_TRIANGLES, mesh.indexCount, mesh.indexType, indexBase);
+					glPopMatrix();
+				}
+				stats.drawCalls += batch.count;
+			}
+			gpu_mesh_unbind(mesh);
+			stats.triangles += (size_t)batch.count * (mesh.indexCount / 3);
+		}
+		glPopAttrib();
+
+		stats.submitMilliseconds = (clock_seconds() - start) * 1000.0;
+		return stats;
+	}
+
+	// Deletes the GL objects. Needs the context they were created in.
+	void release()
+	{
+		size_t i;
+		for (i = 0; i < m_meshes.size(); i++) gpu_mesh_release(m_meshes[i]);
+		m_meshes.clear();
+		m_names.clear();
+		GLExtensions& ext = gl_extensions();
+		if (m_instanceBuffer != 0) ext.DeleteBuffers(1, &m_instanceBuffer);
+		if (m_program != 0) ext.DeleteProgram(m_program);
+		m_instanceBuffer = 0;
+		m_program = 0;
+		m_programBuilt = false;
+		m_dirty = true;
+	}
+
+private:
+	// Instances [first, first + count) of the sorted order share a mesh and material.
+	struct Batch
+	{
+		uint32_t mesh;
+		uint32_t material;
+		uint32_t first;
+		uint32_t count;
+	};
+
+	/*
+		Sorts the instances by render key into batches and lays their
+		transforms out in that order, uploading them for instanced draws.
+		Only runs after the instances change.
+	*/
+	void prepare(bool instanced)
+	{
+		if (m_dirty) {
+			std::vector<std::pair<uint64_t, uint32_t> > keys(m_instances.size());
+			size_t i;
+			for (i = 0; i < m_instances.size(); i++)
+				keys[i] = std::make_pair(scene_render_key(m_instances[i].mesh, m_instances[i].material), (uint32_t)i);
+			std::sort(keys.begin(), keys.end());
+
+			m_batches.clear();
+			m_transforms.resize(16 * m_instances.size());
+			for (i = 0; i < keys.size(); i++) {
+				const SceneInstance& instance = m_instances[keys[i].second];
+				std::copy(instance.transform.m, instance.transform.m + 16, &m_transforms[16 * i]);
+				if (m_batches.empty() || m_batches.back().mesh != instance.mesh || m_batches.back().material != instance.material) {
+					Batch batch = { instance.mesh, instance.material, (uint32_t)i, 0 };
+					m_batches.push_back(batch);
+				}
+				m_batches.back().count++;
+			}
+			m_dirty = false;
+			m_uploaded = false;
+		}
+
+		GLExtensions& ext = gl_extensions();
+		if (instanced && !m_uploaded && ext.vertexBufferObjects) {
+			if (m_instanceBuffer == 0) ext.GenBuffers(1, &m_instanceBuffer);
+			ext.BindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+			ext.BufferData(GL_ARRAY_BUFFER, m_transforms.size() * sizeof(float), m_transforms.empty() ? NULL : &m_transforms[0], GL_DYNAMIC_DRAW);
+			ext.BindBuffer(GL_ARRAY_BUFFER, 0);
+			m_uploaded = true;
+		}
+	}
+
+	// One draw of the batch's mesh per instance, the transforms read from per-instance attributes.
+	void drawInstanced(const Batch& batch, const GpuMesh& mesh, const unsigned char* indexBase)
+	{
+		GLExtensions& ext = gl_extensions();
+		const unsigned char* transforms = (const unsigned char*)(m_instanceBuffer != 0 ? NULL : &m_transforms[0]) + 16 * sizeof(float) * batch.first;
+		if (m_instanceBuffer != 0) ext.BindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+		GLuint c;
+		for (c = 0; c < 4; c++) {
+			ext.EnableVertexAttribArray(SCENE_INSTANCE_ATTRIBUTE + c);
+			ext.VertexAttribPointer(SCENE_INSTANCE_ATTRIBUTE + c, 4, GL_FLOAT, GL_FALSE, 16 * sizeof(float), transforms + 4 * sizeof(float) * c);
+			ext.VertexAttribDivisor(SCENE_INSTANCE_ATTRIBUTE + c, 1);
+		}
+
+		ext.UseProgram(m_program);
+		ext.DrawElementsInstanced(GL_TRIANGLES, mesh.indexCount, mesh.indexType, indexBase, (GLsizei)batch.count);
+		ext.UseProgram(0);
+
+		for (c = 0; c < 4; c++) {
+			ext.VertexAttribDivisor(SCENE_INSTANCE_ATTRIBUTE + c, 0);
+			ext.DisableVertexAttribArray(SCENE_INSTANCE_ATTRIBUTE + c);
+		}
+	}
+
+	// Compiles the instancing shader on first use; false if the GL cannot instance.
+	bool buildProgram() const
+	{
+		if (m_programBuilt) return m_program != 0;
+		m_programBuilt = true;
+
+		GLExtensions& ext = gl_load_extensions();
+		if (!ext.instancedArrays) return false;
+
+		GLuint shader = ext.CreateShader(GL_VERTEX_SHADER);
+		ext.ShaderSource(shader, 1, &SCENE_VERTEX_SHADER, NULL);
+		ext.CompileShader(shader);
+		GLint ok = 0;
+		ext.GetShaderiv(shader, GL_COMPILE_STATUS, &ok);
+		if (!ok) {
+			char log[1024] = "";
+			ext.GetShaderInfoLog(shader, sizeof(log), NULL, log);
+			printf("Scene instancing shader did not compile:\n%s\n", log);
+			ext.DeleteShader(shader);
+			return false;
+		}
+
+		GLuint program = ext.CreateProgram();
+		ext.AttachShader(program, shader);
+		const char* columns[4] = { "instanceColumn0", "instanceColumn1", "instanceColumn2", "instanceColumn3" };
+		GLuint c;
+		for (c = 0; c < 4; c++) ext.BindAttribLocation(program, SCENE_INSTANCE_ATTRIBUTE + c, columns[c]);
+		ext.LinkProgram(program);
+		ext.DeleteShader(shader);
+		ext.GetProgramiv(program, GL_LINK_STATUS, &ok);
+		if (!ok) {
+			char log[1024] = "";
+			ext.GetProgramInfoLog(program, sizeof(log), NULL, log);
+			printf("Scene instancing shader did not link:\n%s\n", log);
+			ext.DeleteProgram(program);
+			return false;
+		}
+		m_program = program;
+		return true;
+	}
+
+	std::vector<GpuMesh> m_meshes;
+	std::vector<std::string> m_names;
+	std::vector<SceneMaterial> m_materials;
+	std::vector<SceneInstance> m_instances;
+
+	std::vector<Batch> m_batches;
+	std::vector<float> m_transforms;  // Column-major 4x4 per instance, in batch order.
+	GLuint m_instanceBuffer;
+	mutable GLuint m_program;
+	mutable bool m_programBuilt;
+	bool m_dirty;
+	bool m_uploaded;
+	bool m_instancing;
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define SIMD_TARGET_SSE2 __attribute__((target("sse2")))
+#define SIMD_TARGET_AVX __attribute__((target("avx")))
+#else
+#define SIMD_TARGET_SSE2
+#define SIMD_TARGET_AVX
+#endif
+
+
+// Bounds and scale-and-bias kernels, with SSE2 and AVX versions picked at
+// runtime. They work on one component array of a structure-of-arrays mesh.
+
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE2, SIMD_AVX };
+
+inline const char* simd_level_name(SimdLevel level)
+{
+	return level == SIMD_AVX ? "avx" : level == SIMD_SSE2 ? "sse2" : "scalar";
+}
+
+// Best level this CPU and OS support.
+inline SimdLevel simd_detect()
+{
+#ifdef SIMD_X86
+	unsigned int regs[4] = { 0, 0, 0, 0 };
+#ifdef _MSC_VER
+	__cpuid((int*)regs, 1);
+#else
+	__get_cpuid(1, &regs[0], &regs[1], &regs[2], &regs[3]);
+#endif
+	const bool sse2 = (regs[3] & (1u << 26)) != 0;
+	const bool avx = (regs[2] & (1u << 28)) != 0;
+	const bool osxsave = (regs[2] & (1u << 27)) != 0;
+
+	if (avx && osxsave) {
+		// The OS must also save the YMM registers on context switches.
+		unsigned long long xcr0;
+#ifdef _MSC_VER
+		xcr0 = _xgetbv(0);
+#else
+		unsigned int lo, hi;
+		__asm__ __volatile__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+		xcr0 = ((unsigned long long)hi << 32) | lo;
+#endif
+		if ((xcr0 & 6) == 6) return SIMD_AVX;
+	}
+	if (sse2) return SIMD_SSE2;
+#endif
+	return SIMD_SCALAR;
+}
+
+// Detected level, lowered by the SIMD_LEVEL environment variable ("scalar",
+// "sse2") for testing.
+inline SimdLevel simd_level_from_env()
+{
+	SimdLevel level = simd_detect();
+	const char* forced = getenv("SIMD_LEVEL");
+	if (forced != NULL && strcmp(forced, "scalar") == 0) level = SIMD_SCALAR;
+	if (forced != NULL && strcmp(forced, "sse2") == 0 && level > SIMD_SSE2) level = SIMD_SSE2;
+	return level;
+}
+
+// simd_level_from_env(), worked out once. Safe to call from loader threads.
+inline SimdLevel simd_level()
+{
+	static const SimdLevel level = simd_level_from_env();
+	return level;
+}
+
+
+inline void bounds_array_scalar(const float* values, size_t count, float& minimum, float& maximum)
+{
+	size_t i;
+	for (i = 0; i < count; i++) {
+		if (values[i] < minimum) minimum = values[i];
+		if (values[i] > maximum) maximum = values[i];
+	}
+}
+
+inline void scale_bias_array_scalar(float* values, size_t count, float scale, float bias)
+{
+	size_t i;
+	for (i = 0; i < count; i++) values[i] = values[i] * scale + bias;
+}
+
+#ifdef SIMD_X86
+
+SIMD_TARGET_SSE2 inline void bounds_array_sse2(const float* values, size_t count, float& minimum, float& maximum)
+{
+	const size_t blocks = count / 4;
+	if (blocks > 0) {
+		__m128 lo = _mm_loadu_ps(values), hi = lo;
+		size_t b;
+		for (b = 1; b < blocks; b++) {
+			__m128 v = _mm_loadu_ps(values + 4 * b);
+			lo = _mm_min_ps(lo, v);
+			hi = _mm_max_ps(hi, v);
+		}
+		float lanes[8];
+		_mm_storeu_ps(lanes, lo);
+		_mm_storeu_ps(lanes + 4, hi);
+		int j;
+		for (j = 0; j < 4; j++) {
+			if (lanes[j] < minimum) minimum = lanes[j];
+			if (lanes[4 + j] > maximum) maximum = lanes[4 + j];
+		}
+	}
+	bounds_array_scalar(values + 4 * blocks, count - 4 * blocks, minimum, maximum);
+}
+
+SIMD_TARGET_SSE2 inline void scale_bias_array_sse2(float* values, size_t count, float scale, float bias)
+{
+	const __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(bias);
+	const size_t blocks = count / 4;
+	size_t b;
+	for (b = 0; b < blocks; b++) {
+		float* p = values + 4 * b;
+		_mm_storeu_ps(p, _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(p), s), o));
+	}
+	scale_bias_array_scalar(values + 4 * blocks, count - 4 * blocks, scale, bias);
+}
+
+SIMD_TARGET_AVX inline void bounds_array_avx(const float* values, size_t count, float& minimum, float& maximum)
+{
+	const size_t blocks = count / 8;
+	if (blocks > 0) {
+		__m256 lo = _mm256_loadu_ps(values), hi = lo;
+		size_t b;
+		for (b = 1; b < blocks; b++) {
+			__m256 v = _mm256_loadu_ps(values + 8 * b);
+			lo = _mm256_min_ps(lo, v);
+			hi = _mm256_max_ps(hi, v);
+		}
+		float lanes[16];
+		_mm256_storeu_ps(lanes, lo);
+		_mm256_storeu_ps(lanes + 8, hi);
+		_mm256_zeroupper();
+		int j;
+		for (j = 0; j < 8; j++) {
+			if (lanes[j] < minimum) minimum = lanes[j];
+			if (lanes[8 + j] > maximum) maximum = lanes[8 + j];
+		}
+	}
+	bounds_array_scalar(values + 8 * blocks, count - 8 * blocks, minimum, maximum);
+}
+
+SIMD_TARGET_AVX inline void scale_bias_array_avx(float* values, size_t count, float scale, float bias)
+{
+	const __m256 s = _mm256_set1_ps(scale), o = _mm256_set1_ps(bias);
+	const size_t blocks = count / 8;
+	size_t b;
+	for (b = 0; b < blocks; b++) {
+		float* p = values + 8 * b;
+		_mm256_storeu_ps(p, _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(p), s), o));
+	}
+	_mm256_zeroupper();
+	scale_bias_array_scalar(values + 8 * blocks, count - 8 * blocks, scale, bias);
+}
+
+#endif
+
+// Min/max of one float array; minimum/maximum must be initialised.
+inline void bounds_array(const float* values, size_t count, float& minimum, float& maximum, SimdLevel level = simd_level())
+{
+#ifdef SIMD_X86
+	if (level == SIMD_AVX) { bounds_array_avx(values, count, minimum, maximum); return; }
+	if (level == SIMD_SSE2) { bounds_array_sse2(values, count, minimum, maximum); return; }
+#endif
+	bounds_array_scalar(values, count, minimum, maximum);
+}
+
+// values = values * scale + bias.
+inline void scale_bias_array(float* values, size_t count, float scale, float bias, SimdLevel level = simd_level())
+{
+#ifdef SIMD_X86
+	if (level == SIMD_AVX) { scale_bias_array_avx(values, count, scale, bias); return; }
+	if (level == SIMD_SSE2) { scale_bias_array_sse2(values, count, scale, bias); return; }
+#endif
+	scale_bias_array_scalar(values, count, scale, bias);
+}
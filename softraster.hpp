@@ -0,0 +1,670 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <vector>
+#include "mesh.hpp"
+#include "threadpool.hpp"
+#include "transform.hpp"
+
+
+// CPU rasteriser for the mesh render modes, so frames can be produced and
+// checked on machines without any GL implementation.
+//
+// It follows the fixed-function pipeline the app uses: modelview and
+// projection matrices, clipping against the near plane, a depth buffer with
+// GL_LEQUAL, and one light with material colours (including
+// GL_COLOR_MATERIAL). Triangles use flat (provoking = last vertex) or
+// Gouraud shading; lines and points are one pixel wide / square.
+//
+// Each draw call runs in three parallel stages on thread_pool():
+//   1. transform and light the vertices;
+//   2. set up primitives in chunks and bin them into 64x64 pixel tiles;
+//   3. rasterise the tiles, each visiting the chunks in submission order.
+// Tiles are independent, so the image is identical for any thread count.
+
+const int SOFT_TILE_SIZE = 64;
+
+// Colour (RGBA8 in memory order, as glReadPixels(GL_RGBA, GL_UNSIGNED_BYTE)
+// returns it) and depth, both bottom row first like GL window coordinates.
+struct SoftFramebuffer
+{
+	int width;
+	int height;
+	std::vector<uint32_t> color;
+	std::vector<float> depth;
+
+	SoftFramebuffer() : width(0), height(0) {}
+
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		color.assign((size_t)w * h, 0);
+		depth.assign((size_t)w * h, 1.0f);
+	}
+
+	void clear(float r, float g, float b, float a, float depthValue)
+	{
+		std::fill(color.begin(), color.end(), pack(r, g, b, a));
+		std::fill(depth.begin(), depth.end(), depthValue);
+	}
+
+	// Float colour to RGBA8 the way GL converts it (clamp, round to nearest).
+	static uint32_t pack(float r, float g, float b, float a)
+	{
+		const float c[4] = { r, g, b, a };
+		uint32_t packed = 0;
+		int i;
+		for (i = 0; i < 4; i++) {
+			float v = c[i] < 0.0f ? 0.0f : (c[i] > 1.0f ? 1.0f : c[i]);
+			packed |= (uint32_t)(v * 255.0f + 0.5f) << (8 * i);
+		}
+		return packed;
+	}
+
+	// Writes the colour buffer as a binary PPM (P6), top row first.
+	bool savePPM(const char* path) const
+	{
+		FILE* file = fopen(path, "wb");
+		if (file == NULL) {
+			printf("Could not write '%s'.\n", path);
+			return false;
+		}
+		std::vector<unsigned char> row((size_t)width * 3);
+		bool ok = fprintf(file, "P6\n%d %d\n255\n", width, height) > 0;
+		int x, y;
+		for (y = height - 1; ok && y >= 0; y--) {
+			const uint32_t* src = &color[(size_t)y * width];
+			for (x = 0; x < width; x++) {
+				row[3 * x] = (unsigned char)src[x];
+				row[3 * x + 1] = (unsigned char)(src[x] >> 8);
+				row[3 * x + 2] = (unsigned char)(src[x] >> 16);
+			}
+			ok = fwrite(row.data(), 1, row.size(), file) == row.size();
+		}
+		ok = fclose(file) == 0 && ok;
+		if (!ok) printf("Could not write '%s'.\n", path);
+		return ok;
+	}
+};
+
+struct SoftMaterial
+{
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	float emission[4];
+	float shininess;
+};
+
+// Fixed-function state consulted by the draw calls. The defaults match a
+// fresh GL context.
+struct SoftState
+{
+	Mat4 projection;
+	Mat4 modelview;
+
+	bool lighting;              // GL_LIGHTING with GL_LIGHT0 enabled.
+	bool colorMaterial;         // GL_COLOR_MATERIAL: ambient and diffuse follow 'color'.
+	float sceneAmbient[4];      // GL_LIGHT_MODEL_AMBIENT
+	float lightPosition[4];     // Eye space, as glLightfv(GL_POSITION) stores it.
+	float lightAmbient[4];
+	float lightDiffuse[4];
+	float lightSpecular[4];
+	SoftMaterial material;
+
+	float color[4];             // Current colour and normal, used by lines and points.
+	float normal[3];
+	float pointSize;
+
+	SoftState()
+	{
+		projection = modelview = mat4_identity();
+		lighting = colorMaterial = false;
+		set4(sceneAmbient, 0.2f, 0.2f, 0.2f, 1.0f);
+		set4(lightPosition, 0.0f, 0.0f, 1.0f, 0.0f);
+		set4(lightAmbient, 0.0f, 0.0f, 0.0f, 1.0f);
+		set4(lightDiffuse, 1.0f, 1.0f, 1.0f, 1.0f);
+		set4(lightSpecular, 1.0f, 1.0f, 1.0f, 1.0f);
+		set4(material.ambient, 0.2f, 0.2f, 0.2f, 1.0f);
+		set4(material.diffuse, 0.8f, 0.8f, 0.8f, 1.0f);
+		set4(material.specular, 0.0f, 0.0f, 0.0f, 1.0f);
+		set4(material.emission, 0.0f, 0.0f, 0.0f, 1.0f);
+		material.shininess = 0.0f;
+		set4(color, 1.0f, 1.0f, 1.0f, 1.0f);
+		normal[0] = normal[1] = 0.0f;
+		normal[2] = 1.0f;
+		pointSize = 1.0f;
+	}
+
+	// Like glLightfv(GL_LIGHT0, GL_POSITION): transformed by the current modelview.
+	void setLightPosition(const float position[4])
+	{
+		mat4_transform(modelview, position[0], position[1], position[2], position[3], lightPosition);
+	}
+
+	static void set4(float* v, float a, float b, float c, float d) { v[0] = a; v[1] = b; v[2] = c; v[3] = d; }
+};
+
+/*
+	Fixed-function lighting of one vertex (GL_LIGHT0, infinite viewer, no
+	attenuation). 'eye' is the eye-space position and 'n' the eye-space
+	normal, used as given (GL_NORMALIZE is off).
+*/
+inline void soft_light(const SoftState& state, const float eye[3], const float n[3], float out[4])
+{
+	const float* ambient = state.colorMaterial ? state.color : state.material.ambient;
+	const float* diffuse = state.colorMaterial ? state.color : state.material.diffuse;
+	const SoftMaterial& material = state.material;
+
+	float l[3];
+	const float* position = state.lightPosition;
+	if (position[3] != 0.0f) {
+		l[0] = position[0] / position[3] - eye[0];
+		l[1] = position[1] / position[3] - eye[1];
+		l[2] = position[2] / position[3] - eye[2];
+	} else {
+		l[0] = position[0]; l[1] = position[1]; l[2] = position[2];
+	}
+	float length = sqrtf(l[0] * l[0] + l[1] * l[1] + l[2] * l[2]);
+	if (length > 0.0f) { l[0] /= length; l[1] /= length; l[2] /= length; }
+
+	const float nDotL = n[0] * l[0] + n[1] * l[1] + n[2] * l[2];
+	float specular = 0.0f;
+	if (nDotL > 0.0f) {
+		float h[3] = { l[0], l[1], l[2] + 1.0f };
+		length = sqrtf(h[0] * h[0] + h[1] * h[1] + h[2] * h[2]);
+		float nDotH = length > 0.0f ? (n[0] * h[0] + n[1] * h[1] + n[2] * h[2]) / length : 0.0f;
+		if (nDotH > 0.0f) specular = material.shininess > 0.0f ? powf(nDotH, material.shininess) : 1.0f;
+	}
+	const float lambert = nDotL > 0.0f ? nDotL : 0.0f;
+
+	int i;
+	for (i = 0; i < 3; i++) {
+		out[i] = material.emission[i] + ambient[i] * state.sceneAmbient[i] + ambient[i] * state.lightAmbient[i]
+			+ lambert * diffuse[i] * state.lightDiffuse[i] + specular * material.specular[i] * state.lightSpecular[i];
+	}
+	out[3] = diffuse[3];
+}
+
+class SoftRasterizer
+{
+public:
+	SoftRasterizer() : m_target(NULL), m_tilesX(0), m_tilesY(0), m_smooth(false) {}
+
+	/*
+		Draws indexed triangles. With 'flat' set, 'normals' holds one normal
+		per triangle; otherwise one per vertex, lit per vertex and
+		interpolated (GL_SMOOTH). Without lighting the current colour is used.
+	*/
+	void drawTriangles(SoftFramebuffer& target, const SoftState& state, const Float3Array& positions, const uint32_t* indices, size_t triangleCount, const Float3Array& normals, bool flat)
+	{
+		transformVertices(state, positions, flat ? NULL : &normals);
+
+		float normalMatrix[9];
+		mat4_normal_matrix(state.modelview, normalMatrix);
+		const Float3Array* faceNormals = &normals;
+		const SoftState* s = &state;
+		rasterise(target, triangleCount, [this, s, indices, flat, faceNormals, &normalMatrix](size_t t, std::vector<Primitive>& out) {
+			Vertex v[3];
+			int c;
+			for (c = 0; c < 3; c++) vertex(indices[3 * t + c], v[c]);
+			if (flat) {
+				// GL lights a flat triangle at its provoking (last) vertex.
+				float color[4];
+				lightNormal(*s, normalMatrix, indices[3 * t + 2], faceNormals->x[t], faceNormals->y[t], faceNormals->z[t], color);
+				for (c = 0; c < 3; c++) setColor(v[c], color);
+			}
+			emitTriangle(v, flat, out);
+		});
+	}
+
+	// Draws lines given as index pairs, in the current colour and normal.
+	void drawLines(SoftFramebuffer& target, const SoftState& state, const Float3Array& positions, const uint32_t* indices, size_t lineCount)
+	{
+		transformVertices(state, positions, NULL);
+		float color[4];
+		constantColor(state, color);
+		rasterise(target, lineCount, [this, indices, &color](size_t i, std::vector<Primitive>& out) {
+			Vertex v[2];
+			vertex(indices[2 * i], v[0]);
+			vertex(indices[2 * i + 1], v[1]);
+			setColor(v[0], color);
+			setColor(v[1], color);
+			emitLine(v, out);
+		});
+	}
+
+	// Draws every position as a square point of state.pointSize pixels.
+	void drawPoints(SoftFramebuffer& target, const SoftState& state, const Float3Array& positions)
+	{
+		transformVertices(state, positions, NULL);
+		float color[4];
+		constantColor(state, color);
+		const float size = state.pointSize;
+		rasterise(target, positions.size(), [this, size, &color](size_t i, std::vector<Primitive>& out) {
+			Vertex v;
+			vertex((uint32_t)i, v);
+			setColor(v, color);
+			emitPoint(v, size, out);
+		});
+	}
+
+private:
+	SoftRasterizer(const SoftRasterizer&);
+	SoftRasterizer& operator=(const SoftRasterizer&);
+
+	// Clip-space vertex with its colour.
+	struct Vertex
+	{
+		float x, y, z, w;
+		float r, g, b, a;
+	};
+
+	// Set-up primitive in window coordinates (pixels, depth in [0, 1]).
+	struct Primitive
+	{
+		float x[3], y[3], z[3];
+		float invW[3];
+		float r[3], g[3], b[3], a[3];
+		int vertexCount;   // 1 point, 2 line, 3 triangle
+		bool flat;
+		float size;        // Point size.
+		int minX, minY, maxX, maxY;   // Inclusive pixel bounds.
+	};
+
+	// Stage 1: clip-space positions (and lit colours for smooth triangles).
+	void transformVertices(const SoftState& state, const Float3Array& positions, const Float3Array* vertexNormals)
+	{
+		const size_t count = positions.size();
+		m_clip.resize(count);
+		m_clipW.resize(count);
+		if (vertexNormals != NULL) m_vertexColor.resize(count * 4);
+
+		const Mat4 modelview = state.modelview;
+		const Mat4 projection = state.projection;
+		float normalMatrix[9];
+		mat4_normal_matrix(modelview, normalMatrix);
+
+		const size_t blockSize = 4096;
+		const size_t blocks = (count + blockSize - 1) / blockSize;
+		thread_pool().run(blocks, [&](size_t block) {
+			const size_t end = (std::min)(count, (block + 1) * blockSize);
+			size_t i;
+			for (i = block * blockSize; i < end; i++) {
+				float eye[4], clip[4];
+				mat4_transform(modelview, positions.x[i], positions.y[i], positions.z[i], 1.0f, eye);
+				mat4_transform(projection, eye[0], eye[1], eye[2], eye[3], clip);
+				m_clip.x[i] = clip[0];
+				m_clip.y[i] = clip[1];
+				m_clip.z[i] = clip[2];
+				m_clipW[i] = clip[3];
+
+				if (vertexNormals != NULL) {
+					float* color = &m_vertexColor[4 * i];
+					if (state.lighting) {
+						float n[3];
+						transformNormal(normalMatrix, vertexNormals->x[i], vertexNormals->y[i], vertexNormals->z[i], n);
+						soft_light(state, eye, n, color);
+					} else {
+						color[0] = state.color[0]; color[1] = state.color[1]; color[2] = state.color[2]; color[3] = state.color[3];
+					}
+				}
+			}
+		});
+		m_smooth = vertexNormals != NULL;
+	}
+
+	static void transformNormal(const float* m, float x, float y, float z, float out[3])
+	{
+		out[0] = m[0] * x + m[3] * y + m[6] * z;
+		out[1] = m[1] * x + m[4] * y + m[7] * z;
+		out[2] = m[2] * x + m[5] * y + m[8] * z;
+	}
+
+	void lightNormal(const SoftState& state, const float* normalMatrix, uint32_t vertexIndex, float nx, float ny, float nz, float out[4]) const
+	{
+		if (!state.lighting) {
+			out[0] = state.color[0]; out[1] = state.color[1]; out[2] = state.color[2]; out[3] = state.color[3];
+			return;
+		}
+		// Eye-space position of the vertex, only needed for a positional light.
+		float eye[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+		if (state.lightPosition[3] != 0.0f) {
+			Mat4 inverse;
+			float clip[4] = { m_clip.x[vertexIndex], m_clip.y[vertexIndex], m_clip.z[vertexIndex], m_clipW[vertexIndex] };
+			if (mat4_inverse(state.projection, inverse)) mat4_transform(inverse, clip[0], clip[1], clip[2], clip[3], eye);
+		}
+		float n[3];
+		transformNormal(normalMatrix, nx, ny, nz, n);
+		soft_light(state, eye, n, out);
+	}
+
+	void constantColor(const SoftState& state, float out[4]) const
+	{
+		float normalMatrix[9];
+		mat4_normal_matrix(state.modelview, normalMatrix);
+		const float eye[3] = { 0.0f, 0.0f, 0.0f };
+		if (state.lighting) {
+			float n[3];
+			transformNormal(normalMatrix, state.normal[0], state.normal[1], state.normal[2], n);
+			soft_light(state, eye, n, out);
+		} else {
+			out[0] = state.color[0]; out[1] = state.color[1]; out[2] = state.color[2]; out[3] = state.color[3];
+		}
+	}
+
+	void vertex(uint32_t i, Vertex& v) const
+	{
+		v.x = m_clip.x[i];
+		v.y = m_clip.y[i];
+		v.z = m_clip.z[i];
+		v.w = m_clipW[i];
+		if (m_smooth) {
+			const float* color = &m_vertexColor[4 * i];
+			v.r = color[0]; v.g = color[1]; v.b = color[2]; v.a = color[3];
+		}
+	}
+
+	static void setColor(Vertex& v, const float color[4])
+	{
+		v.r = color[0]; v.g = color[1]; v.b = color[2]; v.a = color[3];
+	}
+
+	static Vertex lerp(const Vertex& a, const Vertex& b, float t)
+	{
+		Vertex v;
+		v.x = a.x + (b.x - a.x) * t;
+		v.y = a.y + (b.y - a.y) * t;
+		v.z = a.z + (b.z - a.z) * t;
+		v.w = a.w + (b.w - a.w) * t;
+		v.r = a.r + (b.r - a.r) * t;
+		v.g = a.g + (b.g - a.g) * t;
+		v.b = a.b + (b.b - a.b) * t;
+		v.a = a.a + (b.a - a.a) * t;
+		return v;
+	}
+
+	// True if all vertices are outside the same clip plane.
+	static bool outsideFrustum(const Vertex* v, int count)
+	{
+		int outside[6] = { 0, 0, 0, 0, 0, 0 };
+		int i;
+		for (i = 0; i < count; i++) {
+			outside[0] += v[i].x > v[i].w;
+			outside[1] += v[i].x < -v[i].w;
+			outside[2] += v[i].y > v[i].w;
+			outside[3] += v[i].y < -v[i].w;
+			outside[4] += v[i].z > v[i].w;
+			outside[5] += v[i].z < -v[i].w;
+		}
+		for (i = 0; i < 6; i++) {
+			if (outside[i] == count) return true;
+		}
+		return false;
+	}
+
+	// Perspective divide and viewport transform of vertex 'v' into corner 'c'.
+	void toWindow(const Vertex& v, Primitive& p, int c) const
+	{
+		const float invW = 1.0f / v.w;
+		p.x[c] = (v.x * invW * 0.5f + 0.5f) * m_target->width;
+		p.y[c] = (v.y * invW * 0.5f + 0.5f) * m_target->height;
+		p.z[c] = v.z * invW * 0.5f + 0.5f;
+		p.invW[c] = invW;
+		p.r[c] = v.r;
+		p.g[c] = v.g;
+		p.b[c] = v.b;
+		p.a[c] = v.a;
+	}
+
+	// Clamps the primitive's pixel bounds to the framebuffer; false if empty.
+	bool setBounds(Primitive& p, float minX, float minY, float maxX, float maxY) const
+	{
+		p.minX = (std::max)(0, (int)floorf(minX));
+		p.minY = (std::max)(0, (int)floorf(minY));
+		p.maxX = (std::min)(m_target->width - 1, (int)ceilf(maxX));
+		p.maxY = (std::min)(m_target->height - 1, (int)ceilf(maxY));
+		return p.minX <= p.maxX && p.minY <= p.maxY;
+	}
+
+	void emitTriangle(const Vertex* v, bool flat, std::vector<Primitive>& out) const
+	{
+		if (outsideFrustum(v, 3)) return;
+
+		// Clip against the near plane (z >= -w); the other planes are handled
+		// by the pixel bounds and the depth test.
+		Vertex polygon[4];
+		int count = 0, i;
+		for (i = 0; i < 3; i++) {
+			const Vertex& a = v[i];
+			const Vertex& b = v[(i + 1) % 3];
+			const float da = a.z + a.w, db = b.z + b.w;
+			if (da >= 0.0f) polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f)) polygon[count++] = lerp(a, b, da / (da - db));
+		}
+
+		for (i = 1; i + 1 < count; i++) {
+			Primitive p;
+			p.vertexCount = 3;
+			p.flat = flat;
+			p.size = 1.0f;
+			toWindow(polygon[0], p, 0);
+			toWindow(polygon[i], p, 1);
+			toWindow(polygon[i + 1], p, 2);
+			if (setBounds(p, (std::min)((std::min)(p.x[0], p.x[1]), p.x[2]), (std::min)((std::min)(p.y[0], p.y[1]), p.y[2]),
+				(std::max)((std::max)(p.x[0], p.x[1]), p.x[2]), (std::max)((std::max)(p.y[0], p.y[1]), p.y[2])))
+				out.push_back(p);
+		}
+	}
+
+	void emitLine(const Vertex* v, std::vector<Primitive>& out) const
+	{
+		if (outsideFrustum(v, 2)) return;
+
+		Vertex a = v[0], b = v[1];
+		const float da = a.z + a.w, db = b.z + b.w;
+		if (da < 0.0f) a = lerp(a, b, da / (da - db));
+		else if (db < 0.0f) b = lerp(a, b, da / (da - db));
+
+		Primitive p;
+		p.vertexCount = 2;
+		p.flat = true;
+		p.size = 1.0f;
+		toWindow(a, p, 0);
+		toWindow(b, p, 1);
+		if (setBounds(p, (std::min)(p.x[0], p.x[1]) - 1.0f, (std::min)(p.y[0], p.y[1]) - 1.0f, (std::max)(p.x[0], p.x[1]) + 1.0f, (std::max)(p.y[0], p.y[1]) + 1.0f))
+			out.push_back(p);
+	}
+
+	void emitPoint(const Vertex& v, float size, std::vector<Primitive>& out) const
+	{
+		if (outsideFrustum(&v, 1)) return;
+
+		Primitive p;
+		p.vertexCount = 1;
+		p.flat = true;
+		p.size = size;
+		toWindow(v, p, 0);
+		// Square of 'size' pixels, as GL rasterises non-smooth points.
+		float first = floorf(p.x[0] + 0.5f - 0.5f * size), firstRow = floorf(p.y[0] + 0.5f - 0.5f * size);
+		if (setBounds(p, first, firstRow, first + size - 1.0f, firstRow + size - 1.0f)) out.push_back(p);
+	}
+
+	// Stages 2 and 3 for 'count' input primitives set up by 'setup'.
+	template <typename SetupFunc>
+	void rasterise(SoftFramebuffer& target, size_t count, const SetupFunc& setup)
+	{
+		if (count == 0 || target.width <= 0 || target.height <= 0) return;
+		m_target = &target;
+		m_tilesX = (target.width + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		m_tilesY = (target.height + SOFT_TILE_SIZE - 1) / SOFT_TILE_SIZE;
+		const size_t tileCount = (size_t)m_tilesX * m_tilesY;
+
+		const size_t minChunk = 2048;
+		const size_t chunks = (std::max)((size_t)1, (std::min)((count + minChunk - 1) / minChunk, (size_t)thread_pool().size() * 4));
+		const size_t chunkSize = (count + chunks - 1) / chunks;
+		if (m_primitives.size() < chunks) m_primitives.resize(chunks);
+		if (m_bins.size() < chunks * tileCount) m_bins.resize(chunks * tileCount);
+
+		thread_pool().run(chunks, [&](size_t chunk) {
+			std::vector<Primitive>& primitives = m_primitives[chunk];
+			std::vector<uint32_t>* bins = &m_bins[chunk * tileCount];
+			primitives.clear();
+			size_t tile;
+			for (tile = 0; tile < tileCount; tile++) bins[tile].clear();
+
+			const size_t end = (std::min)(count, (chunk + 1) * chunkSize);
+			size_t i;
+			for (i = chunk * chunkSize; i < end; i++) setup(i, primitives);
+
+			for (i = 0; i < primitives.size(); i++) {
+				const Primitive& p = primitives[i];
+				int tx, ty;
+				for (ty = p.minY / SOFT_TILE_SIZE; ty <= p.maxY / SOFT_TILE_SIZE; ty++) {
+					for (tx = p.minX / SOFT_TILE_SIZE; tx <= p.maxX / SOFT_TILE_SIZE; tx++) bins[ty * m_tilesX + tx].push_back((uint32_t)i);
+				}
+			}
+		});
+
+		thread_pool().run(tileCount, [&](size_t tile) {
+			const int x0 = (int)(tile % m_tilesX) * SOFT_TILE_SIZE;
+			const int y0 = (int)(tile / m_tilesX) * SOFT_TILE_SIZE;
+			const int x1 = (std::min)(x0 + SOFT_TILE_SIZE, target.width) - 1;
+			const int y1 = (std::min)(y0 + SOFT_TILE_SIZE, target.height) - 1;
+			size_t chunk, i;
+			for (chunk = 0; chunk < chunks; chunk++) {
+				const std::vector<Primitive>& primitives = m_primitives[chunk];
+				const std::vector<uint32_t>& bin = m_bins[chunk * tileCount + tile];
+				for (i = 0; i < bin.size(); i++) {
+					const Primitive& p = primitives[bin[i]];
+					const int minX = (std::max)(p.minX, x0), maxX = (std::min)(p.maxX, x1);
+					const int minY = (std::max)(p.minY, y0), maxY = (std::min)(p.maxY, y1);
+					if (p.vertexCount == 3) rasteriseTriangle(p, minX, minY, maxX, maxY);
+					else if (p.vertexCount == 2) rasteriseLine(p, minX, minY, maxX, maxY);
+					else rasterisePoint(p, minX, minY, maxX, maxY);
+				}
+			}
+		});
+		m_target = NULL;
+	}
+
+	// Depth test (GL_LEQUAL, fragments beyond the far plane dropped) and write.
+	inline void fragment(int x, int y, float z, uint32_t color) const
+	{
+		const size_t i = (size_t)y * m_target->width + x;
+		if (z <= m_target->depth[i] && z >= 0.0f && z <= 1.0f) {
+			m_target->depth[i] = z;
+			m_target->color[i] = color;
+		}
+	}
+
+	/*
+		Edge-function rasterisation of the pixels whose centres lie inside the
+		triangle. Pixels exactly on an edge belong to the triangle on its left
+		or top side, so neighbouring triangles never both draw them.
+	*/
+	void rasteriseTriangle(const Primitive& p, int minX, int minY, int maxX, int maxY) const
+	{
+		int order[3] = { 0, 1, 2 };
+		float area = (p.x[1] - p.x[0]) * (p.y[2] - p.y[0]) - (p.x[2] - p.x[0]) * (p.y[1] - p.y[0]);
+		if (area == 0.0f) return;
+		if (area < 0.0f) { order[1] = 2; order[2] = 1; area = -area; }
+
+		float edgeX[3], edgeY[3], dx[3], dy[3];
+		bool topLeft[3];
+		int e;
+		for (e = 0; e < 3; e++) {
+			// Edge e is opposite vertex e, running from vertex e+1 to e+2.
+			const int a = order[(e + 1) % 3], b = order[(e + 2) % 3];
+			edgeX[e] = p.x[a];
+			edgeY[e] = p.y[a];
+			dx[e] = p.x[b] - p.x[a];
+			dy[e] = p.y[b] - p.y[a];
+			topLeft[e] = dy[e] < 0.0f || (dy[e] == 0.0f && dx[e] < 0.0f);
+		}
+
+		const float invArea = 1.0f / area;
+		const uint32_t flatColor = SoftFramebuffer::pack(p.r[2], p.g[2], p.b[2], p.a[2]);
+		int x, y;
+		for (y = minY; y <= maxY; y++) {
+			const float py = y + 0.5f;
+			float w[3];
+			for (e = 0; e < 3; e++) w[e] = dx[e] * (py - edgeY[e]) - dy[e] * (minX + 0.5f - edgeX[e]);
+			for (x = minX; x <= maxX; x++) {
+				if ((w[0] > 0.0f || (w[0] == 0.0f && topLeft[0])) && (w[1] > 0.0f || (w[1] == 0.0f && topLeft[1])) && (w[2] > 0.0f || (w[2] == 0.0f && topLeft[2]))) {
+					const float b0 = w[0] * invArea, b1 = w[1] * invArea, b2 = w[2] * invArea;
+					const int v0 = order[0], v1 = order[1], v2 = order[2];
+					const float z = b0 * p.z[v0] + b1 * p.z[v1] + b2 * p.z[v2];
+					uint32_t color = flatColor;
+					if (!p.flat) {
+						// Perspective-correct colour.
+						const float q0 = b0 * p.invW[v0], q1 = b1 * p.invW[v1], q2 = b2 * p.invW[v2];
+						const float q = 1.0f / (q0 + q1 + q2);
+						color = SoftFramebuffer::pack((q0 * p.r[v0] + q1 * p.r[v1] + q2 * p.r[v2]) * q, (q0 * p.g[v0] + q1 * p.g[v1] + q2 * p.g[v2]) * q,
+							(q0 * p.b[v0] + q1 * p.b[v1] + q2 * p.b[v2]) * q, (q0 * p.a[v0] + q1 * p.a[v1] + q2 * p.a[v2]) * q);
+					}
+					fragment(x, y, z, color);
+				}
+				for (e = 0; e < 3; e++) w[e] -= dy[e];
+			}
+		}
+	}
+
+	/*
+		One-pixel line: one fragment per column (or row, for steep lines) whose
+		centre the line crosses, as GL's diamond-exit rule gives for most lines.
+	*/
+	void rasteriseLine(const Primitive& p, int minX, int minY, int maxX, int maxY) const
+	{
+		const uint32_t color = SoftFramebuffer::pack(p.r[0], p.g[0], p.b[0], p.a[0]);
+		const bool xMajor = fabsf(p.x[1] - p.x[0]) >= fabsf(p.y[1] - p.y[0]);
+		// Walk along the major axis u; v is the minor axis.
+		const float u0 = xMajor ? p.x[0] : p.y[0], u1 = xMajor ? p.x[1] : p.y[1];
+		const float v0 = xMajor ? p.y[0] : p.x[0], v1 = xMajor ? p.y[1] : p.x[1];
+		const float du = u1 - u0;
+		if (du == 0.0f) return;
+
+		const int uMin = xMajor ? minX : minY, uMax = xMajor ? maxX : maxY;
+		const int vMin = xMajor ? minY : minX, vMax = xMajor ? maxY : maxX;
+		// Pixel centres c + 0.5 in [min(u0, u1), max(u0, u1)).
+		int first = (std::max)(uMin, (int)ceilf((std::min)(u0, u1) - 0.5f));
+		int last = (std::min)(uMax, (int)ceilf((std::max)(u0, u1) - 0.5f) - 1);
+		int u;
+		for (u = first; u <= last; u++) {
+			const float t = (u + 0.5f - u0) / du;
+			const int v = (int)floorf(v0 + (v1 - v0) * t);
+			if (v < vMin || v > vMax) continue;
+			const float z = p.z[0] + (p.z[1] - p.z[0]) * t;
+			if (xMajor) fragment(u, v, z, color);
+			else fragment(v, u, z, color);
+		}
+	}
+
+	void rasterisePoint(const Primitive& p, int minX, int minY, int maxX, int maxY) const
+	{
+		const uint32_t color = SoftFramebuffer::pack(p.r[0], p.g[0], p.b[0], p.a[0]);
+		int x, y;
+		for (y = minY; y <= maxY; y++) {
+			for (x = minX; x <= maxX; x++) fragment(x, y, p.z[0], color);
+		}
+	}
+
+	SoftFramebuffer* m_target;
+	int m_tilesX, m_tilesY;
+
+	// Stage 1 output, reused across draws.
+	Float3Array m_clip;
+	std::vector<float> m_clipW;
+	std::vector<float> m_vertexColor;   // RGBA per vertex, smooth triangles only.
+	bool m_smooth;
+
+	// Stage 2 output: primitives per chunk, and per chunk and tile the
+	// indices of the primitives overlapping the tile.
+	std::vector<std::vector<Primitive> > m_primitives;
+	std::vector<std::vector<uint32_t> > m_bins;
+};
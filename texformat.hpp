@@ -0,0 +1,398 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+#include "glextensions.hpp"
+#include "mipmap.hpp"
+#include "threadpool.hpp"
+
+
+// Storage formats for 8-bit textures: which internal format to ask GL for,
+// the client data that goes with it, a CPU BC1 (DXT1) encoder, and a tally
+// of the memory each texture takes.
+//
+// A PPM has at most 8 bits per channel, so anything wider (the GL_RGB16 the
+// coursework used to ask for) only doubles memory and upload bandwidth.
+
+enum TextureFormat
+{
+	TEXTURE_FORMAT_AUTO,    // RGB8, or RGBA8 when RGB rows are not a multiple of 4 bytes.
+	TEXTURE_FORMAT_RGB8,
+	TEXTURE_FORMAT_SRGB8,   // Decoded to linear when sampled.
+	TEXTURE_FORMAT_RGBA8,   // Padded to 4 bytes per texel: every row is 4-byte aligned.
+	TEXTURE_FORMAT_BC1      // 4x4 blocks in 8 bytes (4 bits per texel), encoded on the CPU.
+};
+
+inline const char* texture_format_name(TextureFormat format)
+{
+	switch (format) {
+	case TEXTURE_FORMAT_RGB8: return "rgb8";
+	case TEXTURE_FORMAT_SRGB8: return "srgb8";
+	case TEXTURE_FORMAT_RGBA8: return "rgba8";
+	case TEXTURE_FORMAT_BC1: return "bc1";
+	default: return "auto";
+	}
+}
+
+// Format named by the TEXTURE_FORMAT environment variable, auto by default.
+inline TextureFormat texture_format_from_env()
+{
+	const char* name = getenv("TEXTURE_FORMAT");
+	int format;
+	for (format = TEXTURE_FORMAT_RGB8; name != NULL && format <= TEXTURE_FORMAT_BC1; format++) {
+		if (strcmp(name, texture_format_name((TextureFormat)format)) == 0) return (TextureFormat)format;
+	}
+	return TEXTURE_FORMAT_AUTO;
+}
+
+/*
+	Resolves 'requested' for an image 'width' texels wide with 'channels'
+	channels, falling back to RGB8 when the current context lacks sRGB
+	textures or S3TC compression. Needs a current GL context.
+*/
+inline TextureFormat choose_texture_format(TextureFormat requested, int width, int channels)
+{
+	const GLExtensions& ext = gl_load_extensions();
+	if (requested == TEXTURE_FORMAT_SRGB8 && !ext.textureSrgb) {
+		printf("sRGB textures are not supported; using rgb8.\n");
+		requested = TEXTURE_FORMAT_RGB8;
+	}
+	if (requested == TEXTURE_FORMAT_BC1 && !ext.textureCompressionS3tc) {
+		printf("S3TC texture compression is not supported; using rgb8.\n");
+		requested = TEXTURE_FORMAT_RGB8;
+	}
+	if (requested == TEXTURE_FORMAT_AUTO) {
+		requested = channels == 3 && (width * 3) % 4 != 0 ? TEXTURE_FORMAT_RGBA8 : TEXTURE_FORMAT_RGB8;
+	}
+	return requested;
+}
+
+// Internal format to request for 'format' with 'channels' source channels.
+inline GLint texture_internal_format(TextureFormat format, int channels)
+{
+	switch (format) {
+	case TEXTURE_FORMAT_SRGB8: return channels == 3 ? GL_SRGB8 : GL_SLUMINANCE8;
+	case TEXTURE_FORMAT_RGBA8: return GL_RGBA8;
+	case TEXTURE_FORMAT_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	default: return channels == 3 ? GL_RGB8 : GL_LUMINANCE8;
+	}
+}
+
+inline const char* texture_internal_format_name(GLint internalFormat)
+{
+	switch (internalFormat) {
+	case GL_RGB8: return "GL_RGB8";
+	case GL_LUMINANCE8: return "GL_LUMINANCE8";
+	case GL_SRGB8: return "GL_SRGB8";
+	case GL_SLUMINANCE8: return "GL_SLUMINANCE8";
+	case GL_RGBA8: return "GL_RGBA8";
+	case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return "GL_COMPRESSED_RGB_S3TC_DXT1_EXT";
+	default: return "?";
+	}
+}
+
+/*
+	Bytes one level occupies in 'format'. This is the nominal size; drivers
+	often pad 3-byte texels to 4, so RGB8 can cost as much as RGBA8.
+*/
+inline size_t texture_level_bytes(TextureFormat format, int width, int height, int channels)
+{
+	if (format == TEXTURE_FORMAT_BC1) return mip_level_bytes(width, height, channels, MIP_ENCODING_BC1);
+	if (format == TEXTURE_FORMAT_RGBA8) return (size_t)width * height * 4;
+	return (size_t)width * height * channels;
+}
+
+// Pads interleaved 1- or 3-channel pixels to RGBA with alpha 255.
+inline void expand_to_rgba(const unsigned char* pixels, size_t count, int channels, unsigned char* out)
+{
+	size_t i;
+	for (i = 0; i < count; i++) {
+		const unsigned char* p = pixels + i * channels;
+		out[4 * i] = p[0];
+		out[4 * i + 1] = p[channels == 3 ? 1 : 0];
+		out[4 * i + 2] = p[channels == 3 ? 2 : 0];
+		out[4 * i + 3] = 255;
+	}
+}
+
+
+// BC1 encoding. Each 4x4 block stores two RGB565 endpoints and a 2-bit index
+// per texel into the palette { c0, c1, (2c0 + c1) / 3, (c0 + 2c1) / 3 }.
+// Endpoints come from the block's principal axis and are then refined by
+// least squares on the chosen indices. Encoding works on the sRGB values as
+// stored, as the hardware decoder interpolates them.
+
+inline uint16_t bc1_pack565(const float colour[3])
+{
+	int r = (int)(colour[0] * (31.0f / 255.0f) + 0.5f);
+	int g = (int)(colour[1] * (63.0f / 255.0f) + 0.5f);
+	int b = (int)(colour[2] * (31.0f / 255.0f) + 0.5f);
+	r = (std::min)((std::max)(r, 0), 31);
+	g = (std::min)((std::max)(g, 0), 63);
+	b = (std::min)((std::max)(b, 0), 31);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void bc1_unpack565(uint16_t value, int colour[3])
+{
+	const int r = (value >> 11) & 31, g = (value >> 5) & 63, b = value & 31;
+	colour[0] = (r << 3) | (r >> 2);
+	colour[1] = (g << 2) | (g >> 4);
+	colour[2] = (b << 3) | (b >> 2);
+}
+
+/*
+	Picks the closest palette entry for each texel of 'block' with endpoints
+	c0 > c1 (four-colour mode). Returns the packed indices; 'error' receives
+	the summed squared error.
+*/
+inline uint32_t bc1_indices(const int block[16][3], uint16_t c0, uint16_t c1, int& error)
+{
+	int palette[4][3];
+	bc1_unpack565(c0, palette[0]);
+	bc1_unpack565(c1, palette[1]);
+	int k;
+	for (k = 0; k < 3; k++) {
+		palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+		palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+	}
+
+	uint32_t indices = 0;
+	error = 0;
+	int i, p;
+	for (i = 0; i < 16; i++) {
+		int best = 0, bestError = 1 << 30;
+		for (p = 0; p < 4; p++) {
+			const int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+			const int e = dr * dr + dg * dg + db * db;
+			if (e < bestError) { bestError = e; best = p; }
+		}
+		indices |= (uint32_t)best << (2 * i);
+		error += bestError;
+	}
+	return indices;
+}
+
+// Encodes endpoints e0, e1 (0-255 floats) as a four-colour block.
+inline void bc1_make_block(const int block[16][3], const float e0[3], const float e1[3], uint16_t& c0, uint16_t& c1, uint32_t& indices, int& error)
+{
+	c0 = bc1_pack565(e0);
+	c1 = bc1_pack565(e1);
+	if (c0 < c1) std::swap(c0, c1);
+	if (c0 == c1) {
+		// Index 0 everywhere: c0 <= c1 would select the three-colour mode.
+		int colour[3], i, k;
+		bc1_unpack565(c0, colour);
+		indices = 0;
+		error = 0;
+		for (i = 0; i < 16; i++) {
+			for (k = 0; k < 3; k++) error += (block[i][k] - colour[k]) * (block[i][k] - colour[k]);
+		}
+		return;
+	}
+	indices = bc1_indices(block, c0, c1, error);
+}
+
+inline void bc1_encode_block(const int block[16][3], unsigned char out[8])
+{
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	int i, k;
+	for (i = 0; i < 16; i++) {
+		for (k = 0; k < 3; k++) mean[k] += block[i][k];
+	}
+	for (k = 0; k < 3; k++) mean[k] /= 16.0f;
+
+	// Covariance: xx, xy, xz, yy, yz, zz.
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (i = 0; i < 16; i++) {
+		const float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+
+	// Principal axis by power iteration.
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	int iteration;
+	for (iteration = 0; iteration < 8; iteration++) {
+		const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		const float largest = (std::max)(fabsf(x), (std::max)(fabsf(y), fabsf(z)));
+		if (largest == 0.0f) break;
+		axis[0] = x / largest; axis[1] = y / largest; axis[2] = z / largest;
+	}
+
+	float lowest = 1e30f, highest = -1e30f;
+	for (i = 0; i < 16; i++) {
+		const float t = (block[i][0] - mean[0]) * axis[0] + (block[i][1] - mean[1]) * axis[1] + (block[i][2] - mean[2]) * axis[2];
+		lowest = (std::min)(lowest, t);
+		highest = (std::max)(highest, t);
+	}
+	const float length2 = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float e0[3], e1[3];
+	for (k = 0; k < 3; k++) {
+		e0[k] = mean[k] + axis[k] * highest / length2;
+		e1[k] = mean[k] + axis[k] * lowest / length2;
+	}
+
+	uint16_t c0, c1;
+	uint32_t indices;
+	int error;
+	bc1_make_block(block, e0, e1, c0, c1, indices, error);
+
+	// Least-squares endpoints for the chosen indices; kept if they do better.
+	if (c0 != c1) {
+		static const float weight0[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+		for (i = 0; i < 16; i++) {
+			const float a = weight0[(indices >> (2 * i)) & 3], b = 1.0f - a;
+			aa += a * a; bb += b * b; ab += a * b;
+			for (k = 0; k < 3; k++) { ax[k] += a * block[i][k]; bx[k] += b * block[i][k]; }
+		}
+		const float determinant = aa * bb - ab * ab;
+		if (determinant > 1e-6f) {
+			for (k = 0; k < 3; k++) {
+				e0[k] = (ax[k] * bb - bx[k] * ab) / determinant;
+				e1[k] = (bx[k] * aa - ax[k] * ab) / determinant;
+			}
+			uint16_t r0, r1;
+			uint32_t refined;
+			int refinedError;
+			bc1_make_block(block, e0, e1, r0, r1, refined, refinedError);
+			if (refinedError < error) { c0 = r0; c1 = r1; indices = refined; }
+		}
+	}
+
+	out[0] = (unsigned char)c0; out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)c1; out[3] = (unsigned char)(c1 >> 8);
+	for (k = 0; k < 4; k++) out[4 + k] = (unsigned char)(indices >> (8 * k));
+}
+
+/*
+	Encodes a width x height image with 'channels' interleaved channels to
+	BC1 blocks in 'out' (mip_level_bytes(.., MIP_ENCODING_BC1) bytes). Edge
+	blocks repeat the last row and column. Rows of blocks are spread over
+	thread_pool().
+*/
+inline void bc1_encode(const unsigned char* pixels, int width, int height, int channels, unsigned char* out)
+{
+	const int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	thread_pool().run(blocksHigh, [&](size_t by) {
+		int block[16][3];
+		int bx, x, y;
+		for (bx = 0; bx < blocksWide; bx++) {
+			for (y = 0; y < 4; y++) {
+				for (x = 0; x < 4; x++) {
+					const int px = (std::min)(bx * 4 + x, width - 1), py = (std::min)((int)by * 4 + y, height - 1);
+					const unsigned char* p = pixels + ((size_t)py * width + px) * channels;
+					block[y * 4 + x][0] = p[0];
+					block[y * 4 + x][1] = p[channels == 3 ? 1 : 0];
+					block[y * 4 + x][2] = p[channels == 3 ? 2 : 0];
+				}
+			}
+			bc1_encode_block(block, out + ((size_t)by * blocksWide + bx) * 8);
+		}
+	});
+}
+
+// Decodes BC1 blocks back to 'width' x 'height' RGB pixels.
+inline void bc1_decode(const unsigned char* blocks, int width, int height, unsigned char* out)
+{
+	const int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+	int bx, by, i, k;
+	for (by = 0; by < blocksHigh; by++) {
+		for (bx = 0; bx < blocksWide; bx++) {
+			const unsigned char* b = blocks + ((size_t)by * blocksWide + bx) * 8;
+			const uint16_t c0 = (uint16_t)(b[0] | (b[1] << 8)), c1 = (uint16_t)(b[2] | (b[3] << 8));
+			const uint32_t indices = b[4] | (b[5] << 8) | (b[6] << 16) | ((uint32_t)b[7] << 24);
+			int palette[4][3];
+			bc1_unpack565(c0, palette[0]);
+			bc1_unpack565(c1, palette[1]);
+			for (k = 0; k < 3; k++) {
+				if (c0 > c1) {
+					palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+					palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+				} else {
+					palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+					palette[3][k] = 0;
+				}
+			}
+			for (i = 0; i < 16; i++) {
+				const int x = bx * 4 + i % 4, y = by * 4 + i / 4;
+				if (x >= width || y >= height) continue;
+				const int* colour = palette[(indices >> (2 * i)) & 3];
+				for (k = 0; k < 3; k++) out[((size_t)y * width + x) * 3 + k] = (unsigned char)colour[k];
+			}
+		}
+	}
+}
+
+// Replaces every level's pixels with its BC1 blocks.
+inline void bc1_encode_levels(std::vector<MipLevel>& levels, int channels)
+{
+	size_t i;
+	for (i = 0; i < levels.size(); i++) {
+		std::vector<unsigned char> blocks(mip_level_bytes(levels[i].width, levels[i].height, channels, MIP_ENCODING_BC1));
+		bc1_encode(&levels[i].pixels[0], levels[i].width, levels[i].height, channels, &blocks[0]);
+		levels[i].pixels.swap(blocks);
+	}
+}
+
+
+// Running record of texture memory, so budgets can be checked as assets
+// are added. Entries use the nominal sizes from texture_level_bytes().
+
+struct TextureMemoryEntry
+{
+	std::string name;
+	GLint internalFormat;
+	int width;
+	int height;
+	int levels;
+	size_t bytes;
+};
+
+inline std::vector<TextureMemoryEntry>& texture_memory_entries()
+{
+	static std::vector<TextureMemoryEntry> entries;
+	return entries;
+}
+
+inline void texture_memory_record(const char* name, GLint internalFormat, int width, int height, int levels, size_t bytes)
+{
+	TextureMemoryEntry entry;
+	entry.name = name;
+	entry.internalFormat = internalFormat;
+	entry.width = width;
+	entry.height = height;
+	entry.levels = levels;
+	entry.bytes = bytes;
+	texture_memory_entries().push_back(entry);
+}
+
+inline size_t texture_memory_total()
+{
+	const std::vector<TextureMemoryEntry>& entries = texture_memory_entries();
+	size_t total = 0, i;
+	for (i = 0; i < entries.size(); i++) total += entries[i].bytes;
+	return total;
+}
+
+inline void print_texture_memory_report()
+{
+	const std::vector<TextureMemoryEntry>& entries = texture_memory_entries();
+	size_t i;
+	for (i = 0; i < entries.size(); i++) {
+		const TextureMemoryEntry& e = entries[i];
+		printf("Texture '%s': %dx%d, %d level(s), %s, %.1f KB\n", e.name.c_str(), e.width, e.height, e.levels, texture_internal_format_name(e.internalFormat), e.bytes / 1024.0);
+	}
+	printf("Texture memory: %u texture(s), %.1f KB\n", (unsigned)entries.size(), texture_memory_total() / 1024.0);
+}
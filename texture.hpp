@@ -0,0 +1,223 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdio.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "glextensions.hpp"
+#include "mipmap.hpp"
+#include "texformat.hpp"
+#include "ppmimage.hpp"
+
+
+// Texture upload from image files.
+
+// Largest block of pixels handed to GL in one call. Bigger images are
+// uploaded in bands of rows with glTexSubImage2D, which bounds both our
+// decode buffer and the driver's staging copy. They also skip the CPU
+// mipmap pyramid, whose float planes would need several times the image.
+const size_t TEXTURE_BAND_BYTES = 8 << 20;
+
+/*
+	Loads a PPM/PGM file into level 0 of the bound GL_TEXTURE_2D with the
+	given internal format. 8-bit binary files are passed to GL straight from
+	the file mapping; other files are decoded one band at a time. The first
+	file row becomes t = 0, as glmReadPPM uploaded it. Needs a current GL
+	context; returns false if the file cannot be read.
+*/
+inline bool load_texture_ppm(const char* path, GLint internalFormat, int* width = NULL, int* height = NULL, size_t bandBytes = TEXTURE_BAND_BYTES)
+{
+	PpmImage image;
+	if (!image.open(path)) return false;
+
+	const int w = image.width(), h = image.height();
+	const GLenum format = image.channels() == 3 ? GL_RGB : GL_LUMINANCE;
+	const size_t rowBytes = image.rowBytes();
+	const int bandRows = (int)(std::max)((size_t)1, (std::min)((size_t)h, bandBytes / rowBytes));
+
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	bool ok = true;
+	if (image.pixels() != NULL && bandRows == h) {
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, image.pixels());
+	} else {
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, w, h, 0, format, GL_UNSIGNED_BYTE, NULL);
+		std::vector<unsigned char> band;
+		if (image.pixels() == NULL) band.resize(rowBytes * bandRows);
+
+		int y;
+		for (y = 0; ok && y < h; y += bandRows) {
+			const int rows = (std::min)(bandRows, h - y);
+			const unsigned char* src = image.pixels() != NULL ? image.pixels() + rowBytes * y : NULL;
+			if (src == NULL) {
+				ok = image.readRows(rows, &band[0]);
+				src = &band[0];
+			}
+			if (ok) glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, w, rows, format, GL_UNSIGNED_BYTE, src);
+		}
+		if (!ok) printf("'%s' has malformed pixel data.\n", path);
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	if (width != NULL) *width = w;
+	if (height != NULL) *height = h;
+	return ok;
+}
+
+/*
+	Uploads a pyramid as levels 0 .. n-1 of the bound GL_TEXTURE_2D in
+	'format' (resolved, not TEXTURE_FORMAT_AUTO), padding the pixels to RGBA
+	first for TEXTURE_FORMAT_RGBA8. BC1 levels must already be encoded.
+	Limits GL_TEXTURE_MAX_LEVEL to the levels supplied and returns the bytes
+	uploaded.
+*/
+inline size_t upload_mipmaps(const std::vector<MipLevel>& levels, TextureFormat format, int channels)
+{
+	const GLint internalFormat = texture_internal_format(format, channels);
+	const GLenum clientFormat = channels == 3 ? GL_RGB : GL_LUMINANCE;
+
+	GLint alignment;
+	glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	std::vector<unsigned char> rgba;
+	size_t bytes = 0, i;
+	for (i = 0; i < levels.size(); i++) {
+		const MipLevel& level = levels[i];
+		if (format == TEXTURE_FORMAT_BC1) {
+			gl_extensions().CompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, (GLsizei)level.pixels.size(), &level.pixels[0]);
+		} else if (format == TEXTURE_FORMAT_RGBA8) {
+			rgba.resize((size_t)level.width * level.height * 4);
+			expand_to_rgba(&level.pixels[0], (size_t)level.width * level.height, channels, &rgba[0]);
+			glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+		} else {
+			glTexImage2D(GL_TEXTURE_2D, (GLint)i, internalFormat, level.width, level.height, 0, clientFormat, GL_UNSIGNED_BYTE, &level.pixels[0]);
+		}
+		bytes += texture_level_bytes(format, level.width, level.height, channels);
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)levels.size() - 1);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+	return bytes;
+}
+
+// Mipmap pyramid of an image file, built off the render thread.
+struct TexturePyramid
+{
+	std::string path;
+	int channels;
+	MipEncoding encoding;
+	bool streamed;                  // Larger than TEXTURE_BAND_BYTES: no levels, the upload streams the file.
+	std::vector<MipLevel> levels;   // Empty if the file could not be read or is streamed.
+};
+
+/*
+	Storage a texture requested as 'format' is built with: BC1 blocks if the
+	context can sample them, raw pixels otherwise (in which case 'format'
+	falls back). Needs a current GL context.
+*/
+inline MipEncoding texture_encoding(TextureFormat& format)
+{
+	if (format == TEXTURE_FORMAT_BC1) format = choose_texture_format(format, 0, 3);
+	return format == TEXTURE_FORMAT_BC1 ? MIP_ENCODING_BC1 : MIP_ENCODING_RAW;
+}
+
+/*
+	Builds the gamma-correct mipmap pyramid of a PPM/PGM file with 'filter',
+	stored with 'encoding'. The pyramid is read from "<path>.mipcache" when
+	that is up to date, and otherwise built and written there for the next
+	run. Images larger than TEXTURE_BAND_BYTES get no pyramid and are marked
+	'streamed' instead. Makes no GL calls, so it can run on a loader thread.
+*/
+inline bool build_texture_pyramid(const char* path, MipEncoding encoding, MipFilter filter, TexturePyramid& pyramid)
+{
+	pyramid.path = path;
+	pyramid.encoding = encoding;
+	pyramid.streamed = false;
+	pyramid.levels.clear();
+	if (load_mip_cache(path, filter, encoding, pyramid.channels, pyramid.levels)) return true;
+
+	PpmImage image;
+	if (!image.open(path)) return false;
+	pyramid.channels = image.channels();
+	if (image.rowBytes() * image.height() > TEXTURE_BAND_BYTES) {
+		printf("'%s' is %dx%d; streaming it to GL in bands without a CPU mipmap pyramid.\n", path, image.width(), image.height());
+		pyramid.encoding = MIP_ENCODING_RAW;
+		pyramid.streamed = true;
+		return true;
+	}
+
+	const unsigned char* pixels = image.pixels();
+	std::vector<unsigned char> decoded;
+	if (pixels == NULL) {
+		decoded.resize(image.rowBytes() * image.height());
+		if (!image.readRows(image.height(), &decoded[0])) {
+			printf("'%s' has malformed pixel data.\n", path);
+			return false;
+		}
+		pixels = &decoded[0];
+	}
+
+	build_mipmaps(pixels, image.width(), image.height(), pyramid.channels, filter, pyramid.levels);
+	if (encoding == MIP_ENCODING_BC1) bc1_encode_levels(pyramid.levels, pyramid.channels);
+	printf("Built %u mipmap levels for '%s' (%s filter).\n", (unsigned)pyramid.levels.size(), path, mip_filter_name(filter));
+	save_mip_cache(path, filter, encoding, pyramid.channels, pyramid.levels);
+	return true;
+}
+
+/*
+	Streams a large image into the bound GL_TEXTURE_2D with
+	load_texture_ppm() and has GL derive the mipmaps (GL 1.4; not gamma
+	correct, unlike the CPU pyramid). Without GL 1.4 the texture keeps only
+	level 0. Returns false if the file cannot be read.
+*/
+inline bool upload_texture_streamed(const TexturePyramid& pyramid, TextureFormat format, int& width, int& height)
+{
+	PpmImage image;
+	if (!image.open(pyramid.path.c_str())) return false;
+	format = choose_texture_format(format == TEXTURE_FORMAT_BC1 ? TEXTURE_FORMAT_AUTO : format, image.width(), pyramid.channels);
+	image.close();
+
+	const GLint internalFormat = texture_internal_format(format, pyramid.channels);
+	const bool generate = gl_version() >= 14;
+	glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, generate ? GL_TRUE : GL_FALSE);
+	if (!load_texture_ppm(pyramid.path.c_str(), internalFormat, &width, &height)) return false;
+
+	int levels = 1, w = width, h = height;
+	size_t bytes = texture_level_bytes(format, w, h, pyramid.channels);
+	while (generate && (w > 1 || h > 1)) {
+		w = (std::max)(1, w / 2);
+		h = (std::max)(1, h / 2);
+		bytes += texture_level_bytes(format, w, h, pyramid.channels);
+		levels++;
+	}
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+	texture_memory_record(pyramid.path.c_str(), internalFormat, width, height, levels, bytes);
+	return true;
+}
+
+/*
+	Uploads a pyramid into the bound GL_TEXTURE_2D as 'format' (see
+	choose_texture_format; BC1 only if the pyramid was built that way),
+	streaming the file instead if the pyramid is 'streamed', and records it
+	in the texture memory report. Returns false if there was nothing to
+	upload; otherwise sets the size of level 0.
+*/
+inline bool upload_texture_pyramid(const TexturePyramid& pyramid, TextureFormat format, int& width, int& height)
+{
+	if (pyramid.streamed) return upload_texture_streamed(pyramid, format, width, height);
+	if (pyramid.levels.empty()) return false;
+	if (pyramid.encoding == MIP_ENCODING_BC1) format = TEXTURE_FORMAT_BC1;
+	else if (format == TEXTURE_FORMAT_BC1) format = TEXTURE_FORMAT_AUTO;
+
+	const MipLevel& base = pyramid.levels[0];
+	format = choose_texture_format(format, base.width, pyramid.channels);
+	size_t bytes = upload_mipmaps(pyramid.levels, format, pyramid.channels);
+	texture_memory_record(pyramid.path.c_str(), texture_internal_format(format, pyramid.channels), base.width, base.height, (int)pyramid.levels.size(), bytes);
+	width = base.width;
+	height = base.height;
+	return true;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed-size pool of worker threads for data-parallel loops.
+// The thread calling run() works on its own batch too, so run() may be
+// called from inside a task without deadlocking.
+class ThreadPool
+{
+public:
+	// 'threads' counts the calling thread; 0 means one per hardware thread.
+	explicit ThreadPool(unsigned threads = 0)
+	{
+		if (threads == 0) threads = std::thread::hardware_concurrency();
+		if (threads == 0) threads = 1;
+
+		m_stop = false;
+		unsigned i;
+		for (i = 1; i < threads; i++)
+			m_workers.push_back(std::thread(&ThreadPool::worker, this));
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_stop = true;
+		}
+		m_wake.notify_all();
+		size_t i;
+		for (i = 0; i < m_workers.size(); i++) m_workers[i].join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of threads that can work on a batch at once.
+	unsigned size() const { return (unsigned)m_workers.size() + 1; }
+
+	// Runs task(i) for every i in [0, count) and returns once all are done.
+	void run(size_t count, const std::function<void(size_t)>& task)
+	{
+		if (count == 0) return;
+
+		Batch batch;
+		batch.task = &task;
+		batch.count = count;
+		batch.next = 0;
+		batch.done = 0;
+		batch.users = 0;
+
+		if (count > 1 && !m_workers.empty()) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_batches.push_back(&batch);
+			m_wake.notify_all();
+		}
+
+		size_t finished = drain(batch);
+
+		std::unique_lock<std::mutex> lock(m_mutex);
+		retire(&batch);
+		batch.done += finished;
+		m_finished.wait(lock, [&batch] { return batch.done == batch.count && batch.users == 0; });
+	}
+
+private:
+	struct Batch
+	{
+		const std::function<void(size_t)>* task;
+		size_t count;
+		std::atomic<size_t> next;
+		size_t done;   // Guarded by m_mutex.
+		size_t users;  // Workers currently draining this batch, guarded by m_mutex.
+	};
+
+	static size_t drain(Batch& batch)
+	{
+		size_t finished = 0;
+		while (true) {
+			size_t i = batch.next.fetch_add(1);
+			if (i >= batch.count) break;
+			(*batch.task)(i);
+			finished++;
+		}
+		return finished;
+	}
+
+	// Removes an exhausted batch from the queue. Caller holds m_mutex.
+	void retire(Batch* batch)
+	{
+		std::deque<Batch*>::iterator it;
+		for (it = m_batches.begin(); it != m_batches.end(); ++it) {
+			if (*it == batch) { m_batches.erase(it); break; }
+		}
+	}
+
+	void worker()
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		while (true) {
+			m_wake.wait(lock, [this] { return m_stop || !m_batches.empty(); });
+			if (m_stop) return;
+
+			Batch* batch = m_batches.front();
+			batch->users++;
+			lock.unlock();
+
+			size_t finished = drain(*batch);
+
+			lock.lock();
+			retire(batch);
+			batch->done += finished;
+			batch->users--;
+			if (batch->done == batch->count && batch->users == 0) m_finished.notify_all();
+		}
+	}
+
+	std::vector<std::thread> m_workers;
+	std::deque<Batch*> m_batches;
+	std::mutex m_mutex;
+	std::condition_variable m_wake;
+	std::condition_variable m_finished;
+	bool m_stop;
+};
+
+
+// Process-wide pool, created on first use.
+inline ThreadPool& thread_pool()
+{
+	static ThreadPool pool;
+	return pool;
+}
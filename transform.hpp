@@ -0,0 +1,208 @@
+#pragma once
+
+#include <math.h>
+#include <string.h>
+
+
+// 4x4 float matrices in OpenGL's column-major layout (m[column * 4 + row]),
+// with the same conventions as the fixed-function matrix calls, so a Mat4
+// built here can be passed to glLoadMatrixf and vice versa.
+
+struct Mat4
+{
+	float m[16];
+};
+
+inline Mat4 mat4_identity()
+{
+	Mat4 r = {};
+	r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+	return r;
+}
+
+// a * b, i.e. b is applied first (as glMultMatrix does).
+inline Mat4 mat4_multiply(const Mat4& a, const Mat4& b)
+{
+	Mat4 r;
+	int column, row;
+	for (column = 0; column < 4; column++) {
+		for (row = 0; row < 4; row++) {
+			r.m[column * 4 + row] = a.m[row] * b.m[column * 4] + a.m[4 + row] * b.m[column * 4 + 1]
+				+ a.m[8 + row] * b.m[column * 4 + 2] + a.m[12 + row] * b.m[column * 4 + 3];
+		}
+	}
+	return r;
+}
+
+// Same matrix as gluLookAt.
+inline Mat4 mat4_look_at(float eyeX, float eyeY, float eyeZ, float centerX, float centerY, float centerZ, float upX, float upY, float upZ)
+{
+	float f[3] = { centerX - eyeX, centerY - eyeY, centerZ - eyeZ };
+	float length = sqrtf(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+	if (length > 0.0f) { f[0] /= length; f[1] /= length; f[2] /= length; }
+
+	float s[3] = { f[1] * upZ - f[2] * upY, f[2] * upX - f[0] * upZ, f[0] * upY - f[1] * upX };
+	length = sqrtf(s[0] * s[0] + s[1] * s[1] + s[2] * s[2]);
+	if (length > 0.0f) { s[0] /= length; s[1] /= length; s[2] /= length; }
+
+	const float u[3] = { s[1] * f[2] - s[2] * f[1], s[2] * f[0] - s[0] * f[2], s[0] * f[1] - s[1] * f[0] };
+
+	Mat4 r = mat4_identity();
+	int i;
+	for (i = 0; i < 3; i++) {
+		r.m[i * 4] = s[i];
+		r.m[i * 4 + 1] = u[i];
+		r.m[i * 4 + 2] = -f[i];
+	}
+	r.m[12] = -(s[0] * eyeX + s[1] * eyeY + s[2] * eyeZ);
+	r.m[13] = -(u[0] * eyeX + u[1] * eyeY + u[2] * eyeZ);
+	r.m[14] = f[0] * eyeX + f[1] * eyeY + f[2] * eyeZ;
+	return r;
+}
+
+// Same matrix as gluPerspective (fovy in degrees).
+inline Mat4 mat4_perspective(float fovy, float aspect, float zNear, float zFar)
+{
+	const float f = 1.0f / tanf(fovy * 3.14159265f / 360.0f);
+	Mat4 r = {};
+	r.m[0] = f / aspect;
+	r.m[5] = f;
+	r.m[10] = (zFar + zNear) / (zNear - zFar);
+	r.m[11] = -1.0f;
+	r.m[14] = 2.0f * zFar * zNear / (zNear - zFar);
+	return r;
+}
+
+// Same matrix as glTranslatef.
+inline Mat4 mat4_translate(float x, float y, float z)
+{
+	Mat4 r = mat4_identity();
+	r.m[12] = x;
+	r.m[13] = y;
+	r.m[14] = z;
+	return r;
+}
+
+// Same matrix as glScalef.
+inline Mat4 mat4_scale(float x, float y, float z)
+{
+	Mat4 r = mat4_identity();
+	r.m[0] = x;
+	r.m[5] = y;
+	r.m[10] = z;
+	return r;
+}
+
+// Same matrix as glRotatef (angle in degrees, axis need not be unit length).
+inline Mat4 mat4_rotate(float angle, float x, float y, float z)
+{
+	Mat4 r = mat4_identity();
+	float length = sqrtf(x * x + y * y + z * z);
+	if (length == 0.0f) return r;
+	x /= length; y /= length; z /= length;
+
+	const float radians = angle * 3.14159265f / 180.0f;
+	const float c = cosf(radians), s = sinf(radians), t = 1.0f - c;
+	r.m[0] = x * x * t + c;     r.m[4] = x * y * t - z * s; r.m[8] = x * z * t + y * s;
+	r.m[1] = y * x * t + z * s; r.m[5] = y * y * t + c;     r.m[9] = y * z * t - x * s;
+	r.m[2] = z * x * t - y * s; r.m[6] = z * y * t + x * s; r.m[10] = z * z * t + c;
+	return r;
+}
+
+/*
+	General inverse (cofactor expansion, as gluUnProject does). Returns false
+	and leaves 'out' untouched if the matrix is singular.
+*/
+inline bool mat4_inverse(const Mat4& a, Mat4& out)
+{
+	const float* m = a.m;
+	float inv[16];
+	inv[0] = m[5] * m[10] * m[15] - m[5] * m[11] * m[14] - m[9] * m[6] * m[15] + m[9] * m[7] * m[14] + m[13] * m[6] * m[11] - m[13] * m[7] * m[10];
+	inv[4] = -m[4] * m[10] * m[15] + m[4] * m[11] * m[14] + m[8] * m[6] * m[15] - m[8] * m[7] * m[14] - m[12] * m[6] * m[11] + m[12] * m[7] * m[10];
+	inv[8] = m[4] * m[9] * m[15] - m[4] * m[11] * m[13] - m[8] * m[5] * m[15] + m[8] * m[7] * m[13] + m[12] * m[5] * m[11] - m[12] * m[7] * m[9];
+	inv[12] = -m[4] * m[9] * m[14] + m[4] * m[10] * m[13] + m[8] * m[5] * m[14] - m[8] * m[6] * m[13] - m[12] * m[5] * m[10] + m[12] * m[6] * m[9];
+	inv[1] = -m[1] * m[10] * m[15] + m[1] * m[11] * m[14] + m[9] * m[2] * m[15] - m[9] * m[3] * m[14] - m[13] * m[2] * m[11] + m[13] * m[3] * m[10];
+	inv[5] = m[0] * m[10] * m[15] - m[0] * m[11] * m[14] - m[8] * m[2] * m[15] + m[8] * m[3] * m[14] + m[12] * m[2] * m[11] - m[12] * m[3] * m[10];
+	inv[9] = -m[0] * m[9] * m[15] + m[0] * m[11] * m[13] + m[8] * m[1] * m[15] - m[8] * m[3] * m[13] - m[12] * m[1] * m[11] + m[12] * m[3] * m[9];
+	inv[13] = m[0] * m[9] * m[14] - m[0] * m[10] * m[13] - m[8] * m[1] * m[14] + m[8] * m[2] * m[13] + m[12] * m[1] * m[10] - m[12] * m[2] * m[9];
+	inv[2] = m[1] * m[6] * m[15] - m[1] * m[7] * m[14] - m[5] * m[2] * m[15] + m[5] * m[3] * m[14] + m[13] * m[2] * m[7] - m[13] * m[3] * m[6];
+	inv[6] = -m[0] * m[6] * m[15] + m[0] * m[7] * m[14] + m[4] * m[2] * m[15] - m[4] * m[3] * m[14] - m[12] * m[2] * m[7] + m[12] * m[3] * m[6];
+	inv[10] = m[0] * m[5] * m[15] - m[0] * m[7] * m[13] - m[4] * m[1] * m[15] + m[4] * m[3] * m[13] + m[12] * m[1] * m[7] - m[12] * m[3] * m[5];
+	inv[14] = -m[0] * m[5] * m[14] + m[0] * m[6] * m[13] + m[4] * m[1] * m[14] - m[4] * m[2] * m[13] - m[12] * m[1] * m[6] + m[12] * m[2] * m[5];
+	inv[3] = -m[1] * m[6] * m[11] + m[1] * m[7] * m[10] + m[5] * m[2] * m[11] - m[5] * m[3] * m[10] - m[9] * m[2] * m[7] + m[9] * m[3] * m[6];
+	inv[7] = m[0] * m[6] * m[11] - m[0] * m[7] * m[10] - m[4] * m[2] * m[11] + m[4] * m[3] * m[10] + m[8] * m[2] * m[7] - m[8] * m[3] * m[6];
+	inv[11] = -m[0] * m[5] * m[11] + m[0] * m[7] * m[9] + m[4] * m[1] * m[11] - m[4] * m[3] * m[9] - m[8] * m[1] * m[7] + m[8] * m[3] * m[5];
+	inv[15] = m[0] * m[5] * m[10] - m[0] * m[6] * m[9] - m[4] * m[1] * m[10] + m[4] * m[2] * m[9] + m[8] * m[1] * m[6] - m[8] * m[2] * m[5];
+
+	float determinant = m[0] * inv[0] + m[1] * inv[4] + m[2] * inv[8] + m[3] * inv[12];
+	if (determinant == 0.0f) return false;
+
+	int i;
+	for (i = 0; i < 16; i++) out.m[i] = inv[i] / determinant;
+	return true;
+}
+
+// out = m * (x, y, z, w)
+inline void mat4_transform(const Mat4& a, float x, float y, float z, float w, float out[4])
+{
+	const float* m = a.m;
+	out[0] = m[0] * x + m[4] * y + m[8] * z + m[12] * w;
+	out[1] = m[1] * x + m[5] * y + m[9] * z + m[13] * w;
+	out[2] = m[2] * x + m[6] * y + m[10] * z + m[14] * w;
+	out[3] = m[3] * x + m[7] * y + m[11] * z + m[15] * w;
+}
+
+/*
+	The ray through the centre of window pixel (x, y), counted from the top
+	left as GLUT reports mouse positions, in the space 'modelview' maps from:
+	it starts on the near plane and reaches the far plane at t = 1 (the
+	points gluUnProject gives for depths 0 and 1). Returns false if the
+	matrices are singular.
+*/
+inline bool mat4_pick_ray(const Mat4& projection, const Mat4& modelview, int x, int y, int width, int height, float origin[3], float direction[3])
+{
+	Mat4 inverse;
+	if (width <= 0 || height <= 0 || !mat4_inverse(mat4_multiply(projection, modelview), inverse)) return false;
+
+	const float ndcX = 2.0f * (x + 0.5f) / width - 1.0f;
+	const float ndcY = 1.0f - 2.0f * (y + 0.5f) / height;
+	float nearPoint[4], farPoint[4];
+	mat4_transform(inverse, ndcX, ndcY, -1.0f, 1.0f, nearPoint);
+	mat4_transform(inverse, ndcX, ndcY, 1.0f, 1.0f, farPoint);
+	if (nearPoint[3] == 0.0f || farPoint[3] == 0.0f) return false;
+
+	int k;
+	for (k = 0; k < 3; k++) {
+		origin[k] = nearPoint[k] / nearPoint[3];
+		direction[k] = farPoint[k] / farPoint[3] - origin[k];
+	}
+	return true;
+}
+
+/*
+	The matrix GL uses for normals: the inverse transpose of the upper 3x3,
+	column-major like Mat4. Falls back to the plain 3x3 if it is singular.
+*/
+inline void mat4_normal_matrix(const Mat4& a, float out[9])
+{
+	const float* m = a.m;
+	// Cofactors of the upper 3x3 (column-major), i.e. determinant * inverse transpose.
+	float c[9];
+	c[0] = m[5] * m[10] - m[9] * m[6];
+	c[1] = m[8] * m[6] - m[4] * m[10];
+	c[2] = m[4] * m[9] - m[8] * m[5];
+	c[3] = m[9] * m[2] - m[1] * m[10];
+	c[4] = m[0] * m[10] - m[8] * m[2];
+	c[5] = m[8] * m[1] - m[0] * m[9];
+	c[6] = m[1] * m[6] - m[5] * m[2];
+	c[7] = m[4] * m[2] - m[0] * m[6];
+	c[8] = m[0] * m[5] - m[4] * m[1];
+	float determinant = m[0] * c[0] + m[1] * c[1] + m[2] * c[2];
+
+	int column, row;
+	for (column = 0; column < 3; column++) {
+		for (row = 0; row < 3; row++) {
+			out[column * 3 + row] = determinant != 0.0f ? c[column * 3 + row] / determinant : m[column * 4 + row];
+		}
+	}
+}
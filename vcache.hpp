@@ -0,0 +1,345 @@
+#pragma once
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <algorithm>
+#include <utility>
+#include <vector>
+#include "mesh.hpp"
+
+
+// Triangle and vertex order for the GPU. OBJ files list faces in whatever
+// order the modelling tool wrote them, so consecutive triangles rarely share
+// vertices and the post-transform vertex cache keeps missing. The passes
+// here reorder the triangles for cache reuse (Forsyth's linear-speed
+// algorithm), group them into clusters drawn outside-in to cut overdraw, and
+// renumber the vertices in the order they are first fetched; cluster_mesh()
+// (clusters.hpp) runs them in that order. The cache is simulated, so the
+// effect can be measured without a GPU.
+
+// Cache size the Forsyth scores model, and the caches the report simulates.
+const int VCACHE_SCORE_SIZE = 32;
+const int VCACHE_FIFO_SIZE = 16;
+const int VCACHE_LRU_SIZE = 32;
+
+enum VertexCacheModel
+{
+	VCACHE_FIFO,  // Older fixed-function and most desktop hardware.
+	VCACHE_LRU    // What the Forsyth scores assume.
+};
+
+struct VertexCacheStats
+{
+	double acmr;  // Vertex shader runs per triangle: 3 at worst, about 0.5 at best for a closed mesh.
+	double atvr;  // Vertex shader runs per vertex used: 1 at best.
+};
+
+/*
+	Replays the index buffer through a simulated post-transform cache of
+	'cacheSize' entries and counts the misses.
+*/
+inline VertexCacheStats vcache_simulate(const uint32_t* indices, size_t triangleCount, size_t vertexCount, VertexCacheModel model, int cacheSize)
+{
+	std::vector<uint32_t> cache;  // Most recent entry at the back.
+	std::vector<unsigned char> used(vertexCount, 0);
+	size_t misses = 0, unique = 0, i;
+	for (i = 0; i < triangleCount * 3; i++) {
+		const uint32_t v = indices[i];
+		if (!used[v]) {
+			used[v] = 1;
+			unique++;
+		}
+
+		std::vector<uint32_t>::iterator hit = std::find(cache.begin(), cache.end(), v);
+		if (hit != cache.end()) {
+			if (model == VCACHE_LRU) {
+				cache.erase(hit);
+				cache.push_back(v);
+			}
+			continue;
+		}
+		misses++;
+		if ((int)cache.size() == cacheSize) cache.erase(cache.begin());
+		cache.push_back(v);
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = triangleCount > 0 ? (double)misses / triangleCount : 0.0;
+	stats.atvr = unique > 0 ? (double)misses / unique : 0.0;
+	return stats;
+}
+
+// Cache behaviour of a mesh under both simulated caches.
+struct VertexCacheReport
+{
+	VertexCacheStats fifo;
+	VertexCacheStats lru;
+};
+
+inline VertexCacheReport vcache_report(const Mesh& mesh)
+{
+	VertexCacheReport report;
+	report.fifo = vcache_simulate(mesh.indices.data(), mesh.triangleCount(), mesh.vertexCount(), VCACHE_FIFO, VCACHE_FIFO_SIZE);
+	report.lru = vcache_simulate(mesh.indices.data(), mesh.triangleCount(), mesh.vertexCount(), VCACHE_LRU, VCACHE_LRU_SIZE);
+	return report;
+}
+
+inline void print_vcache_report(const char* name, const VertexCacheReport& before, const VertexCacheReport& after)
+{
+	printf("Vertex cache '%s': FIFO %d ACMR %.3f -> %.3f, ATVR %.3f -> %.3f; LRU %d ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n",
+		name, VCACHE_FIFO_SIZE, before.fifo.acmr, after.fifo.acmr, before.fifo.atvr, after.fifo.atvr,
+		VCACHE_LRU_SIZE, before.lru.acmr, after.lru.acmr, before.lru.atvr, after.lru.atvr);
+}
+
+/*
+	Forsyth's vertex score. Vertices used recently score high (the three of
+	the last triangle get a fixed 0.75, so the next triangle does not only
+	reuse its edge), and vertices with few triangles left score higher so
+	that lone triangles are not left behind to cost a full miss later.
+*/
+inline float vcache_vertex_score_exact(int cachePosition, uint32_t remaining)
+{
+	if (remaining == 0) return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) score = 0.75f;
+		else score = powf(1.0f - (float)(cachePosition - 3) / (VCACHE_SCORE_SIZE - 3), 1.5f);
+	}
+	return score + 2.0f * powf((float)remaining, -0.5f);
+}
+
+// The scores for every cache position and the common live counts, so the
+// optimiser's inner loop does no powf.
+const uint32_t VCACHE_VALENCE_TABLE = 32;
+
+struct VertexScoreTable
+{
+	float scores[VCACHE_SCORE_SIZE + 1][VCACHE_VALENCE_TABLE];  // [position + 1][remaining]
+
+	VertexScoreTable()
+	{
+		int p;
+		uint32_t r;
+		for (p = -1; p < VCACHE_SCORE_SIZE; p++)
+			for (r = 0; r < VCACHE_VALENCE_TABLE; r++) scores[p + 1][r] = vcache_vertex_score_exact(p, r);
+	}
+};
+
+inline float vcache_vertex_score(int cachePosition, uint32_t remaining)
+{
+	static const VertexScoreTable table;
+	if (remaining >= VCACHE_VALENCE_TABLE) return vcache_vertex_score_exact(cachePosition, remaining);
+	return table.scores[cachePosition + 1][remaining];
+}
+
+/*
+	Reorders the triangles for post-transform cache reuse: greedily emits
+	the triangle with the best vertex scores among those touching the
+	modelled cache, falling back to the next unemitted triangle in the
+	original order when the cache holds nothing useful. Linear in the
+	number of triangles.
+*/
+inline void optimise_vertex_cache(uint32_t* indices, size_t triangleCount, size_t vertexCount)
+{
+	if (triangleCount == 0) return;
+
+	// Live triangles around each vertex: adjacency[offsets[v] .. offsets[v] + remaining[v]).
+	std::vector<uint32_t> remaining(vertexCount, 0), offsets(vertexCount + 1, 0);
+	size_t i, v;
+	for (i = 0; i < triangleCount * 3; i++) remaining[indices[i]]++;
+	for (v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+
+	std::vector<uint32_t> adjacency(triangleCount * 3), fill(offsets.begin(), offsets.end() - 1);
+	for (i = 0; i < triangleCount * 3; i++) adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<int> position(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (v = 0; v < vertexCount; v++) vertexScore[v] = vcache_vertex_score(-1, remaining[v]);
+
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<unsigned char> emitted(triangleCount, 0);
+	for (i = 0; i < triangleCount; i++)
+		triangleScore[i] = vertexScore[indices[3 * i]] + vertexScore[indices[3 * i + 1]] + vertexScore[indices[3 * i + 2]];
+
+	std::vector<uint32_t> output(triangleCount * 3), cache, nextCache;
+	cache.reserve(VCACHE_SCORE_SIZE + 3);
+	nextCache.reserve(VCACHE_SCORE_SIZE + 3);
+
+	const size_t none = (size_t)-1;
+	size_t best = none, cursor = 0, emittedCount;
+	for (emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+		if (best == none) {
+			while (emitted[cursor]) cursor++;
+			best = cursor;
+		}
+		emitted[best] = 1;
+
+		const uint32_t triangle[3] = { indices[3 * best], indices[3 * best + 1], indices[3 * best + 2] };
+		int c;
+		for (c = 0; c < 3; c++) {
+			output[3 * emittedCount + c] = triangle[c];
+
+			// Swap the triangle to the end of the vertex's live list and shrink it.
+			uint32_t* around = &adjacency[offsets[triangle[c]]];
+			uint32_t& count = remaining[triangle[c]];
+			uint32_t k;
+			for (k = 0; k < count; k++) {
+				if (around[k] == best) {
+					std::swap(around[k], around[count - 1]);
+					count--;
+					break;
+				}
+			}
+		}
+
+		// The triangle's vertices move to the front; entries pushed past the
+		// modelled size are evicted.
+		nextCache.assign(triangle, triangle + 3);
+		for (i = 0; i < cache.size(); i++) {
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				nextCache.push_back(cache[i]);
+		}
+
+		// Rescore every vertex whose position or live count changed, and pass
+		// the change on to its live triangles.
+		uint32_t k;
+		for (i = 0; i < nextCache.size(); i++) {
+			const uint32_t u = nextCache[i];
+			position[u] = i < (size_t)VCACHE_SCORE_SIZE ? (int)i : -1;
+			const float score = vcache_vertex_score(position[u], remaining[u]);
+			const float delta = score - vertexScore[u];
+			vertexScore[u] = score;
+
+			const uint32_t* around = &adjacency[offsets[u]];
+			for (k = 0; k < remaining[u]; k++) triangleScore[around[k]] += delta;
+		}
+		if (nextCache.size() > (size_t)VCACHE_SCORE_SIZE) nextCache.resize(VCACHE_SCORE_SIZE);
+		cache.swap(nextCache);
+
+		// The best live triangle touching the cache goes next.
+		best = none;
+		float bestScore = -1e30f;
+		for (i = 0; i < cache.size(); i++) {
+			const uint32_t* around = &adjacency[offsets[cache[i]]];
+			for (k = 0; k < remaining[cache[i]]; k++) {
+				if (triangleScore[around[k]] > bestScore) {
+					bestScore = triangleScore[around[k]];
+					best = around[k];
+				}
+			}
+		}
+	}
+
+	std::copy(output.begin(), output.end(), indices);
+}
+
+/*
+	Cuts overdraw without giving back the cache order: splits the triangles
+	into clusters where the simulated FIFO cache runs cold (a triangle that
+	misses on all three vertices starts a new cluster), then draws the
+	clusters facing away from the mesh centre first. Those are the outside
+	of the mesh, seen from most directions, so later clusters more often
+	fail the depth test. The order inside each cluster is kept.
+*/
+inline void optimise_overdraw(uint32_t* indices, size_t triangleCount, const Float3Array& positions)
+{
+	if (triangleCount == 0) return;
+
+	// Cluster starts, from a timestamped FIFO: v is cached while fewer than
+	// VCACHE_FIFO_SIZE misses have happened since its own.
+	std::vector<size_t> starts;
+	std::vector<size_t> missedAt(positions.size(), (size_t)-1);
+	size_t misses = 0, i;
+	for (i = 0; i < triangleCount; i++) {
+		int c, cold = 0;
+		for (c = 0; c < 3; c++) {
+			const uint32_t v = indices[3 * i + c];
+			if (missedAt[v] == (size_t)-1 || misses - missedAt[v] >= (size_t)VCACHE_FIFO_SIZE) {
+				missedAt[v] = misses++;
+				cold++;
+			}
+		}
+		if (cold == 3 || i == 0) starts.push_back(i);
+	}
+	starts.push_back(triangleCount);
+
+	// Area-weighted centroid and summed normal of each cluster, and of the mesh.
+	const size_t clusters = starts.size() - 1;
+	std::vector<float> centroids(clusters * 3, 0.0f), normals(clusters * 3, 0.0f);
+	float meshCentroid[3] = { 0.0f, 0.0f, 0.0f }, meshArea = 0.0f;
+	size_t k;
+	for (k = 0; k < clusters; k++) {
+		float area = 0.0f;
+		for (i = starts[k]; i < starts[k + 1]; i++) {
+			const uint32_t a = indices[3 * i], b = indices[3 * i + 1], c = indices[3 * i + 2];
+			const float ux = positions.x[b] - positions.x[a], uy = positions.y[b] - positions.y[a], uz = positions.z[b] - positions.z[a];
+			const float wx = positions.x[c] - positions.x[a], wy = positions.y[c] - positions.y[a], wz = positions.z[c] - positions.z[a];
+			const float nx = uy * wz - uz * wy, ny = uz * wx - ux * wz, nz = ux * wy - uy * wx;
+			const float weight = sqrtf(nx * nx + ny * ny + nz * nz);
+
+			centroids[3 * k] += weight * (positions.x[a] + positions.x[b] + positions.x[c]) / 3.0f;
+			centroids[3 * k + 1] += weight * (positions.y[a] + positions.y[b] + positions.y[c]) / 3.0f;
+			centroids[3 * k + 2] += weight * (positions.z[a] + positions.z[b] + positions.z[c]) / 3.0f;
+			normals[3 * k] += nx;
+			normals[3 * k + 1] += ny;
+			normals[3 * k + 2] += nz;
+			area += weight;
+		}
+		int d;
+		for (d = 0; d < 3; d++) {
+			meshCentroid[d] += centroids[3 * k + d];
+			centroids[3 * k + d] /= area > 0.0f ? area : 1.0f;
+		}
+		meshArea += area;
+	}
+	for (k = 0; k < 3; k++) meshCentroid[k] /= meshArea > 0.0f ? meshArea : 1.0f;
+
+	// How far each cluster faces outward from the centre.
+	std::vector<float> outward(clusters);
+	std::vector<uint32_t> order(clusters);
+	for (k = 0; k < clusters; k++) {
+		const float* n = &normals[3 * k];
+		const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		outward[k] = length > 0.0f ? ((centroids[3 * k] - meshCentroid[0]) * n[0] + (centroids[3 * k + 1] - meshCentroid[1]) * n[1]
+			+ (centroids[3 * k + 2] - meshCentroid[2]) * n[2]) / length : 0.0f;
+		order[k] = (uint32_t)k;
+	}
+	std::stable_sort(order.begin(), order.end(), [&outward](uint32_t a, uint32_t b) { return outward[a] > outward[b]; });
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	for (k = 0; k < clusters; k++)
+		output.insert(output.end(), indices + 3 * starts[order[k]], indices + 3 * starts[order[k] + 1]);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+/*
+	Renumbers the vertices in the order the index buffer first uses them, so
+	vertex fetches walk forward through memory. Vertices no triangle uses
+	are dropped.
+*/
+inline void optimise_vertex_fetch(Mesh& mesh)
+{
+	const uint32_t unused = 0xFFFFFFFFu;
+	std::vector<uint32_t> remap(mesh.vertexCount(), unused);
+	uint32_t next = 0;
+	size_t i;
+	for (i = 0; i < mesh.indices.size(); i++) {
+		uint32_t& target = remap[mesh.indices[i]];
+		if (target == unused) target = next++;
+		mesh.indices[i] = target;
+	}
+
+	Float3Array positions;
+	positions.resize(next);
+	for (i = 0; i < remap.size(); i++) {
+		if (remap[i] == unused) continue;
+		positions.x[remap[i]] = mesh.positions.x[i];
+		positions.y[remap[i]] = mesh.positions.y[i];
+		positions.z[remap[i]] = mesh.positions.z[i];
+	}
+	mesh.positions = std::move(positions);
+}
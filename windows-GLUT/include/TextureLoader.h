@@ -35,6 +35,7 @@ GLubyte* glmReadPPM(char* filename, int* width, int* height) {
   FILE* fp;
   int i, w, h, d;
   unsigned char* image;
+  size_t size;
   char head[70]; /* max line <= 70 in PPM (per spec). */
 
   fp = fopen(filename, "rb");
@@ -45,16 +46,20 @@ GLubyte* glmReadPPM(char* filename, int* width, int* height) {
 
   /* grab first two chars of the file and make sure that it has the
    correct magic cookie for a raw PPM file. */
-  fgets(head, 70, fp);
-  if (strncmp(head, "P6", 2)) {
+  if (!fgets(head, 70, fp) || strncmp(head, "P6", 2)) {
     fprintf(stderr, "%s: Not a raw PPM file\n", filename);
+    fclose(fp);
     return NULL;
   }
 
   /* grab the three elements in the header (width, height, maxval). */
   i = 0;
   while (i < 3) {
-    fgets(head, 70, fp);
+    if (!fgets(head, 70, fp)) {
+      fprintf(stderr, "%s: Truncated PPM header\n", filename);
+      fclose(fp);
+      return NULL;
+    }
     if (head[0] == '#') /* skip comments. */
       continue;
     if (i == 0)
@@ -64,10 +69,21 @@ GLubyte* glmReadPPM(char* filename, int* width, int* height) {
     else if (i == 2)
       i += sscanf(head, "%d", &d);
   }
+  if (w <= 0 || h <= 0 || w > 65536 || h > 65536 || d <= 0 || d > 255) {
+    fprintf(stderr, "%s: Unsupported PPM size %dx%d (max value %d)\n", filename, w, h, d);
+    fclose(fp);
+    return NULL;
+  }
 
   /* grab all the image data in one fell swoop. */
-  image = (unsigned char*)malloc(sizeof(unsigned char)*w*h*3);
-  fread(image, sizeof(unsigned char), w*h*3, fp);
+  size = (size_t)w*h*3;
+  image = (unsigned char*)malloc(sizeof(unsigned char)*size);
+  if (!image || fread(image, sizeof(unsigned char), size, fp) != size) {
+    fprintf(stderr, "%s: Truncated PPM data\n", filename);
+    free(image);
+    fclose(fp);
+    return NULL;
+  }
   fclose(fp);
 
   *width = w;